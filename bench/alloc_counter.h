@@ -0,0 +1,62 @@
+// Global operator new/delete replacements that count live heap bytes and
+// allocations, shared by the benchmarks. Include from exactly one
+// translation unit, after main.cpp.
+
+#ifndef TODO_BENCH_ALLOC_COUNTER_H
+#define TODO_BENCH_ALLOC_COUNTER_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+std::size_t liveBytes = 0;
+std::size_t allocationCount = 0;
+
+// Every block carries its size in a header so delete can account for it.
+const std::size_t kHeaderSize = alignof(std::max_align_t);
+
+// Bytes the allocator actually hands out for a request, including its own
+// chunk header and rounding where that can be queried.
+std::size_t footprint(void* block, std::size_t size) {
+#ifdef __GLIBC__
+    (void)size;
+    return malloc_usable_size(block) + sizeof(std::size_t);
+#else
+    (void)block;
+    return size + kHeaderSize;
+#endif
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    void* block = std::malloc(size + kHeaderSize);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    std::size_t bytes = footprint(block, size);
+    *static_cast<std::size_t*>(block) = bytes;
+    liveBytes += bytes;
+    ++allocationCount;
+    return static_cast<char*>(block) + kHeaderSize;
+}
+
+void operator delete(void* pointer) noexcept {
+    if (!pointer) {
+        return;
+    }
+    void* block = static_cast<char*>(pointer) - kHeaderSize;
+    liveBytes -= *static_cast<std::size_t*>(block);
+    std::free(block);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    operator delete(pointer);
+}
+
+#endif
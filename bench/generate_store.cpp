@@ -0,0 +1,40 @@
+// Writes a synthetic store for benchmarking or manual testing.
+//
+// Build: g++ -std=c++14 -O2 -pthread -o generate_store bench/generate_store.cpp
+// Usage: ./generate_store <task_count> [path] [--binary] [--seed N]
+
+#define TODO_NO_MAIN
+#include "../main.cpp"
+
+#include "workload.h"
+
+int main(int argc, char* argv[]) {
+    int taskCount = 0;
+    std::string path = "todos.txt";
+    StorageFormat format = StorageFormat::Text;
+    unsigned seed = 42;
+
+    bool valid = argc > 1 && parseTaskId(argv[1], argv[1] + std::strlen(argv[1]), taskCount);
+    for (int i = 2; valid && i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--binary") {
+            format = StorageFormat::Binary;
+        } else if (option == "--seed" && i + 1 < argc) {
+            seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (option.compare(0, 2, "--") != 0) {
+            path = option;
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        std::cerr << "Usage: generate_store <task_count> [path] [--binary] [--seed N]" << std::endl;
+        return 1;
+    }
+
+    if (!workload::writeStore(path, format, taskCount, seed)) {
+        return 1;
+    }
+    std::cout << "Wrote " << taskCount << " task(s) to " << path << std::endl;
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Measures heap allocations and wall time for loading a store. The
+// per-task path (parse a line, copy the description into a std::string,
+// std::make_unique<Task>, index by id) is compared against
+// TodoStorage::loadTasks, which fills a TaskStore whose descriptions share
+// one arena and whose id index draws nodes from a BlockArena.
+//
+// Build: g++ -std=c++14 -O2 -pthread -o load_bench bench/load_bench.cpp
+// Usage: ./load_bench [task_count] [runs]
+
+#define TODO_NO_MAIN
+#include "../main.cpp"
+
+#include "alloc_counter.h"
+
+#include <chrono>
+
+namespace {
+
+struct Sample {
+    std::size_t allocations;
+    double milliseconds;
+};
+
+template <typename Load>
+Sample measure(int runs, Load load) {
+    Sample best = {0, 0.0};
+    for (int run = 0; run < runs; ++run) {
+        std::size_t allocationsBefore = allocationCount;
+        auto start = std::chrono::steady_clock::now();
+        load();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double milliseconds = std::chrono::duration<double, std::milli>(elapsed).count();
+        if (run == 0 || milliseconds < best.milliseconds) {
+            best.milliseconds = milliseconds;
+        }
+        best.allocations = allocationCount - allocationsBefore;
+    }
+    return best;
+}
+
+void report(const char* path, const char* format, int taskCount, const Sample& sample) {
+    std::cout << "{\"path\":\"" << path << "\",\"format\":\"" << format
+              << "\",\"tasks\":" << taskCount
+              << ",\"allocations_per_task\":"
+              << static_cast<double>(sample.allocations) / taskCount
+              << ",\"load_ms\":" << sample.milliseconds << "}\n";
+}
+
+void writeStore(const std::string& path, StorageFormat format, int taskCount) {
+    TaskStore tasks;
+    const std::int64_t created = 1767261600; // 2026-01-01 10:00:00 UTC
+    for (int taskId = 1; taskId <= taskCount; ++taskId) {
+        std::string description = "Follow up on ticket " + std::to_string(taskId) +
+                                  " with the platform team";
+        tasks.put(TaskFields{taskId, description, taskId % 2 == 0, created,
+                             taskId % 2 == 0 ? created + 86400 : 0});
+    }
+    TodoStorage storage(path);
+    storage.setFormat(format);
+    storage.setDurability(Durability::None);
+    storage.saveTasks(tasks);
+}
+
+// Loads a text snapshot the way the store did before TaskStore existed.
+std::size_t loadPerTask(const std::string& path) {
+    std::vector<std::unique_ptr<Task>> tasks;
+    std::unordered_map<int, size_t> slotById;
+    MappedFile file(path);
+    file.forEachLine([&](const char* begin, const char* end) {
+        TaskFields fields;
+        if (*begin != '#' && Task::parseFileLine(begin, end, fields)) {
+            slotById[fields.id] = tasks.size();
+            tasks.push_back(std::make_unique<Task>(Task::fromFields(fields)));
+        }
+    });
+    return tasks.size();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int taskCount = (argc > 1) ? std::atoi(argv[1]) : 500000;
+    int runs = (argc > 2) ? std::atoi(argv[2]) : 5;
+    if (taskCount <= 0 || runs <= 0) {
+        std::cerr << "Usage: load_bench [task_count] [runs]" << std::endl;
+        return 1;
+    }
+
+    const std::string textPath = "load_bench_text.txt";
+    const std::string binaryPath = "load_bench_binary.txt";
+    writeStore(textPath, StorageFormat::Text, taskCount);
+    writeStore(binaryPath, StorageFormat::Binary, taskCount);
+
+    report("per-task", "text", taskCount, measure(runs, [&]() { loadPerTask(textPath); }));
+    for (const std::string& path : {textPath, binaryPath}) {
+        TodoStorage storage(path);
+        const char* format = (storage.getFormat() == StorageFormat::Binary) ? "binary" : "text";
+        report("TaskStore", format, taskCount, measure(runs, [&]() { storage.loadTasks(); }));
+    }
+
+    std::remove(textPath.c_str());
+    std::remove(binaryPath.c_str());
+    return 0;
+}
@@ -0,0 +1,84 @@
+// Measures heap bytes and allocations per task for the TaskStore
+// structure-of-arrays layout against the previous layout, a
+// std::vector<std::unique_ptr<Task>> plus an id -> slot hash index.
+//
+// Build: g++ -std=c++14 -O2 -pthread -o memory_bench bench/memory_bench.cpp
+// Usage: ./memory_bench [task_count]
+
+#define TODO_NO_MAIN
+#include "../main.cpp"
+
+#include "alloc_counter.h"
+
+namespace {
+
+struct Usage {
+    std::size_t bytes;
+    std::size_t allocations;
+};
+
+std::string makeDescription(int taskId) {
+    return "Follow up on ticket " + std::to_string(taskId) + " with the platform team";
+}
+
+TaskFields makeFields(int taskId, const std::string& description) {
+    const std::int64_t created = 1767261600; // 2026-01-01 10:00:00 UTC
+    return TaskFields{taskId, description, taskId % 2 == 0, created,
+                      taskId % 2 == 0 ? created + 86400 : 0};
+}
+
+template <typename Build>
+Usage measure(Build build) {
+    std::size_t bytesBefore = liveBytes;
+    std::size_t allocationsBefore = allocationCount;
+    Usage usage = build();
+    usage.bytes = liveBytes - bytesBefore;
+    usage.allocations = allocationCount - allocationsBefore;
+    return usage;
+}
+
+void report(const char* layout, int taskCount, const Usage& usage) {
+    std::cout << "{\"layout\":\"" << layout << "\",\"tasks\":" << taskCount
+              << ",\"bytes_per_task\":" << static_cast<double>(usage.bytes) / taskCount
+              << ",\"allocations_per_task\":"
+              << static_cast<double>(usage.allocations) / taskCount << "}\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int taskCount = (argc > 1) ? std::atoi(argv[1]) : 100000;
+    if (taskCount <= 0) {
+        std::cerr << "Usage: memory_bench [task_count]" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> descriptions;
+    descriptions.reserve(taskCount);
+    for (int taskId = 1; taskId <= taskCount; ++taskId) {
+        descriptions.push_back(makeDescription(taskId));
+    }
+
+    std::vector<std::unique_ptr<Task>> pointerLayout;
+    std::unordered_map<int, size_t> pointerIndex;
+    Usage pointerUsage = measure([&]() {
+        for (int taskId = 1; taskId <= taskCount; ++taskId) {
+            auto fields = makeFields(taskId, descriptions[taskId - 1]);
+            pointerIndex[taskId] = pointerLayout.size();
+            pointerLayout.push_back(std::make_unique<Task>(Task::fromFields(fields)));
+        }
+        return Usage();
+    });
+
+    TaskStore store;
+    Usage storeUsage = measure([&]() {
+        for (int taskId = 1; taskId <= taskCount; ++taskId) {
+            store.put(makeFields(taskId, descriptions[taskId - 1]));
+        }
+        return Usage();
+    });
+
+    report("vector<unique_ptr<Task>>", taskCount, pointerUsage);
+    report("TaskStore", taskCount, storeUsage);
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Microbenchmark for parsing one text snapshot line. The original
+// Task::fromFileString (a std::stringstream split into a vector of
+// std::string fields, then std::stoi in a try block) is compared against
+// Task::parseFileLine, which splits the line in place with memchr and
+// returns views into it. Both run over the same lines from workload.h,
+// optionally with a share of malformed lines (non-numeric ids), where the
+// original path pays for an exception per line.
+//
+// Build: g++ -std=c++14 -O2 -pthread -o parse_bench bench/parse_bench.cpp
+// Usage: ./parse_bench [line_count] [malformed_percent] [runs]
+
+#define TODO_NO_MAIN
+#include "../main.cpp"
+
+#include "alloc_counter.h"
+#include "workload.h"
+
+#include <chrono>
+
+namespace {
+
+// The task record and parser as they were before the in-place parser.
+struct LegacyTask {
+    int id;
+    std::string description;
+    bool isCompleted;
+    std::string createdAt;
+    std::string completedAt;
+};
+
+std::unique_ptr<LegacyTask> legacyFromFileString(const std::string& line) {
+    std::stringstream ss(line);
+    std::string token;
+    std::vector<std::string> parts;
+
+    while (std::getline(ss, token, '|')) {
+        parts.push_back(token);
+    }
+
+    if (parts.size() < 4) {
+        return nullptr;
+    }
+
+    try {
+        auto task = std::make_unique<LegacyTask>();
+        task->id = std::stoi(parts[0]);
+        task->description = parts[1];
+        task->isCompleted = (parts[2] == "1");
+        task->createdAt = parts[3];
+        if (parts.size() > 4) {
+            task->completedAt = parts[4];
+        }
+        return task;
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+}
+
+struct Sample {
+    double milliseconds;
+    std::size_t allocations;
+    std::size_t parsed;
+};
+
+template <typename Parse>
+Sample measure(int runs, Parse parse) {
+    Sample best = {0.0, 0, 0};
+    for (int run = 0; run < runs; ++run) {
+        std::size_t allocationsBefore = allocationCount;
+        auto start = std::chrono::steady_clock::now();
+        std::size_t parsed = parse();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double milliseconds = std::chrono::duration<double, std::milli>(elapsed).count();
+        if (run == 0 || milliseconds < best.milliseconds) {
+            best.milliseconds = milliseconds;
+        }
+        best.allocations = allocationCount - allocationsBefore;
+        best.parsed = parsed;
+    }
+    return best;
+}
+
+void report(const char* parser, std::size_t lineCount, int malformedPercent, const Sample& sample) {
+    std::cout << "{\"parser\":\"" << parser << "\",\"lines\":" << lineCount
+              << ",\"malformed_percent\":" << malformedPercent
+              << ",\"parsed\":" << sample.parsed
+              << ",\"ns_per_line\":" << sample.milliseconds * 1e6 / lineCount
+              << ",\"allocations_per_line\":"
+              << static_cast<double>(sample.allocations) / lineCount << "}" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int lineCount = (argc > 1) ? std::atoi(argv[1]) : 200000;
+    int malformedPercent = (argc > 2) ? std::atoi(argv[2]) : 0;
+    int runs = (argc > 3) ? std::atoi(argv[3]) : 3;
+    if (lineCount <= 0 || malformedPercent < 0 || malformedPercent > 100 || runs <= 0) {
+        std::cerr << "Usage: parse_bench [line_count] [malformed_percent] [runs]" << std::endl;
+        return 1;
+    }
+
+    TaskStore tasks = workload::makeTasks(lineCount);
+    std::vector<std::string> lines;
+    lines.reserve(tasks.size());
+    for (size_t slot = 0; slot < tasks.slotCount(); ++slot) {
+        std::string line = tasks.toTask(slot).toFileString();
+        if (malformedPercent > 0 && static_cast<int>(slot % 100) < malformedPercent) {
+            line[0] = 'x';
+        }
+        lines.push_back(std::move(line));
+    }
+
+    Sample legacy = measure(runs, [&]() {
+        std::size_t parsed = 0;
+        for (const auto& line : lines) {
+            parsed += legacyFromFileString(line) ? 1 : 0;
+        }
+        return parsed;
+    });
+    Sample inPlace = measure(runs, [&]() {
+        std::size_t parsed = 0;
+        std::int64_t checksum = 0;
+        for (const auto& line : lines) {
+            TaskFields fields;
+            if (Task::parseFileLine(line.data(), line.data() + line.size(), fields)) {
+                checksum += fields.createdAt + static_cast<std::int64_t>(fields.description.size());
+                ++parsed;
+            }
+        }
+        volatile std::int64_t sink = checksum;
+        (void)sink;
+        return parsed;
+    });
+
+    report("stringstream+stoi", lines.size(), malformedPercent, legacy);
+    report("parseFileLine", lines.size(), malformedPercent, inPlace);
+    return 0;
+}
@@ -0,0 +1,198 @@
+// Benchmark suite for the store as it grows. For every size and format it
+// generates a synthetic store (see workload.h) and measures
+//   load            TodoStorage::loadTasks
+//   save            TodoStorage::saveTasks of the loaded store (no fsync)
+//   list_stream     TodoManager::listTasks before the store is loaded
+//   add_cold        TodoManager::addTask on a manager that has not loaded
+//   complete_cold   TodoManager::completeTask on a manager that has not loaded
+//   list_loaded     TodoManager::listTasks over the resident store
+//   add             TodoManager::addTask, journaled
+//   complete        TodoManager::completeTask, journaled
+//   remove          TodoManager::removeTask, journaled
+// Each result is one JSON line on stdout. Timed phases report the best of
+// --runs repetitions; mutations report the mean over a fixed number of
+// operations. Rendered output goes to a discarding stream.
+//
+// Build: g++ -std=c++14 -O2 -pthread -o suite_bench bench/suite_bench.cpp
+// Usage: ./suite_bench [--sizes 1000,10000,100000,1000000] [--formats text,binary]
+//                      [--runs 3] [--ops 1000]
+
+#define TODO_NO_MAIN
+#include "../main.cpp"
+
+#include "workload.h"
+
+#include <chrono>
+
+namespace {
+
+// Swallows everything written to std::cout while a benchmark runs.
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+class QuietOutput {
+private:
+    NullBuffer sink;
+    std::streambuf* previous;
+
+public:
+    QuietOutput() : previous(std::cout.rdbuf(&sink)) {}
+    ~QuietOutput() { std::cout.rdbuf(previous); }
+};
+
+double elapsedMilliseconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Body>
+double bestOf(int runs, Body body) {
+    double best = 0.0;
+    for (int run = 0; run < runs; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            QuietOutput quiet;
+            body();
+        }
+        double milliseconds = elapsedMilliseconds(start);
+        if (run == 0 || milliseconds < best) {
+            best = milliseconds;
+        }
+    }
+    return best;
+}
+
+void report(const char* benchmark, const char* format, int taskCount, int ops, double milliseconds) {
+    std::cout << "{\"benchmark\":\"" << benchmark << "\",\"format\":\"" << format
+              << "\",\"tasks\":" << taskCount << ",\"ops\":" << ops
+              << ",\"ms\":" << milliseconds
+              << ",\"ns_per_op\":" << milliseconds * 1e6 / ops << "}" << std::endl;
+}
+
+std::unique_ptr<TodoManager> openManager(const std::string& path) {
+    auto storage = std::make_unique<TodoStorage>(path);
+    storage->setDurability(Durability::None);
+    return std::make_unique<TodoManager>(std::move(storage));
+}
+
+std::vector<int> parseList(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        int value = 0;
+        if (!parseTaskId(item.data(), item.data() + item.size(), value) || value <= 0) {
+            return std::vector<int>();
+        }
+        values.push_back(value);
+    }
+    return values;
+}
+
+void runSize(const std::string& path, StorageFormat format, int taskCount, int runs, int ops) {
+    const char* formatName = (format == StorageFormat::Binary) ? "binary" : "text";
+    workload::writeStore(path, format, taskCount);
+
+    TodoStorage storage(path);
+    storage.setDurability(Durability::None);
+    TaskStore loaded;
+    report("load", formatName, taskCount, 1,
+           bestOf(runs, [&]() { loaded = storage.loadTasks(); }));
+    report("save", formatName, taskCount, 1,
+           bestOf(runs, [&]() { storage.saveTasks(loaded); }));
+
+    report("list_stream", formatName, taskCount, 1, bestOf(runs, [&]() {
+        openManager(path)->listTasks(TaskFilter());
+    }));
+
+    // One fresh manager per operation, as for separate ./todo invocations.
+    int mutations = std::min(ops, taskCount);
+    report("add_cold", formatName, taskCount, mutations, bestOf(1, [&]() {
+        for (int i = 0; i < mutations; ++i) {
+            openManager(path)->addTask("benchmark task " + std::to_string(i));
+        }
+    }));
+    int coldCompleted = 0;
+    double coldMilliseconds = bestOf(1, [&]() {
+        for (int step = 0; step < taskCount && coldCompleted < mutations; ++step) {
+            coldCompleted += openManager(path)->completeTask(step + 1) ? 1 : 0;
+        }
+    });
+    report("complete_cold", formatName, taskCount, std::max(coldCompleted, 1), coldMilliseconds);
+
+    auto manager = openManager(path);
+    manager->ensureLoaded();
+    report("list_loaded", formatName, taskCount, 1,
+           bestOf(runs, [&]() { manager->listTasks(TaskFilter()); }));
+
+    report("add", formatName, taskCount, mutations, bestOf(1, [&]() {
+        for (int i = 0; i < mutations; ++i) {
+            manager->addTask("benchmark task " + std::to_string(i));
+        }
+    }));
+    // Walks ids from the middle of the store, skipping completed tasks.
+    int completed = 0;
+    double completeMilliseconds = bestOf(1, [&]() {
+        for (int step = 0; step < taskCount && completed < mutations; ++step) {
+            completed += manager->completeTask((taskCount / 2 + step) % taskCount + 1) ? 1 : 0;
+        }
+    });
+    report("complete", formatName, taskCount, std::max(completed, 1), completeMilliseconds);
+    report("remove", formatName, taskCount, mutations, bestOf(1, [&]() {
+        for (int i = 0; i < mutations; ++i) {
+            manager->removeTask(taskCount / 2 + i);
+        }
+    }));
+
+    manager.reset();
+    workload::removeStoreFiles(path);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<int> sizes = {1000, 10000, 100000, 1000000};
+    std::vector<StorageFormat> formats = {StorageFormat::Text, StorageFormat::Binary};
+    int runs = 3;
+    int ops = 1000;
+
+    bool valid = true;
+    for (int i = 1; valid && i < argc; ++i) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            valid = false;
+        } else if (option == "--sizes") {
+            sizes = parseList(argv[++i]);
+            valid = !sizes.empty();
+        } else if (option == "--formats") {
+            formats.clear();
+            std::stringstream stream(argv[++i]);
+            std::string name;
+            while (valid && std::getline(stream, name, ',')) {
+                valid = name == "text" || name == "binary";
+                formats.push_back(name == "binary" ? StorageFormat::Binary : StorageFormat::Text);
+            }
+        } else if (option == "--runs" || option == "--ops") {
+            std::vector<int> value = parseList(argv[++i]);
+            valid = value.size() == 1;
+            (option == "--runs" ? runs : ops) = valid ? value[0] : 0;
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid || formats.empty()) {
+        std::cerr << "Usage: suite_bench [--sizes 1000,10000,...] [--formats text,binary] "
+                     "[--runs N] [--ops N]" << std::endl;
+        return 1;
+    }
+
+    const std::string path = "suite_bench_store.txt";
+    for (int taskCount : sizes) {
+        for (StorageFormat format : formats) {
+            runSize(path, format, taskCount, runs, ops);
+        }
+    }
+    return 0;
+}
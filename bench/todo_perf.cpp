@@ -0,0 +1,362 @@
+// Process-level regression harness for the todo binary. For every store
+// size and format it writes a synthetic store (see workload.h) and runs
+// each binary under test as a fresh process, as a shell would:
+//   help       process start-up alone, without touching a store
+//   add        a journaled add on the unloaded store
+//   list       a full listing, written to /dev/null
+//   list_page  the first 20 tasks
+// It records the wall time from fork to exit and the child's peak RSS
+// (from wait4). Each result is one JSON line on stdout with the median and
+// the best of --runs runs. The page cache is warm after the first run, so
+// this measures process start and store access rather than the disk.
+//
+// With --budgets FILE, every result is checked against the file's limits.
+// Results over budget are reported on stderr and the exit status is 1.
+// Budget lines are "<command> <tasks> <median_ms> [<peak_rss_mib>]". A '-'
+// skips a limit and '#' starts a comment. Every budget applies to each
+// binary and format measured at that size.
+//
+// Build: cmake --build build --target todo_perf
+//        (or g++ -std=c++14 -O2 -pthread -o todo_perf bench/todo_perf.cpp)
+// Usage: ./todo_perf --binary ./todo [--binary ./todo_lto ...]
+//                    [--sizes 1000,100000,1000000] [--formats text,binary]
+//                    [--runs 5] [--dir perf-stores] [--budgets FILE]
+
+#define TODO_NO_MAIN
+#include "../main.cpp"
+
+#include "workload.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#endif
+
+namespace {
+
+struct Scenario {
+    const char* name;
+    bool usesStore;
+    std::vector<std::string> arguments; // after "--store PATH"
+};
+
+struct Result {
+    std::string binary;
+    std::string format;
+    int tasks;
+    std::string command;
+    double medianMilliseconds;
+    double bestMilliseconds;
+    long peakRssKib;
+};
+
+struct Budget {
+    std::string command;
+    int tasks;
+    double medianMilliseconds; // negative: no limit
+    double peakRssMib;         // negative: no limit
+};
+
+const std::vector<Scenario>& scenarios() {
+    static const std::vector<Scenario> all = {
+        {"help", false, {"help"}},
+        {"add", true, {"add", "Benchmark task from todo_perf"}},
+        {"list", true, {"list"}},
+        {"list_page", true, {"list", "--limit", "20"}},
+    };
+    return all;
+}
+
+std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+std::string baseName(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+bool readBudgets(const std::string& path, std::vector<Budget>& budgets) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: Unable to open budget file: " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        line = line.substr(0, line.find('#'));
+        std::stringstream fields(line);
+        Budget budget;
+        std::string milliseconds;
+        std::string rss = "-";
+        if (!(fields >> budget.command)) {
+            continue;
+        }
+        if (!(fields >> budget.tasks >> milliseconds)) {
+            std::cerr << "Error: " << path << ":" << lineNumber
+                      << ": expected <command> <tasks> <median_ms> [<peak_rss_mib>]" << std::endl;
+            return false;
+        }
+        fields >> rss;
+        budget.medianMilliseconds = milliseconds == "-" ? -1.0 : std::atof(milliseconds.c_str());
+        budget.peakRssMib = rss == "-" ? -1.0 : std::atof(rss.c_str());
+        budgets.push_back(budget);
+    }
+    return true;
+}
+
+#ifndef _WIN32
+// Runs `arguments` as a child process with its output discarded. Returns
+// false if it could not be started or did not exit with status 0.
+bool runProcess(const std::vector<std::string>& arguments, double& milliseconds, long& peakRssKib) {
+    std::vector<char*> argv;
+    for (const auto& argument : arguments) {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t child = ::fork();
+    if (child < 0) {
+        return false;
+    }
+    if (child == 0) {
+        int null = ::open("/dev/null", O_RDWR);
+        if (null >= 0) {
+            ::dup2(null, STDIN_FILENO);
+            ::dup2(null, STDOUT_FILENO);
+            ::dup2(null, STDERR_FILENO);
+        }
+        ::execv(argv[0], argv.data());
+        ::_exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    if (::wait4(child, &status, 0, &usage) != child) {
+        return false;
+    }
+    milliseconds = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start).count();
+#ifdef __APPLE__
+    peakRssKib = usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    peakRssKib = usage.ru_maxrss;
+#endif
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Writes the store in a short-lived child. On exec, Linux records the peak
+// RSS of the forked copy of this process in the child's ru_maxrss, so
+// the harness has to stay small itself for the readings to mean anything.
+bool writeStoreInChild(const std::string& path, StorageFormat format, int taskCount) {
+    pid_t child = ::fork();
+    if (child < 0) {
+        return false;
+    }
+    if (child == 0) {
+        ::_exit(workload::writeStore(path, format, taskCount) ? 0 : 1);
+    }
+    int status = 0;
+    if (::waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "Error: Unable to write store: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool measure(const std::string& binary, const Scenario& scenario, const std::string& store,
+             int runs, Result& result) {
+    std::vector<std::string> arguments = {binary};
+    if (scenario.usesStore) {
+        arguments.push_back("--store");
+        arguments.push_back(store);
+    }
+    arguments.insert(arguments.end(), scenario.arguments.begin(), scenario.arguments.end());
+
+    std::vector<double> times;
+    result.peakRssKib = 0;
+    for (int run = 0; run < runs; ++run) {
+        double milliseconds = 0.0;
+        long peakRssKib = 0;
+        if (!runProcess(arguments, milliseconds, peakRssKib)) {
+            std::cerr << "Error: " << binary << " " << scenario.name << " failed." << std::endl;
+            return false;
+        }
+        times.push_back(milliseconds);
+        result.peakRssKib = std::max(result.peakRssKib, peakRssKib);
+    }
+    std::sort(times.begin(), times.end());
+    result.binary = baseName(binary);
+    result.command = scenario.name;
+    result.medianMilliseconds = times[times.size() / 2];
+    result.bestMilliseconds = times.front();
+    return true;
+}
+#endif
+
+void report(const Result& result) {
+    std::cout << "{\"binary\":\"" << result.binary << "\",\"format\":\"" << result.format
+              << "\",\"tasks\":" << result.tasks << ",\"command\":\"" << result.command
+              << "\",\"median_ms\":" << result.medianMilliseconds
+              << ",\"best_ms\":" << result.bestMilliseconds
+              << ",\"peak_rss_kib\":" << result.peakRssKib << "}" << std::endl;
+}
+
+// Reports every limit `result` exceeds; returns how many it checked.
+size_t check(const Result& result, const std::vector<Budget>& budgets, size_t& exceeded) {
+    size_t checked = 0;
+    for (const auto& budget : budgets) {
+        if (budget.command != result.command || budget.tasks != result.tasks) {
+            continue;
+        }
+        std::string where = result.binary + " " + result.command + " on " +
+                            std::to_string(result.tasks) + " " + result.format + " task(s)";
+        if (budget.medianMilliseconds >= 0) {
+            ++checked;
+            if (result.medianMilliseconds > budget.medianMilliseconds) {
+                ++exceeded;
+                std::cerr << "Budget exceeded: " << where << ": median " << result.medianMilliseconds
+                          << " ms > " << budget.medianMilliseconds << " ms" << std::endl;
+            }
+        }
+        if (budget.peakRssMib >= 0) {
+            ++checked;
+            if (result.peakRssKib > budget.peakRssMib * 1024) {
+                ++exceeded;
+                std::cerr << "Budget exceeded: " << where << ": peak RSS "
+                          << result.peakRssKib / 1024.0 << " MiB > " << budget.peakRssMib
+                          << " MiB" << std::endl;
+            }
+        }
+    }
+    return checked;
+}
+
+void usage() {
+    std::cerr << "Usage: todo_perf --binary PATH [--binary PATH ...] [--sizes 1000,100000,1000000]\n"
+                 "                 [--formats text,binary] [--runs 5] [--dir perf-stores]\n"
+                 "                 [--budgets FILE]" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+    (void)argc;
+    (void)argv;
+    std::cerr << "todo_perf needs fork and wait4; it runs on POSIX systems only." << std::endl;
+    return 1;
+#else
+    std::vector<std::string> binaries;
+    std::vector<std::string> sizes = {"1000", "100000", "1000000"};
+    std::vector<std::string> formats = {"text", "binary"};
+    std::string directory = "perf-stores";
+    std::string budgetFile;
+    int runs = 5;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (option == "--binary") {
+            binaries.push_back(value);
+        } else if (option == "--sizes") {
+            sizes = splitList(value);
+        } else if (option == "--formats") {
+            formats = splitList(value);
+        } else if (option == "--runs") {
+            runs = std::atoi(value.c_str());
+        } else if (option == "--dir") {
+            directory = value;
+        } else if (option == "--budgets") {
+            budgetFile = value;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (binaries.empty() || runs <= 0) {
+        usage();
+        return 1;
+    }
+    for (const auto& format : formats) {
+        if (format != "text" && format != "binary") {
+            std::cerr << "Error: Unknown format '" << format << "'; expected text or binary."
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Budget> budgets;
+    if (!budgetFile.empty() && !readBudgets(budgetFile, budgets)) {
+        return 1;
+    }
+    ::mkdir(directory.c_str(), 0777);
+
+    std::vector<Result> results;
+    for (const auto& binary : binaries) {
+        Result result;
+        if (!measure(binary, scenarios().front(), "", runs, result)) {
+            return 1;
+        }
+        result.format = "none";
+        result.tasks = 0;
+        report(result);
+        results.push_back(result);
+    }
+
+    for (const auto& format : formats) {
+        for (const auto& size : sizes) {
+            int taskCount = std::atoi(size.c_str());
+            std::string store = directory + "/" + format + "-" + size + ".txt";
+            for (const auto& scenario : scenarios()) {
+                if (!scenario.usesStore) {
+                    continue;
+                }
+                for (const auto& binary : binaries) {
+                    // A fresh store per binary, so every binary sees the same
+                    // snapshot and an empty journal.
+                    if (!writeStoreInChild(store, format == "binary" ? StorageFormat::Binary
+                                                                     : StorageFormat::Text,
+                                           taskCount)) {
+                        return 1;
+                    }
+                    Result result;
+                    if (!measure(binary, scenario, store, runs, result)) {
+                        return 1;
+                    }
+                    result.format = format;
+                    result.tasks = taskCount;
+                    report(result);
+                    results.push_back(result);
+                }
+            }
+            workload::removeStoreFiles(store);
+        }
+    }
+
+    size_t checked = 0;
+    size_t exceeded = 0;
+    for (const auto& result : results) {
+        checked += check(result, budgets, exceeded);
+    }
+    if (!budgets.empty()) {
+        std::cerr << checked << " budget(s) checked, " << exceeded << " exceeded." << std::endl;
+    }
+    return exceeded == 0 ? 0 : 1;
+#endif
+}
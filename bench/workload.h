@@ -0,0 +1,84 @@
+// Deterministic synthetic stores for the benchmarks. Descriptions are drawn
+// from a fixed vocabulary with lengths skewed like real todo lists: mostly
+// three to eight words with a long tail, about 45 bytes on average.
+// Creation times spread over the two years before 2026 and about a third of
+// the tasks are completed within a month of being created.
+//
+// Include after main.cpp.
+
+#ifndef TODO_BENCH_WORKLOAD_H
+#define TODO_BENCH_WORKLOAD_H
+
+#include <random>
+
+namespace workload {
+
+const char* const kVocabulary[] = {
+    "review", "update", "fix", "call", "email", "draft", "plan", "buy", "book", "send",
+    "the", "a", "for", "with", "about", "before", "after", "weekly", "quarterly", "new",
+    "report", "invoice", "meeting", "groceries", "release", "notes", "budget", "dentist",
+    "tickets", "slides", "backlog", "deploy", "roadmap", "contract", "feedback", "team",
+    "client", "server", "migration", "onboarding", "renewal", "agenda", "summary", "demo",
+};
+const size_t kVocabularySize = sizeof(kVocabulary) / sizeof(kVocabulary[0]);
+const std::int64_t kEpochEnd = 1767225600; // 2026-01-01 00:00:00 UTC
+const std::int64_t kSpanSeconds = 2 * 365 * 86400;
+
+inline std::string makeDescription(std::mt19937& random) {
+    std::geometric_distribution<int> extraWords(0.3);
+    std::uniform_int_distribution<size_t> pickWord(0, kVocabularySize - 1);
+    int words = std::min(3 + extraWords(random), 40);
+
+    std::string description;
+    for (int word = 0; word < words; ++word) {
+        if (word > 0) {
+            description += ' ';
+        }
+        description += kVocabulary[pickWord(random)];
+    }
+    return description;
+}
+
+inline TaskStore makeTasks(int taskCount, unsigned seed = 42) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<std::int64_t> pickCreated(kEpochEnd - kSpanSeconds, kEpochEnd);
+    std::uniform_int_distribution<std::int64_t> pickDelay(600, 30 * 86400);
+    std::uniform_int_distribution<int> pickDone(0, 2);
+
+    TaskStore tasks;
+    tasks.reserve(static_cast<size_t>(taskCount), static_cast<size_t>(taskCount) * 48);
+    for (int taskId = 1; taskId <= taskCount; ++taskId) {
+        std::string description = makeDescription(random);
+        std::int64_t created = pickCreated(random);
+        bool completed = pickDone(random) == 0;
+        tasks.put(TaskFields{taskId, description, completed, created,
+                             completed ? created + pickDelay(random) : 0});
+    }
+    return tasks;
+}
+
+inline void removeStoreFiles(const std::string& path) {
+    const char* suffixes[] = {"", ".journal", ".lock", ".tmp", ".index", ".index.log", ".index.tmp",
+                              ".ids", ".ids.tmp", ".order", ".order.tmp", ".archive",
+                              ".archive.tmp"};
+    for (const char* suffix : suffixes) {
+        std::remove((path + suffix).c_str());
+    }
+}
+
+// Replaces any store at `path` with a fresh one of `taskCount` tasks.
+inline bool writeStore(const std::string& path, StorageFormat format, int taskCount,
+                       unsigned seed = 42) {
+    removeStoreFiles(path);
+    TodoStorage storage(path);
+    storage.setFormat(format);
+    storage.setDurability(Durability::None);
+    if (taskCount > 0) {
+        storage.reserveId(taskCount);
+    }
+    return storage.saveTasks(makeTasks(taskCount, seed));
+}
+
+} // namespace workload
+
+#endif
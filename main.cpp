@@ -1,361 +1,7589 @@
-#include <iostream>
-#include <vector>
-#include <cstring>
-#include <fstream>
-#include <sstream>
-#include <algorithm>
-#include <memory>
-#include <ctime>
-#include <iomanip>
-
-class Task {
-private:
-    int id;
-    std::string description;
-    bool isCompleted;
-    std::string createdAt;
-    std::string completedAt;
-
-public:
-    Task(int taskId, const std::string& desc) 
-        : id(taskId), description(desc), isCompleted(false), completedAt("") {
-        createdAt = Task::getCurrentTimestamp();
-    }
-
-    // Getters
-    int getId() const { return id; }
-    std::string getDescription() const { return description; }
-    bool getIsCompleted() const { return isCompleted; }
-    std::string getCreatedAt() const { return createdAt; }
-    std::string getCompletedAt() const { return completedAt; }
-
-    void markComplete() {
-        isCompleted = true;
-        completedAt = Task::getCurrentTimestamp();
-    }
-
-    std::string toFileString() const {
-        return std::to_string(id) + "|" + description + "|" + 
-               (isCompleted ? "1" : "0") + "|" + createdAt + "|" + completedAt;
-    }
-
-    static std::unique_ptr<Task> fromFileString(const std::string& line) {
-        std::stringstream ss(line);
-        std::string token;
-        std::vector<std::string> parts;
-
-        while (std::getline(ss, token, '|')) {
-            parts.push_back(token);
-        }
-
-        if (parts.size() < 4) {
-            return nullptr;
-        }
-
-        try {
-            int taskId = std::stoi(parts[0]);
-            auto task = std::make_unique<Task>(taskId, parts[1]);
-            task->isCompleted = (parts[2] == "1");
-            task->createdAt = parts[3];
-            if (parts.size() > 4) {
-                task->completedAt = parts[4];
-            }
-            return task;
-        } catch (const std::exception&) {
-            return nullptr;
-        }
-    }
-
-private:
-    static std::string getCurrentTimestamp() {
-        auto now = std::time(nullptr);
-        auto tm = *std::localtime(&now);
-        std::ostringstream oss;
-        oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
-        return oss.str();
-    }
-};
-
-class TodoStorage {
-private:
-    std::string filename;
-
-public:
-    explicit TodoStorage(const std::string& file = "todos.txt") : filename(file) {}
-
-    std::vector<std::unique_ptr<Task>> loadTasks() const {
-        std::vector<std::unique_ptr<Task>> tasks;
-        std::ifstream file(filename);
-        
-        if (!file.is_open()) {
-            return tasks; // Return empty vector if file doesn't exist
-        }
-
-        std::string line;
-        while (std::getline(file, line)) {
-            if (!line.empty()) {
-                auto task = Task::fromFileString(line);
-                if (task) {
-                    tasks.push_back(std::move(task));
-                }
-            }
-        }
-
-        return tasks;
-    }
-
-    bool saveTasks(const std::vector<std::unique_ptr<Task>>& tasks) const {
-        std::ofstream file(filename);
-        
-        if (!file.is_open()) {
-            std::cerr << "Error: Unable to save tasks to file." << std::endl;
-            return false;
-        }
-
-        for (const auto& task : tasks) {
-            file << task->toFileString() << std::endl;
-        }
-
-        return true;
-    }
-};
-
-class TodoManager {
-private:
-    std::vector<std::unique_ptr<Task>> tasks;
-    std::unique_ptr<TodoStorage> storage;
-
-public:
-    explicit TodoManager(std::unique_ptr<TodoStorage> stor) 
-        : storage(std::move(stor)) {
-        tasks = storage->loadTasks();
-    }
-
-    bool addTask(const std::string& description) {
-        if (isDescriptionEmpty(description)) {
-            std::cout << "Error: Task description cannot be empty." << std::endl;
-            return false;
-        }
-
-        int taskId = generateNextId();
-        auto newTask = std::make_unique<Task>(taskId, trimString(description));
-        tasks.push_back(std::move(newTask));
-
-        if (storage->saveTasks(tasks)) {
-            std::cout << "Task added successfully with ID: " << taskId << std::endl;
-            return true;
-        }
-        return false;
-    }
-
-    void listTasks() const {
-        if (tasks.empty()) {
-            std::cout << "No tasks found. Add a task with 'add <description>'" << std::endl;
-            return;
-        }
-
-        std::cout << "\n=== Todo List ===" << std::endl;
-        for (const auto& task : tasks) {
-            std::string status = task->getIsCompleted() ? "✓" : "○";
-            std::cout << task->getId() << ". [" << status << "] " 
-                      << task->getDescription() << std::endl;
-        }
-        std::cout << std::endl;
-    }
-
-    bool completeTask(int taskId) {
-        Task* task = findTaskById(taskId);
-        if (!task) {
-            std::cout << "Error: Task with ID " << taskId << " not found." << std::endl;
-            return false;
-        }
-
-        if (task->getIsCompleted()) {
-            std::cout << "Task " << taskId << " is already completed." << std::endl;
-            return false;
-        }
-
-        task->markComplete();
-        if (storage->saveTasks(tasks)) {
-            std::cout << "Task " << taskId << " marked as completed." << std::endl;
-            return true;
-        }
-        return false;
-    }
-
-    bool removeTask(int taskId) {
-        auto it = std::find_if(tasks.begin(), tasks.end(),
-            [taskId](const std::unique_ptr<Task>& task) {
-                return task->getId() == taskId;
-            });
-
-        if (it == tasks.end()) {
-            std::cout << "Error: Task with ID " << taskId << " not found." << std::endl;
-            return false;
-        }
-
-        tasks.erase(it);
-        if (storage->saveTasks(tasks)) {
-            std::cout << "Task " << taskId << " removed successfully." << std::endl;
-            return true;
-        }
-        return false;
-    }
-
-private:
-    Task* findTaskById(int taskId) const {
-        auto it = std::find_if(tasks.begin(), tasks.end(),
-            [taskId](const std::unique_ptr<Task>& task) {
-                return task->getId() == taskId;
-            });
-        return (it != tasks.end()) ? it->get() : nullptr;
-    }
-
-    int generateNextId() const {
-        int maxId = 0;
-        for (const auto& task : tasks) {
-            maxId = std::max(maxId, task->getId());
-        }
-        return maxId + 1;
-    }
-
-    bool isDescriptionEmpty(const std::string& description) const {
-        return trimString(description).empty();
-    }
-
-    std::string trimString(const std::string& str) const {
-        size_t start = str.find_first_not_of(" \t\n\r");
-        if (start == std::string::npos) {
-            return "";
-        }
-        size_t end = str.find_last_not_of(" \t\n\r");
-        return str.substr(start, end - start + 1);
-    }
-};
-
-class TodoCLI {
-private:
-    std::unique_ptr<TodoManager> manager;
-
-public:
-    TodoCLI() {
-        auto storage = std::make_unique<TodoStorage>();
-        manager = std::make_unique<TodoManager>(std::move(storage));
-    }
-
-    void run(int argc, char* argv[]) {
-        if (argc < 2) {
-            showHelp();
-            return;
-        }
-
-        std::string command = toLowerCase(argv[1]);
-
-        if (command == "add") {
-            handleAddCommand(argc, argv);
-        } else if (command == "list") {
-            manager->listTasks();
-        } else if (command == "complete") {
-            handleCompleteCommand(argc, argv);
-        } else if (command == "remove") {
-            handleRemoveCommand(argc, argv);
-        } else if (command == "help" || command == "--help" || command == "-h") {
-            showHelp();
-        } else {
-            std::cout << "Unknown command: " << command << std::endl;
-            showHelp();
-        }
-    }
-
-private:
-    void handleAddCommand(int argc, char* argv[]) {
-        if (argc < 3) {
-            std::cout << "Error: Please provide a task description." << std::endl;
-            std::cout << "Usage: ./todo add <task description>" << std::endl;
-            return;
-        }
-
-        std::string description = buildDescriptionFromArgs(argc, argv, 2);
-        manager->addTask(description);
-    }
-
-    void handleCompleteCommand(int argc, char* argv[]) {
-        if (argc < 3) {
-            std::cout << "Error: Please provide a task ID." << std::endl;
-            std::cout << "Usage: ./todo complete <task_id>" << std::endl;
-            return;
-        }
-
-        try {
-            int taskId = std::stoi(argv[2]);
-            manager->completeTask(taskId);
-        } catch (const std::exception&) {
-            std::cout << "Error: Task ID must be a number." << std::endl;
-        }
-    }
-
-    void handleRemoveCommand(int argc, char* argv[]) {
-        if (argc < 3) {
-            std::cout << "Error: Please provide a task ID." << std::endl;
-            std::cout << "Usage: ./todo remove <task_id>" << std::endl;
-            return;
-        }
-
-        try {
-            int taskId = std::stoi(argv[2]);
-            manager->removeTask(taskId);
-        } catch (const std::exception&) {
-            std::cout << "Error: Task ID must be a number." << std::endl;
-        }
-    }
-
-    void showHelp() const {
-        std::cout << R"(
-CLI Todo Application - Help
-
-Usage: ./todo <command> [arguments]
-
-Commands:
-  add <description>    Add a new todo task
-  list                 Display all current tasks with their status
-  complete <task_id>   Mark a task as complete
-  remove <task_id>     Remove a task from the list
-  help                 Show this help message
-
-Examples:
-  ./todo add "Buy groceries"
-  ./todo list
-  ./todo complete 1
-  ./todo remove 2
-)" << std::endl;
-    }
-
-    std::string toLowerCase(const std::string& str) const {
-        std::string result = str;
-        std::transform(result.begin(), result.end(), result.begin(), ::tolower);
-        return result;
-    }
-
-    std::string buildDescriptionFromArgs(int argc, char* argv[], int startIndex) const {
-        std::string description;
-        for (int i = startIndex; i < argc; ++i) {
-            if (i > startIndex) {
-                description += " ";
-            }
-            description += argv[i];
-        }
-        return description;
-    }
-};
-
-int main(int argc, char* argv[]) {
-    try {
-        TodoCLI cli;
-        cli.run(argc, argv);
-    } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
-        return 1;
-    }
-    
-    return 0;
-}
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <ctime>
+#include <unordered_map>
+#include <unordered_set>
+#include <cctype>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <functional>
+#include <future>
+#include <deque>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <csignal>
+#include <cerrno>
+#include <iterator>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef TODO_WITH_SQLITE
+#include <sqlite3.h>
+#endif
+
+// Heap allocations made by this process; counted by the operator new
+// replacement next to main() and reported by --stats.
+static std::atomic<std::uint64_t> heapAllocationCount(0);
+static std::atomic<std::uint64_t> heapAllocatedBytes(0);
+
+// Per-command instrumentation behind --stats / TODO_STATS. Wall time is
+// charged to the innermost active phase only, so the phases partition the
+// command's run time. Byte counters and phase scopes are no-ops unless a
+// command is being measured.
+class CommandStats {
+public:
+    enum Phase { Other, Load, Parse, Replay, Scan, Render, Mutate, Journal, Save, Index, kPhaseCount };
+
+    // Marks a phase for the lifetime of the object.
+    class Scope {
+    private:
+        bool active;
+
+    public:
+        explicit Scope(Phase phase) : active(current().enabled) {
+            if (active) {
+                current().enter(phase);
+            }
+        }
+        ~Scope() {
+            if (active) {
+                current().leave();
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    bool enabled;
+    Clock::time_point started;
+    Clock::time_point phaseStarted;
+    std::vector<Phase> phases;
+    double phaseMilliseconds[kPhaseCount];
+    std::uint64_t bytesRead;
+    std::uint64_t bytesWritten;
+    std::uint64_t taskCount;
+    std::uint64_t allocationsAtStart;
+    std::uint64_t allocatedBytesAtStart;
+
+    CommandStats() : enabled(false), phaseMilliseconds(), bytesRead(0), bytesWritten(0),
+                     taskCount(0), allocationsAtStart(0), allocatedBytesAtStart(0) {}
+
+    void charge() {
+        Clock::time_point now = Clock::now();
+        phaseMilliseconds[phases.back()] +=
+            std::chrono::duration<double, std::milli>(now - phaseStarted).count();
+        phaseStarted = now;
+    }
+
+    void enter(Phase phase) {
+        charge();
+        phases.push_back(phase);
+    }
+
+    void leave() {
+        charge();
+        if (phases.size() > 1) {
+            phases.pop_back();
+        }
+    }
+
+public:
+    // Per thread, so server read workers never race with the measured
+    // command on the server thread.
+    static CommandStats& current() {
+        static thread_local CommandStats stats;
+        return stats;
+    }
+
+    bool isEnabled() const { return enabled; }
+
+    void begin() {
+        *this = CommandStats();
+        enabled = true;
+        started = phaseStarted = Clock::now();
+        phases.assign(1, Other);
+        allocationsAtStart = heapAllocationCount.load(std::memory_order_relaxed);
+        allocatedBytesAtStart = heapAllocatedBytes.load(std::memory_order_relaxed);
+    }
+
+    void addBytesRead(std::uint64_t bytes) {
+        if (enabled) {
+            bytesRead += bytes;
+        }
+    }
+
+    void addBytesWritten(std::uint64_t bytes) {
+        if (enabled) {
+            bytesWritten += bytes;
+        }
+    }
+
+    void setTaskCount(std::uint64_t count) {
+        if (enabled) {
+            taskCount = count;
+        }
+    }
+
+    // Ends the measurement and writes it as one JSON object line.
+    void report(std::ostream& out, const std::string& command) {
+        if (!enabled) {
+            return;
+        }
+        charge();
+        enabled = false;
+        static const char* const names[kPhaseCount] = {
+            "other", "load", "parse", "replay", "scan", "render", "mutate", "journal", "save", "index"};
+        double total = std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+
+        std::ostringstream line;
+        line << "{\"command\":\"" << command << "\",\"total_ms\":" << total;
+        for (int phase = Load; phase < kPhaseCount; ++phase) {
+            line << ",\"" << names[phase] << "_ms\":" << phaseMilliseconds[phase];
+        }
+        line << ",\"other_ms\":" << phaseMilliseconds[Other]
+             << ",\"bytes_read\":" << bytesRead << ",\"bytes_written\":" << bytesWritten
+             << ",\"tasks\":" << taskCount
+             << ",\"allocations\":"
+             << heapAllocationCount.load(std::memory_order_relaxed) - allocationsAtStart
+             << ",\"allocated_bytes\":"
+             << heapAllocatedBytes.load(std::memory_order_relaxed) - allocatedBytesAtStart << "}";
+        out << line.str() << std::endl;
+    }
+};
+
+// Parses a non-negative decimal id from [begin, end) without allocating.
+inline bool parseTaskId(const char* begin, const char* end, int& taskId) {
+    if (begin == end) {
+        return false;
+    }
+
+    long long value = 0;
+    for (const char* it = begin; it != end; ++it) {
+        if (*it < '0' || *it > '9') {
+            return false;
+        }
+        value = value * 10 + (*it - '0');
+        if (value > INT_MAX) {
+            return false;
+        }
+    }
+    taskId = static_cast<int>(value);
+    return true;
+}
+
+// Non-owning view of a run of characters, such as a description stored in
+// a TaskStore arena or a field inside a mapped file.
+class StringRef {
+private:
+    const char* chars;
+    size_t length;
+
+public:
+    StringRef() : chars(""), length(0) {}
+    StringRef(const char* text) : chars(text), length(std::strlen(text)) {}
+    StringRef(const char* data, size_t size) : chars(data), length(size) {}
+    StringRef(const char* begin, const char* end)
+        : chars(begin), length(static_cast<size_t>(end - begin)) {}
+    StringRef(const std::string& text) : chars(text.data()), length(text.size()) {}
+
+    const char* data() const { return chars; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    std::string str() const { return std::string(chars, length); }
+};
+
+inline std::ostream& operator<<(std::ostream& out, StringRef text) {
+    return out.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
+// Formats into one large buffer and hands it to the stream in big chunks,
+// so rendering many lines costs a few write calls instead of a flush per
+// line. Writes through std::ostream so redirected streams keep working.
+class ChunkedWriter {
+private:
+    static constexpr size_t kDefaultChunkSize = 1 << 20; // 1 MiB
+
+    std::ostream& out;
+    std::string buffer;
+    size_t chunkSize;
+
+public:
+    explicit ChunkedWriter(std::ostream& stream, size_t chunk = kDefaultChunkSize)
+        : out(stream), chunkSize(chunk) {
+        buffer.reserve(chunkSize);
+    }
+
+    ~ChunkedWriter() { flush(); }
+
+    ChunkedWriter(const ChunkedWriter&) = delete;
+    ChunkedWriter& operator=(const ChunkedWriter&) = delete;
+
+    ChunkedWriter& append(const char* data, size_t length) {
+        if (buffer.size() + length > chunkSize) {
+            flush();
+        }
+        buffer.append(data, length);
+        return *this;
+    }
+
+    ChunkedWriter& append(StringRef text) { return append(text.data(), text.size()); }
+
+    ChunkedWriter& append(char c) { return append(&c, 1); }
+
+    ChunkedWriter& appendNumber(long long value) {
+        char digits[24];
+        char* end = digits + sizeof(digits);
+        char* cursor = end;
+        unsigned long long magnitude = value < 0 ? 0ULL - static_cast<unsigned long long>(value)
+                                                 : static_cast<unsigned long long>(value);
+        do {
+            *--cursor = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+        if (value < 0) {
+            *--cursor = '-';
+        }
+        return append(cursor, static_cast<size_t>(end - cursor));
+    }
+
+    void flush() {
+        if (!buffer.empty()) {
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+    }
+};
+
+// Timestamps are held as epoch seconds (0 means "unset") and only turned
+// into local "YYYY-MM-DD HH:MM:SS" text when written to the text format or
+// the journal. The conversions use calendar arithmetic plus a per-thread
+// cache of the UTC offset, so bulk loads and saves do not pay for
+// mktime/localtime on every record; localtime_r is only consulted when
+// the cached offset window is left.
+inline std::int64_t daysFromCivil(std::int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    const std::int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+    const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<std::int64_t>(dayOfEra) - 719468;
+}
+
+inline void civilFromDays(std::int64_t days, std::int64_t& year, unsigned& month, unsigned& day) {
+    days += 719468;
+    const std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned dayOfEra = static_cast<unsigned>(days - era * 146097);
+    const unsigned yearOfEra =
+        (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const unsigned monthIndex = (5 * dayOfYear + 2) / 153;
+    day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+    month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+    year = static_cast<std::int64_t>(yearOfEra) + era * 400 + (month <= 2);
+}
+
+// Local time minus UTC at `epoch`, in seconds, straight from the C library.
+inline std::int64_t localOffsetAt(std::int64_t epoch) {
+    std::time_t when = static_cast<std::time_t>(epoch);
+    std::tm local;
+#ifdef _WIN32
+    localtime_s(&local, &when);
+#else
+    localtime_r(&when, &local);
+#endif
+    std::int64_t asUtc = daysFromCivil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday) *
+                             86400 + local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+    return asUtc - epoch;
+}
+
+// localOffsetAt, cached. Offsets change at most once a day, on a quarter
+// hour, so a day whose first and last second share an offset is cached
+// whole in a small per-thread table; that keeps scattered timestamps
+// (a store spanning years) off localtime. A transition day falls back to
+// quarter-hour windows.
+inline std::int64_t utcOffsetAt(std::int64_t epoch) {
+    struct DayOffset {
+        std::int64_t day;
+        std::int64_t offset;
+        bool valid;
+        bool uniform;
+    };
+    const size_t kCachedDays = 1024;
+    thread_local DayOffset days[kCachedDays] = {};
+
+    std::int64_t day = (epoch >= 0 ? epoch : epoch - 86399) / 86400;
+    DayOffset& entry = days[static_cast<size_t>(day) % kCachedDays];
+    if (!entry.valid || entry.day != day) {
+        entry.day = day;
+        entry.offset = localOffsetAt(day * 86400);
+        entry.uniform = localOffsetAt(day * 86400 + 86399) == entry.offset;
+        entry.valid = true;
+    }
+    if (entry.uniform) {
+        return entry.offset;
+    }
+
+    const std::int64_t window = 15 * 60;
+    thread_local std::int64_t cachedWindow = INT64_MIN;
+    thread_local std::int64_t cachedOffset = 0;
+
+    std::int64_t key = (epoch >= 0 ? epoch : epoch - window + 1) / window;
+    if (key != cachedWindow) {
+        cachedOffset = localOffsetAt(epoch);
+        cachedWindow = key;
+    }
+    return cachedOffset;
+}
+
+inline char* writeDigits(char* out, std::int64_t value, int width) {
+    for (int i = width - 1; i >= 0; --i) {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+    return out + width;
+}
+
+// Writes into a caller-provided buffer and returns the formatted length.
+inline size_t formatTimestamp(std::int64_t epoch, char (&buffer)[32]) {
+    if (epoch == 0) {
+        return 0;
+    }
+
+    std::int64_t local = epoch + utcOffsetAt(epoch);
+    std::int64_t days = (local >= 0 ? local : local - 86399) / 86400;
+    std::int64_t seconds = local - days * 86400;
+    std::int64_t year = 0;
+    unsigned month = 0;
+    unsigned day = 0;
+    civilFromDays(days, year, month, day);
+    if (year < 0 || year > 9999) {
+        return 0;
+    }
+
+    char* out = writeDigits(buffer, year, 4);
+    *out++ = '-';
+    out = writeDigits(out, month, 2);
+    *out++ = '-';
+    out = writeDigits(out, day, 2);
+    *out++ = ' ';
+    out = writeDigits(out, seconds / 3600, 2);
+    *out++ = ':';
+    out = writeDigits(out, seconds / 60 % 60, 2);
+    *out++ = ':';
+    out = writeDigits(out, seconds % 60, 2);
+    return static_cast<size_t>(out - buffer);
+}
+
+inline std::string formatTimestamp(std::int64_t epoch) {
+    char buffer[32];
+    return std::string(buffer, formatTimestamp(epoch, buffer));
+}
+
+// Accepts exactly "YYYY-MM-DD HH:MM:SS"; anything else reads as unset.
+inline std::int64_t parseTimestamp(StringRef text) {
+    static const char pattern[] = "dddd-dd-dd dd:dd:dd";
+    if (text.size() != sizeof(pattern) - 1) {
+        return 0;
+    }
+
+    const char* chars = text.data();
+    for (size_t i = 0; i < text.size(); ++i) {
+        bool isDigit = chars[i] >= '0' && chars[i] <= '9';
+        if ((pattern[i] == 'd') != isDigit || (!isDigit && chars[i] != pattern[i])) {
+            return 0;
+        }
+    }
+
+    auto number = [chars](size_t offset, size_t width) {
+        std::int64_t value = 0;
+        for (size_t i = offset; i < offset + width; ++i) {
+            value = value * 10 + (chars[i] - '0');
+        }
+        return value;
+    };
+
+    std::int64_t local = daysFromCivil(number(0, 4), static_cast<unsigned>(number(5, 2)),
+                                       static_cast<unsigned>(number(8, 2))) * 86400 +
+                         number(11, 2) * 3600 + number(14, 2) * 60 + number(17, 2);
+    std::int64_t guess = local - utcOffsetAt(local);
+    return local - utcOffsetAt(guess);
+}
+
+// Fields of one persisted record, pointing into the buffer they came from.
+struct TaskFields {
+    int id;
+    StringRef description;
+    bool completed;
+    std::int64_t createdAt;
+    std::int64_t completedAt;
+};
+
+class Task {
+private:
+    int id;
+    std::string description;
+    bool isCompleted;
+    std::int64_t createdAt;
+    std::int64_t completedAt;
+
+public:
+    Task(int taskId, const std::string& desc) 
+        : id(taskId), description(desc), isCompleted(false), completedAt(0) {
+        createdAt = Task::getCurrentTimestamp();
+    }
+
+    // Getters
+    int getId() const { return id; }
+    const std::string& getDescription() const { return description; }
+    bool getIsCompleted() const { return isCompleted; }
+    std::int64_t getCreatedAt() const { return createdAt; }
+    std::int64_t getCompletedAt() const { return completedAt; }
+
+    void markComplete() {
+        isCompleted = true;
+        completedAt = Task::getCurrentTimestamp();
+    }
+
+    std::string toFileString() const {
+        return std::to_string(id) + "|" + description + "|" + 
+               (isCompleted ? "1" : "0") + "|" + formatTimestamp(createdAt) + "|" +
+               formatTimestamp(completedAt);
+    }
+
+    // Journal records keep the description last so it may contain '|'.
+    std::string toJournalString() const {
+        return std::to_string(id) + "|" + (isCompleted ? "1" : "0") + "|" +
+               formatTimestamp(createdAt) + "|" + formatTimestamp(completedAt) + "|" +
+               description;
+    }
+
+    TaskFields fields() const {
+        return TaskFields{id, description, isCompleted, createdAt, completedAt};
+    }
+
+    // Rebuilds a task from persisted fields without stamping a new creation time.
+    static Task fromFields(const TaskFields& fields) {
+        return Task(fields.id, fields.description.str(), fields.completed,
+                    fields.createdAt, fields.completedAt);
+    }
+
+    // Parses one snapshot line straight out of a buffer (e.g. a mapped
+    // file) without building intermediate strings for the delimiters.
+    // Only the description may contain '|', so the id is split off the
+    // front and status, createdAt and completedAt off the back. Lines with
+    // four fields (no completedAt) come from hand-edited stores.
+    static bool parseFileLine(const char* begin, const char* end, TaskFields& fields) {
+        const char* idEnd = static_cast<const char*>(std::memchr(begin, '|', end - begin));
+        if (!idEnd || !parseTaskId(begin, idEnd, fields.id)) {
+            return false;
+        }
+
+        const char* bars[3]; // the last three '|' after the id, from the end
+        size_t barCount = 0;
+        for (const char* cursor = end; barCount < 3 && --cursor > idEnd;) {
+            if (*cursor == '|') {
+                bars[barCount++] = cursor;
+            }
+        }
+        if (barCount < 2) {
+            return false;
+        }
+
+        const char* statusBar = bars[barCount - 1];
+        const char* createdBar = bars[barCount - 2];
+        const char* createdEnd = barCount == 3 ? bars[0] : end;
+        fields.description = StringRef(idEnd + 1, statusBar);
+        fields.completed = (createdBar - statusBar == 2 && statusBar[1] == '1');
+        fields.createdAt = parseTimestamp(StringRef(createdBar + 1, createdEnd));
+        fields.completedAt = barCount == 3 ? parseTimestamp(StringRef(bars[0] + 1, end)) : 0;
+        return true;
+    }
+
+    static bool parseJournalLine(const char* begin, const char* end, TaskFields& fields) {
+        const char* fieldBegin[5];
+        const char* fieldEnd[5];
+        if (splitFields(begin, end, fieldBegin, fieldEnd, 5) < 5 ||
+            !parseTaskId(fieldBegin[0], fieldEnd[0], fields.id)) {
+            return false;
+        }
+
+        fields.completed = (fieldEnd[1] - fieldBegin[1] == 1 && *fieldBegin[1] == '1');
+        fields.createdAt = parseTimestamp(StringRef(fieldBegin[2], fieldEnd[2]));
+        fields.completedAt = parseTimestamp(StringRef(fieldBegin[3], fieldEnd[3]));
+        fields.description = StringRef(fieldBegin[4], fieldEnd[4]);
+        return true;
+    }
+
+private:
+    Task(int taskId, std::string desc, bool done, std::int64_t created, std::int64_t completed)
+        : id(taskId), description(std::move(desc)), isCompleted(done),
+          createdAt(created), completedAt(completed) {}
+
+    // Splits [begin, end) on '|' into at most maxFields fields; the last
+    // field runs to the end of the line.
+    static size_t splitFields(const char* begin, const char* end, const char** fieldBegin,
+                              const char** fieldEnd, size_t maxFields) {
+        size_t fieldCount = 0;
+        const char* cursor = begin;
+        while (fieldCount < maxFields) {
+            const char* bar = nullptr;
+            if (fieldCount + 1 < maxFields) {
+                bar = static_cast<const char*>(std::memchr(cursor, '|', end - cursor));
+            }
+            fieldBegin[fieldCount] = cursor;
+            fieldEnd[fieldCount] = bar ? bar : end;
+            ++fieldCount;
+            if (!bar) {
+                break;
+            }
+            cursor = bar + 1;
+        }
+        return fieldCount;
+    }
+
+    static std::int64_t getCurrentTimestamp() {
+        return static_cast<std::int64_t>(std::time(nullptr));
+    }
+};
+
+// Identifies one version of a file on disk. Files are replaced by rename,
+// so a changed inode means another process wrote a new version. Always
+// compares equal on Windows, where this is not tracked.
+struct FileIdentity {
+    std::uint64_t device;
+    std::uint64_t inode;
+    std::uint64_t size;
+    std::int64_t modifiedNanos;
+
+    FileIdentity() : device(0), inode(0), size(0), modifiedNanos(0) {}
+
+    bool operator==(const FileIdentity& other) const {
+        return device == other.device && inode == other.inode && size == other.size &&
+               modifiedNanos == other.modifiedNanos;
+    }
+    bool operator!=(const FileIdentity& other) const { return !(*this == other); }
+
+#ifndef _WIN32
+    static FileIdentity fromStat(const struct stat& info) {
+        FileIdentity identity;
+        identity.device = static_cast<std::uint64_t>(info.st_dev);
+        identity.inode = static_cast<std::uint64_t>(info.st_ino);
+        identity.size = static_cast<std::uint64_t>(info.st_size);
+#ifdef __APPLE__
+        identity.modifiedNanos = info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+        identity.modifiedNanos = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+        return identity;
+    }
+#endif
+
+    static FileIdentity of(const std::string& path) {
+#ifndef _WIN32
+        struct stat info;
+        if (::stat(path.c_str(), &info) == 0) {
+            return fromStat(info);
+        }
+#else
+        (void)path;
+#endif
+        return FileIdentity();
+    }
+};
+
+// Read-only view of a whole file. Uses mmap where available so the loader
+// can scan the page cache directly instead of copying lines out of a stream.
+class MappedFile {
+private:
+    const char* mapped;
+    size_t length;
+    bool opened;
+    FileIdentity fileIdentity;
+#ifdef _WIN32
+    std::string buffer;
+#endif
+
+public:
+    explicit MappedFile(const std::string& path) : mapped(nullptr), length(0), opened(false) {
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            return;
+        }
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        mapped = buffer.data();
+        length = buffer.size();
+        opened = true;
+        CommandStats::current().addBytesRead(length);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat info;
+        if (::fstat(fd, &info) == 0) {
+            opened = true;
+            fileIdentity = FileIdentity::fromStat(info);
+            length = static_cast<size_t>(info.st_size);
+            if (length > 0) {
+                void* region = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (region == MAP_FAILED) {
+                    opened = false;
+                    length = 0;
+                } else {
+                    ::madvise(region, length, MADV_SEQUENTIAL);
+                    mapped = static_cast<const char*>(region);
+                    CommandStats::current().addBytesRead(length);
+                }
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (mapped) {
+            ::munmap(const_cast<char*>(mapped), length);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return opened; }
+    const char* data() const { return mapped; }
+    size_t size() const { return length; }
+    const FileIdentity& identity() const { return fileIdentity; }
+
+    // Asks the kernel to start reading [from, to) in the background
+    // (MADV_WILLNEED), so a later access does not wait on a page fault.
+    // A hint only; a no-op on Windows, where the file is already in memory.
+    void willNeed(size_t from, size_t to) const {
+#ifndef _WIN32
+        to = std::min(to, length);
+        if (!mapped || from >= to) {
+            return;
+        }
+        static const size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t begin = from - from % pageSize;
+        ::madvise(const_cast<char*>(mapped) + begin, to - begin, MADV_WILLNEED);
+#else
+        (void)from;
+        (void)to;
+#endif
+    }
+
+    // Length up to and including the last newline. A file that is being
+    // appended to may end in a partially written line, which readers skip.
+    size_t terminatedSize() const {
+        size_t end = length;
+        while (end > 0 && mapped[end - 1] != '\n') {
+            --end;
+        }
+        return end;
+    }
+
+    // Calls visit(begin, end) for every non-empty line in [from, to).
+    template <typename Visitor>
+    void forEachLine(Visitor visit, size_t from = 0, size_t to = SIZE_MAX) const {
+        scanLines([&visit](const char* begin, const char* end) {
+            visit(begin, end);
+            return true;
+        }, from, to);
+    }
+
+    // Like forEachLine, but stops as soon as visit returns false.
+    template <typename Visitor>
+    void scanLines(Visitor visit, size_t from = 0, size_t to = SIZE_MAX) const {
+        if (!mapped) {
+            return;
+        }
+        const char* cursor = mapped + std::min(from, length);
+        const char* end = mapped + std::min(to, length);
+        while (cursor < end) {
+            auto newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+            const char* lineEnd = newline ? newline : end;
+            if (lineEnd != cursor && !visit(cursor, lineEnd)) {
+                return;
+            }
+            cursor = lineEnd + 1;
+        }
+    }
+};
+
+// Double-buffered read-ahead for a range of a mapping that is consumed
+// front to back: while the caller parses one window, the window after it
+// is already being read (MappedFile::willNeed), so a cold store is read
+// and parsed at the same time instead of one page fault at a time. A
+// disabled ReadAhead does nothing.
+class ReadAhead {
+private:
+    static constexpr size_t kWindowBytes = 4 << 20; // 4 MiB
+
+    const MappedFile& file;
+    size_t limit;
+    size_t requested; // end of the range asked for so far
+
+public:
+    ReadAhead(const MappedFile& mapped, size_t from, size_t to, bool enabled)
+        : file(mapped), limit(enabled ? std::min(to, mapped.size()) : 0), requested(from) {
+        advance(from);
+    }
+
+    // Called with the position being parsed; keeps one window requested
+    // beyond the current one.
+    void advance(size_t position) {
+        while (requested < limit && position + 2 * kWindowBytes > requested) {
+            file.willNeed(requested, requested + kWindowBytes);
+            requested += kWindowBytes;
+        }
+    }
+};
+
+// Advisory flock() held on a lock file for the lifetime of the object.
+// Store files are replaced by rename, so the lock lives in a file of its
+// own that is never replaced. One object may hold several lock files (a
+// sharded store locks every shard); they are released in reverse order.
+// Locking is a no-op on Windows.
+class FileLock {
+private:
+    std::vector<int> fds;
+
+public:
+    FileLock() {}
+
+    explicit FileLock(const std::string& path) { add(path); }
+
+    FileLock(FileLock&& other) : fds(std::move(other.fds)) { other.fds.clear(); }
+
+    FileLock& operator=(FileLock&& other) {
+        if (this != &other) {
+            release();
+            fds = std::move(other.fds);
+            other.fds.clear();
+        }
+        return *this;
+    }
+
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+
+    ~FileLock() { release(); }
+
+    // Blocks until the lock on `path` is held as well.
+    void add(const std::string& path) {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Unable to open lock file: " + path);
+        }
+        while (::flock(fd, LOCK_EX) != 0) {
+            if (errno != EINTR) {
+                ::close(fd);
+                throw std::runtime_error("Unable to lock " + path);
+            }
+        }
+        fds.push_back(fd);
+#else
+        (void)path;
+#endif
+    }
+
+    void release() {
+#ifndef _WIN32
+        for (auto it = fds.rbegin(); it != fds.rend(); ++it) {
+            ::flock(*it, LOCK_UN);
+            ::close(*it);
+        }
+#endif
+        fds.clear();
+    }
+};
+
+// Replaces `target` with `source`; readers holding the old file keep a
+// consistent copy.
+inline bool replaceFile(const std::string& source, const std::string& target) {
+#ifdef _WIN32
+    std::remove(target.c_str());
+#endif
+    return std::rename(source.c_str(), target.c_str()) == 0;
+}
+
+// Forces a file's contents to stable storage. A no-op on Windows.
+inline bool syncFile(const std::string& path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+#else
+    (void)path;
+    return true;
+#endif
+}
+
+// Makes a rename or newly created file in path's directory durable.
+inline bool syncParentDirectory(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return syncFile(slash == std::string::npos ? "." : path.substr(0, slash + 1));
+}
+
+// Output buffer for snapshot and archive files that overlaps formatting
+// with writing: the caller fills one buffer while a background thread
+// writes the other. With `startWriteback` (on Linux), each written range
+// is also handed to the device right away (sync_file_range), so the fsync
+// before the rename finds most of the file already on its way. Without
+// `pipelined` the buffers are written on the caller's thread.
+class WriteBehindFile : public std::streambuf {
+private:
+    static constexpr size_t kBufferSize = 1 << 20; // 1 MiB
+
+    std::FILE* file;
+    bool startWriteback;
+    std::vector<char> buffers[2];
+    size_t filling;            // the buffer being filled
+    std::uint64_t queuedBytes; // bytes passed to writeRange so far
+    std::uint64_t writtenBytes;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable changed;
+    const char* pending;  // the buffer being written, guarded by `mutex`
+    size_t pendingBytes;  // and its length; 0 once written
+    bool closing;
+    std::atomic<bool> failed;
+
+public:
+    WriteBehindFile()
+        : file(nullptr), startWriteback(false), filling(0), queuedBytes(0), writtenBytes(0),
+          pending(nullptr), pendingBytes(0), closing(false), failed(false) {}
+
+    ~WriteBehindFile() { close(); }
+
+    WriteBehindFile(const WriteBehindFile&) = delete;
+    WriteBehindFile& operator=(const WriteBehindFile&) = delete;
+
+    // Creates or truncates `path`. False when it cannot be opened.
+    bool open(const std::string& path, bool pipelined, bool writeback) {
+        file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        std::setvbuf(file, nullptr, _IONBF, 0);
+        startWriteback = writeback;
+        for (auto& buffer : buffers) {
+            buffer.resize(kBufferSize);
+        }
+        setp(buffers[0].data(), buffers[0].data() + kBufferSize);
+        if (pipelined) {
+            writer = std::thread([this]() { writeBehind(); });
+        }
+        return true;
+    }
+
+    // Writes what is buffered and closes the file. False if any write
+    // failed.
+    bool close() {
+        if (!file) {
+            return false;
+        }
+        handOff();
+        if (writer.joinable()) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this]() { return pendingBytes == 0; });
+                closing = true;
+            }
+            changed.notify_all();
+            writer.join();
+        }
+        if (std::fclose(file) != 0) {
+            failed = true;
+        }
+        file = nullptr;
+        return !failed;
+    }
+
+    // Bytes passed to the buffer so far.
+    std::uint64_t size() const {
+        return queuedBytes + static_cast<std::uint64_t>(pptr() - pbase());
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        handOff();
+        if (failed) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        handOff();
+        if (writer.joinable()) {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this]() { return pendingBytes == 0; });
+        }
+        return failed ? -1 : 0;
+    }
+
+private:
+    // Passes the filled part of the current buffer to the writer (waiting
+    // until it is done with the other one) and switches buffers.
+    void handOff() {
+        size_t length = static_cast<size_t>(pptr() - pbase());
+        if (length == 0) {
+            return;
+        }
+        queuedBytes += length;
+        if (!writer.joinable()) {
+            writeRange(pbase(), length);
+            setp(pbase(), epptr());
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this]() { return pendingBytes == 0; });
+            pending = pbase();
+            pendingBytes = length;
+        }
+        changed.notify_all();
+        filling ^= 1;
+        setp(buffers[filling].data(), buffers[filling].data() + kBufferSize);
+    }
+
+    void writeBehind() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            changed.wait(lock, [this]() { return pendingBytes != 0 || closing; });
+            if (pendingBytes == 0) {
+                return;
+            }
+            const char* data = pending;
+            size_t length = pendingBytes;
+            lock.unlock();
+            writeRange(data, length);
+            lock.lock();
+            pendingBytes = 0;
+            changed.notify_all();
+        }
+    }
+
+    void writeRange(const char* data, size_t length) {
+        if (failed || std::fwrite(data, 1, length, file) != length) {
+            failed = true;
+            return;
+        }
+#ifdef __linux__
+        if (startWriteback) {
+            ::sync_file_range(::fileno(file), static_cast<off_t>(writtenBytes),
+                              static_cast<off_t>(length), SYNC_FILE_RANGE_WRITE);
+        }
+#endif
+        writtenBytes += length;
+    }
+};
+
+// Pool for small fixed-size blocks such as hash-index nodes. Blocks are
+// carved from 64 KiB chunks with a pointer bump and freed blocks are
+// recycled by size, so loading a store costs a handful of chunk
+// allocations instead of one malloc per task. Larger requests (bucket
+// arrays) go straight to operator new.
+class BlockArena {
+public:
+    static constexpr size_t kGranularity = sizeof(void*);
+
+private:
+    static constexpr size_t kChunkSize = 64 << 10;
+    static constexpr size_t kMaxPooledSize = 16 * kGranularity;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char* cursor;
+    size_t remaining;
+    void* freeLists[kMaxPooledSize / kGranularity];
+
+public:
+    BlockArena() : cursor(nullptr), remaining(0), freeLists() {}
+
+    BlockArena(const BlockArena&) = delete;
+    BlockArena& operator=(const BlockArena&) = delete;
+
+    void* allocate(size_t bytes) {
+        if (bytes > kMaxPooledSize) {
+            return ::operator new(bytes);
+        }
+        size_t rounded = (std::max(bytes, kGranularity) + kGranularity - 1) / kGranularity * kGranularity;
+        void*& freeList = freeLists[rounded / kGranularity - 1];
+        if (freeList) {
+            void* block = freeList;
+            freeList = *static_cast<void**>(block);
+            return block;
+        }
+        if (remaining < rounded) {
+            chunks.emplace_back(new char[kChunkSize]);
+            cursor = chunks.back().get();
+            remaining = kChunkSize;
+        }
+        void* block = cursor;
+        cursor += rounded;
+        remaining -= rounded;
+        return block;
+    }
+
+    void deallocate(void* block, size_t bytes) {
+        if (bytes > kMaxPooledSize) {
+            ::operator delete(block);
+            return;
+        }
+        size_t rounded = (std::max(bytes, kGranularity) + kGranularity - 1) / kGranularity * kGranularity;
+        void*& freeList = freeLists[rounded / kGranularity - 1];
+        *static_cast<void**>(block) = freeList;
+        freeList = block;
+    }
+};
+
+constexpr size_t BlockArena::kGranularity; // odr-used by std::max
+
+// Standard allocator over a shared BlockArena. Copies of an allocator share
+// the arena (node-based containers rebind and copy it internally), while a
+// copied container starts a pool of its own. Not thread-safe: each arena
+// belongs to a single container.
+template <typename T>
+class ArenaAllocator {
+    static_assert(alignof(T) <= BlockArena::kGranularity, "over-aligned type for BlockArena");
+
+    template <typename U>
+    friend class ArenaAllocator;
+
+    std::shared_ptr<BlockArena> arena;
+
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator() : arena(std::make_shared<BlockArena>()) {}
+    // Declared so that moving an allocator copies it: a moved-from
+    // container must keep a usable arena.
+    ArenaAllocator(const ArenaAllocator& other) : arena(other.arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(arena->allocate(count * sizeof(T)));
+    }
+
+    void deallocate(T* block, size_t count) {
+        arena->deallocate(block, count * sizeof(T));
+    }
+
+    ArenaAllocator select_on_container_copy_construction() const {
+        return ArenaAllocator();
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+// Contiguous structure-of-arrays storage for the loaded tasks. Every field
+// lives in its own column, timestamps are packed as epoch seconds and all
+// descriptions share one arena, so scans stream through memory instead of
+// chasing one heap allocation per task. The id index allocates its nodes
+// from a BlockArena for the same reason.
+//
+// Removing a task only tombstones its slot, so slots are numbered
+// 0..slotCount() and loops skip isRemoved() ones. The columns are packed
+// once tombstones make up half of the slots, or on compact().
+class TaskStore {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    // Slots per change-tracking chunk; see chunkStamp().
+    static constexpr size_t kChunkSlots = 4096;
+
+private:
+    using SlotIndex = std::unordered_map<int, size_t, std::hash<int>, std::equal_to<int>,
+                                         ArenaAllocator<std::pair<const int, size_t>>>;
+
+    std::vector<int> ids;
+    std::vector<bool> completedFlags;
+    std::vector<bool> removedFlags;
+    std::vector<std::int64_t> createdTimes;
+    std::vector<std::int64_t> completedTimes;
+    std::vector<size_t> descriptionOffsets;
+    std::vector<std::uint32_t> descriptionLengths;
+    std::string descriptionArena;
+    size_t wastedArenaBytes;
+    size_t removedCount;
+    SlotIndex slotById;
+    std::vector<std::uint64_t> chunkStamps;
+
+public:
+    TaskStore() : wastedArenaBytes(0), removedCount(0) {}
+
+    size_t size() const { return ids.size() - removedCount; }
+    bool empty() const { return size() == 0; }
+    size_t slotCount() const { return ids.size(); }
+    size_t tombstoneCount() const { return removedCount; }
+
+    void reserve(size_t taskCount, size_t descriptionBytes) {
+        ids.reserve(taskCount);
+        completedFlags.reserve(taskCount);
+        removedFlags.reserve(taskCount);
+        createdTimes.reserve(taskCount);
+        completedTimes.reserve(taskCount);
+        descriptionOffsets.reserve(taskCount);
+        descriptionLengths.reserve(taskCount);
+        descriptionArena.reserve(descriptionBytes);
+        slotById.reserve(taskCount);
+    }
+
+    size_t find(int taskId) const {
+        auto found = slotById.find(taskId);
+        return (found != slotById.end()) ? found->second : npos;
+    }
+
+    int id(size_t slot) const { return ids[slot]; }
+    bool isCompleted(size_t slot) const { return completedFlags[slot]; }
+    bool isRemoved(size_t slot) const { return removedFlags[slot]; }
+
+    StringRef description(size_t slot) const {
+        return StringRef(descriptionArena.data() + descriptionOffsets[slot],
+                         descriptionLengths[slot]);
+    }
+
+    std::int64_t createdAt(size_t slot) const { return createdTimes[slot]; }
+    std::int64_t completedAt(size_t slot) const { return completedTimes[slot]; }
+
+    TaskFields fieldsAt(size_t slot) const {
+        return TaskFields{id(slot), description(slot), isCompleted(slot),
+                          createdAt(slot), completedAt(slot)};
+    }
+
+    Task toTask(size_t slot) const {
+        return Task::fromFields(fieldsAt(slot));
+    }
+
+    // Changes whenever a task in slots [chunk * kChunkSlots, +kChunkSlots)
+    // changes. Stamps come from one process-wide counter, so a chunk of a
+    // reloaded store never matches a stamp taken from an older store.
+    size_t chunkCount() const { return (ids.size() + kChunkSlots - 1) / kChunkSlots; }
+    std::uint64_t chunkStamp(size_t chunk) const { return chunkStamps[chunk]; }
+
+    // Appends a new task, or overwrites the existing one with the same id.
+    void put(const TaskFields& fields) {
+        size_t slot = find(fields.id);
+        if (slot == npos) {
+            slotById[fields.id] = ids.size();
+            ids.push_back(fields.id);
+            completedFlags.push_back(fields.completed);
+            removedFlags.push_back(false);
+            createdTimes.push_back(fields.createdAt);
+            completedTimes.push_back(fields.completedAt);
+            descriptionOffsets.push_back(0);
+            descriptionLengths.push_back(0);
+            slot = ids.size() - 1;
+        } else {
+            completedFlags[slot] = fields.completed;
+            createdTimes[slot] = fields.createdAt;
+            completedTimes[slot] = fields.completedAt;
+            wastedArenaBytes += descriptionLengths[slot];
+        }
+
+        descriptionOffsets[slot] = descriptionArena.size();
+        descriptionLengths[slot] = static_cast<std::uint32_t>(fields.description.size());
+        descriptionArena.append(fields.description.data(), fields.description.size());
+        touch(slot);
+    }
+
+    void markCompleted(size_t slot, std::int64_t timestamp) {
+        completedFlags[slot] = true;
+        completedTimes[slot] = timestamp;
+        touch(slot);
+    }
+
+    // Tombstones the slot; the remaining tasks keep their slots until the
+    // store is compacted.
+    void erase(size_t slot) {
+        slotById.erase(ids[slot]);
+        removedFlags[slot] = true;
+        wastedArenaBytes += descriptionLengths[slot];
+        ++removedCount;
+        touch(slot);
+
+        if (removedCount > ids.size() / 2) {
+            compact();
+        } else if (wastedArenaBytes > descriptionArena.size() / 2) {
+            compactArena();
+        }
+    }
+
+    // Drops tombstoned slots, keeping the remaining tasks in order. Slot
+    // numbers obtained before the call are invalidated.
+    void compact() {
+        size_t kept = 0;
+        for (size_t slot = 0; slot < ids.size(); ++slot) {
+            if (removedFlags[slot]) {
+                continue;
+            }
+            if (kept != slot) {
+                touch(kept);
+                ids[kept] = ids[slot];
+                completedFlags[kept] = completedFlags[slot];
+                createdTimes[kept] = createdTimes[slot];
+                completedTimes[kept] = completedTimes[slot];
+                descriptionOffsets[kept] = descriptionOffsets[slot];
+                descriptionLengths[kept] = descriptionLengths[slot];
+                slotById[ids[kept]] = kept;
+            }
+            ++kept;
+        }
+        ids.resize(kept);
+        completedFlags.resize(kept);
+        removedFlags.assign(kept, false);
+        createdTimes.resize(kept);
+        completedTimes.resize(kept);
+        descriptionOffsets.resize(kept);
+        descriptionLengths.resize(kept);
+        removedCount = 0;
+        chunkStamps.resize(chunkCount());
+        compactArena();
+    }
+
+private:
+    void touch(size_t slot) {
+        static std::atomic<std::uint64_t> lastStamp(0);
+        size_t chunk = slot / kChunkSlots;
+        if (chunk >= chunkStamps.size()) {
+            chunkStamps.resize(chunk + 1);
+        }
+        chunkStamps[chunk] = lastStamp.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    // Drops the bytes of removed or replaced descriptions from the arena.
+    void compactArena() {
+        std::string packed;
+        packed.reserve(descriptionArena.size() - wastedArenaBytes);
+        for (size_t slot = 0; slot < ids.size(); ++slot) {
+            if (removedFlags[slot]) {
+                continue;
+            }
+            size_t offset = packed.size();
+            packed.append(descriptionArena, descriptionOffsets[slot], descriptionLengths[slot]);
+            descriptionOffsets[slot] = offset;
+        }
+        descriptionArena.swap(packed);
+        wastedArenaBytes = 0;
+    }
+};
+
+// Fixed-width column helpers for the binary file formats. Reads go through
+// memcpy because mapped columns are not guaranteed to be aligned.
+template <typename T>
+T readColumnValue(const char* column, size_t index) {
+    T value;
+    std::memcpy(&value, column + index * sizeof(T), sizeof(T));
+    return value;
+}
+
+template <typename T>
+void writeColumn(std::ofstream& file, const std::vector<T>& column) {
+    file.write(reinterpret_cast<const char*>(column.data()),
+               static_cast<std::streamsize>(column.size() * sizeof(T)));
+}
+
+// Selection applied by `list` and `search`: status, a creation-time
+// window, an optional set of ids, an order and a page.
+struct TaskFilter {
+    enum class Status { Any, Pending, Done };
+    // Stored keeps file order; the others are served by persisted indexes.
+    enum class Order { Stored, Id, Created, Completed };
+
+    static constexpr size_t kUnlimited = static_cast<size_t>(-1);
+
+    Status status;
+    std::int64_t createdFrom;  // inclusive; 0 means unbounded
+    std::int64_t createdUntil; // exclusive; 0 means unbounded
+    size_t offset;
+    size_t limit;
+    const std::vector<int>* ids; // sorted; nullptr selects every id
+    Order order;
+
+    TaskFilter()
+        : status(Status::Any), createdFrom(0), createdUntil(0), offset(0), limit(kUnlimited),
+          ids(nullptr), order(Order::Stored) {}
+
+    bool selectsEverything() const {
+        return status == Status::Any && createdFrom == 0 && createdUntil == 0 &&
+               offset == 0 && limit == kUnlimited && ids == nullptr;
+    }
+
+    // Ascending key for `sortOrder`: ids ascending, oldest created first,
+    // or most recently completed first with pending tasks last. Ties go
+    // to the lower id.
+    static std::pair<std::int64_t, int> sortKey(Order sortOrder, int taskId,
+                                                std::int64_t createdAt, std::int64_t completedAt) {
+        switch (sortOrder) {
+        case Order::Created:
+            return std::make_pair(createdAt, taskId);
+        case Order::Completed:
+            return std::make_pair(completedAt != 0 ? -completedAt : INT64_MAX, taskId);
+        default:
+            return std::make_pair(std::int64_t(0), taskId);
+        }
+    }
+
+    bool matches(int taskId, bool completed, std::int64_t createdAt) const {
+        if ((status == Status::Pending && completed) || (status == Status::Done && !completed)) {
+            return false;
+        }
+        if (ids && !std::binary_search(ids->begin(), ids->end(), taskId)) {
+            return false;
+        }
+        return (createdFrom == 0 || createdAt >= createdFrom) &&
+               (createdUntil == 0 || createdAt < createdUntil);
+    }
+};
+
+// Ids named on the command line for a bulk complete or remove: single ids
+// and inclusive ranges, as in "3,7,100-5000". An empty selection selects
+// every id.
+struct IdSelection {
+    std::vector<std::pair<int, int>> ranges; // sorted and merged
+
+    bool empty() const { return ranges.empty(); }
+
+    bool isSingleId() const {
+        return ranges.size() == 1 && ranges[0].first == ranges[0].second;
+    }
+
+    bool contains(int taskId) const {
+        if (ranges.empty()) {
+            return true;
+        }
+        auto next = std::upper_bound(ranges.begin(), ranges.end(), std::make_pair(taskId, INT_MAX));
+        return next != ranges.begin() && (next - 1)->second >= taskId;
+    }
+
+    // Adds a comma-separated list of ids and ranges; false on a malformed
+    // entry, leaving the selection unchanged.
+    bool parse(const std::string& text) {
+        std::vector<std::pair<int, int>> parsed(ranges);
+        size_t start = 0;
+        while (start <= text.size()) {
+            size_t comma = text.find(',', start);
+            size_t stop = (comma == std::string::npos) ? text.size() : comma;
+            const char* begin = text.data() + start;
+            const char* end = text.data() + stop;
+            const char* dash = static_cast<const char*>(std::memchr(begin, '-', end - begin));
+            int first = 0;
+            int last = 0;
+            if (!parseTaskId(begin, dash ? dash : end, first) ||
+                (dash && !parseTaskId(dash + 1, end, last)) || first <= 0) {
+                return false;
+            }
+            if (!dash) {
+                last = first;
+            }
+            if (last < first) {
+                return false;
+            }
+            parsed.emplace_back(first, last);
+            start = stop + 1;
+        }
+
+        std::sort(parsed.begin(), parsed.end());
+        ranges.clear();
+        for (const auto& range : parsed) {
+            if (!ranges.empty() && range.first <= ranges.back().second + 1LL) {
+                ranges.back().second = std::max(ranges.back().second, range.second);
+            } else {
+                ranges.push_back(range);
+            }
+        }
+        return true;
+    }
+};
+
+// Applies a TaskFilter's predicate and page to a stream of records.
+class FilterCursor {
+private:
+    const TaskFilter& filter;
+    size_t matched;
+
+public:
+    explicit FilterCursor(const TaskFilter& taskFilter) : filter(taskFilter), matched(0) {}
+
+    // True when the record matches and falls inside the requested page.
+    bool accept(int taskId, bool completed, std::int64_t createdAt) {
+        if (isDone() || !filter.matches(taskId, completed, createdAt)) {
+            return false;
+        }
+        return matched++ >= filter.offset;
+    }
+
+    bool isDone() const {
+        return filter.limit != TaskFilter::kUnlimited && matched >= filter.offset + filter.limit;
+    }
+};
+
+// Immutable copy of a resident store, published for server read workers
+// so a long listing neither blocks the server thread nor sees a half-done
+// mutation. The copy is made of chunks that mirror TaskStore's change
+// chunks; publishing a new version after a mutation rebuilds only the
+// chunks whose stamp changed and shares the rest with the previous
+// version. A version, and any chunk no newer version shares, is freed
+// when its last reader drops it.
+class StoreVersion {
+private:
+    struct Chunk {
+        std::uint64_t stamp;
+        std::vector<int> ids;
+        std::vector<std::uint8_t> completedFlags;
+        std::vector<std::int64_t> createdTimes;
+        std::vector<std::int64_t> completedTimes;
+        std::vector<std::uint32_t> descriptionEnds;
+        std::string descriptions;
+    };
+
+    std::vector<std::shared_ptr<const Chunk>> chunks;
+    size_t taskCount;
+
+public:
+    StoreVersion() : taskCount(0) {}
+
+    size_t size() const { return taskCount; }
+
+    // The version of `tasks`, sharing unchanged chunks with `previous`.
+    static std::shared_ptr<const StoreVersion> publish(
+        const TaskStore& tasks, const std::shared_ptr<const StoreVersion>& previous) {
+        auto version = std::make_shared<StoreVersion>();
+        version->chunks.reserve(tasks.chunkCount());
+        bool reused = previous && previous->chunks.size() == tasks.chunkCount();
+        for (size_t chunk = 0; chunk < tasks.chunkCount(); ++chunk) {
+            if (previous && chunk < previous->chunks.size() &&
+                previous->chunks[chunk]->stamp == tasks.chunkStamp(chunk)) {
+                version->chunks.push_back(previous->chunks[chunk]);
+            } else {
+                version->chunks.push_back(buildChunk(tasks, chunk));
+                reused = false;
+            }
+            version->taskCount += version->chunks.back()->ids.size();
+        }
+        return reused ? previous : version;
+    }
+
+    // Visits the tasks that `filter` selects, in store order. The filter's
+    // order is ignored.
+    template <typename Visit>
+    void scan(const TaskFilter& filter, Visit visit) const {
+        FilterCursor cursor(filter);
+        for (const auto& chunk : chunks) {
+            for (size_t row = 0; row < chunk->ids.size(); ++row) {
+                if (cursor.isDone()) {
+                    return;
+                }
+                bool completed = chunk->completedFlags[row] != 0;
+                if (!cursor.accept(chunk->ids[row], completed, chunk->createdTimes[row])) {
+                    continue;
+                }
+                size_t begin = row == 0 ? 0 : chunk->descriptionEnds[row - 1];
+                TaskFields fields{chunk->ids[row],
+                                  StringRef(chunk->descriptions.data() + begin,
+                                            chunk->descriptionEnds[row] - begin),
+                                  completed, chunk->createdTimes[row],
+                                  chunk->completedTimes[row]};
+                visit(fields);
+            }
+        }
+    }
+
+private:
+    static std::shared_ptr<const Chunk> buildChunk(const TaskStore& tasks, size_t chunk) {
+        auto built = std::make_shared<Chunk>();
+        built->stamp = tasks.chunkStamp(chunk);
+        size_t first = chunk * TaskStore::kChunkSlots;
+        size_t last = std::min(first + TaskStore::kChunkSlots, tasks.slotCount());
+        for (size_t slot = first; slot < last; ++slot) {
+            if (tasks.isRemoved(slot)) {
+                continue;
+            }
+            StringRef description = tasks.description(slot);
+            built->ids.push_back(tasks.id(slot));
+            built->completedFlags.push_back(tasks.isCompleted(slot) ? 1 : 0);
+            built->createdTimes.push_back(tasks.createdAt(slot));
+            built->completedTimes.push_back(tasks.completedAt(slot));
+            built->descriptions.append(description.data(), description.size());
+            built->descriptionEnds.push_back(static_cast<std::uint32_t>(built->descriptions.size()));
+        }
+        return built;
+    }
+};
+
+enum class StorageFormat { Text, Binary };
+
+// When writes are forced to stable storage with fsync. Snapshots are always
+// replaced atomically; this only decides what survives a power loss.
+//   None   never
+//   Batch  every snapshot: compactions, batch commits and migrations
+//   Op     every snapshot and every journal record, and batch operations
+//          are journaled one by one instead of once at commit
+enum class Durability { None, Batch, Op };
+
+// How snapshot and archive files move to and from disk.
+//   Sync       one step at a time: a save formats, then writes each
+//              buffer; a load faults pages in as the parser reaches them
+//   Pipelined  saves format the next buffer while the last one is written
+//              (WriteBehindFile), and loads and full scans read the next
+//              window ahead of the parser (ReadAhead)
+enum class IoMode { Sync, Pipelined };
+
+// What TodoManager needs from a store on disk: whole-store loadTasks and
+// saveTasks, per-record reads (findTask), puts and deletes (the record*
+// calls) and filtered, ordered range scans (scanTasks). TodoStorage keeps
+// the store in one snapshot file and its journal; ShardedStorage
+// partitions it over several TodoStorage shards; SqliteStorage keeps one
+// row per task in an embedded database. Methods are const where they only
+// read or append to files and update cached file state.
+class StorageBackend {
+public:
+    // Passed to lockForTask() for a task that has no id yet.
+    static constexpr int kNewTask = 0;
+
+    virtual ~StorageBackend() {}
+
+    virtual const std::string& getFilename() const = 0;
+    virtual StorageFormat getFormat() const = 0;
+    virtual void setFormat(StorageFormat newFormat) = 0;
+    virtual Durability getDurability() const = 0;
+    virtual void setDurability(Durability level) = 0;
+    virtual IoMode getIoMode() const = 0;
+    virtual void setIoMode(IoMode mode) = 0;
+    virtual void setParseThreads(size_t threads) = 0;
+    virtual bool isJournaled() const = 0;
+    virtual std::streamoff journalBytes() const = 0;
+
+    virtual std::uint64_t getGeneration() const = 0;
+    virtual std::uint64_t currentGeneration() const = 0;
+    virtual int getNextId() const = 0;
+    virtual void reserveId(int taskId) const = 0;
+    // The id for a new task: `candidate`, or the first id after it that the
+    // lock from lockForTask(kNewTask) covers. The id is reserved.
+    virtual int claimId(int candidate) const = 0;
+
+    // lockForWrite covers the whole store; lockForTask only what a single
+    // mutation of `taskId` (or kNewTask) writes.
+    virtual FileLock lockForWrite() const = 0;
+    virtual FileLock lockForTask(int taskId) const = 0;
+    virtual bool refresh(TaskStore& tasks) const = 0;
+    virtual bool prepareAppend() const = 0;
+    virtual std::unique_ptr<Task> findTask(int taskId) const = 0;
+    virtual TaskStore loadTasks() const = 0;
+    virtual void scanTasks(const TaskFilter& filter,
+                           const std::function<void(const TaskFields&)>& visit) const = 0;
+    virtual bool saveTasks(const TaskStore& tasks) const = 0;
+    virtual bool recordAdded(const Task& task, const TaskStore* tasks) const = 0;
+    virtual bool recordCompleted(const Task& task, const TaskStore* tasks) const = 0;
+    virtual bool recordRemoved(int taskId, const TaskStore* tasks) const = 0;
+
+    // A backend with transactions (SqliteStorage) runs a batch as one:
+    // beginTransaction returns true and the batch's record* calls join it
+    // until commitTransaction. Otherwise TodoManager keeps the batch in
+    // memory and writes one snapshot when it ends.
+    virtual bool beginTransaction() const { return false; }
+    virtual bool commitTransaction() const { return false; }
+
+    // How tasks are partitioned. Files kept per shard, such as the search
+    // index, are named after shardFilename().
+    virtual size_t shardCount() const { return 1; }
+    virtual size_t shardOf(int taskId) const {
+        (void)taskId;
+        return 0;
+    }
+    virtual std::string shardFilename(size_t shard) const {
+        (void)shard;
+        return getFilename();
+    }
+
+    // Used by `migrate --shards`: a new layout continues the generations of
+    // the one it replaces, so archive blocks stay committed, and the old
+    // layout's files are deleted once the new one is saved.
+    virtual void continueGeneration(std::uint64_t previous) = 0;
+    virtual void removeFiles() const = 0;
+};
+
+class TodoStorage : public StorageBackend {
+private:
+    static constexpr std::streamoff kDefaultCompactionThreshold = 1 << 20; // 1 MiB
+    static constexpr std::uint32_t kBinaryVersion = 3;
+    static constexpr size_t kBinaryHeaderV1Size = 24;
+    static constexpr size_t kBinaryHeaderV2Size = 32;
+    // Text snapshots smaller than this per thread are parsed on one thread.
+    static constexpr size_t kParallelChunkBytes = 4 << 20; // 4 MiB
+    // Binary rows read ahead at a time during loads and scans.
+    static constexpr size_t kReadAheadRows = 64 << 10;
+
+    // Binary layout: a 40-byte header (24 bytes in version 1, which has no
+    // nextId, and 32 in version 2, which has no generation), then one column
+    // per field, then the description heap. Values are stored in native
+    // byte order.
+    //   int64  createdAt[count]     epoch seconds
+    //   int64  completedAt[count]   epoch seconds, 0 when not completed
+    //   int32  id[count]
+    //   uint64 descOffset[count+1]  offsets into the heap
+    //   uint8  status[count]        1 when completed
+    //   char   heap[heapSize]
+    struct BinaryHeader {
+        char magic[4];
+        std::uint32_t version;
+        std::uint64_t count;
+        std::uint64_t heapSize;
+        std::uint64_t nextId;
+        std::uint64_t generation;
+    };
+
+    // Several processes may share a store. Writers serialize on the lock
+    // file and catch up with each other through refresh() before mutating;
+    // readers never lock. Every snapshot carries a generation number and the
+    // journal starts with the generation it extends, so a journal that was
+    // already folded into a newer snapshot is ignored instead of replayed.
+    std::string filename;
+    std::string journalFilename;
+    std::string lockFilename;
+    std::string idIndexFilename;
+    std::string orderIndexFilename;
+    bool journalEnabled;
+    std::streamoff compactionThreshold;
+    mutable std::streamoff journalSize; // journal bytes reflected in memory
+    mutable bool journalStale;          // on-disk journal predates the snapshot
+    mutable int nextTaskId;
+    mutable std::uint64_t generation;
+    mutable FileIdentity snapshotIdentity;
+    StorageFormat format;
+    Durability durability;
+    IoMode ioMode;
+    size_t parseThreads;
+
+public:
+    explicit TodoStorage(const std::string& file = "todos.txt", bool journaled = true,
+                         std::streamoff threshold = kDefaultCompactionThreshold)
+        : filename(file), journalFilename(file + ".journal"), lockFilename(file + ".lock"),
+          idIndexFilename(file + ".ids"), orderIndexFilename(file + ".order"),
+          journalEnabled(journaled),
+          compactionThreshold(threshold), journalSize(0),
+          journalStale(false), nextTaskId(1), generation(0), format(detectFormat(file)),
+          durability(Durability::Batch), ioMode(IoMode::Pipelined),
+          parseThreads(defaultParseThreads()) {}
+
+    const std::string& getFilename() const override { return filename; }
+    StorageFormat getFormat() const override { return format; }
+    bool isJournaled() const override { return journalEnabled; }
+    std::streamoff journalBytes() const override { return journalSize; }
+
+    // The generation this process last loaded or wrote, and the one on disk.
+    std::uint64_t getGeneration() const override { return generation; }
+    std::uint64_t currentGeneration() const override {
+        MappedFile file(filename);
+        return file.size() == 0 ? 0 : snapshotGeneration(file);
+    }
+
+    void continueGeneration(std::uint64_t previous) override {
+        generation = std::max(generation, previous);
+    }
+
+    // Ids are never reused: the counter is persisted with each snapshot and
+    // advanced by every added task, including ones that were later removed.
+    int getNextId() const override { return nextTaskId; }
+
+    // Marks an id as used so the next snapshot persists a counter past it.
+    void reserveId(int taskId) const override {
+        if (taskId >= nextTaskId) {
+            nextTaskId = taskId + 1;
+        }
+    }
+
+    int claimId(int candidate) const override {
+        reserveId(candidate);
+        return candidate;
+    }
+
+    // Takes effect on the next snapshot written by saveTasks.
+    void setFormat(StorageFormat newFormat) override { format = newFormat; }
+
+    Durability getDurability() const override { return durability; }
+    void setDurability(Durability level) override { durability = level; }
+
+    IoMode getIoMode() const override { return ioMode; }
+    void setIoMode(IoMode mode) override { ioMode = mode; }
+
+    // Upper bound on threads used to parse large text snapshots.
+    void setParseThreads(size_t threads) override { parseThreads = std::max<size_t>(threads, 1); }
+
+    static size_t defaultParseThreads() {
+        unsigned int cores = std::thread::hardware_concurrency();
+        return cores > 0 ? cores : 1;
+    }
+
+    // Held around every mutation (or a whole batch) together with refresh(),
+    // so the critical section is a catch-up read and a journal append.
+    FileLock lockForWrite() const override {
+        return FileLock(lockFilename);
+    }
+
+    const std::string& getLockFilename() const { return lockFilename; }
+
+    FileLock lockForTask(int taskId) const override {
+        (void)taskId;
+        return lockForWrite();
+    }
+
+    // Brings `tasks` up to date with changes other processes made since it
+    // was loaded: a replaced snapshot is reloaded, new journal records are
+    // replayed. Returns true when anything changed.
+    bool refresh(TaskStore& tasks) const override {
+        bool changed = false;
+        if (!catchUp(tasks, changed)) {
+            tasks = loadTasks();
+            return true;
+        }
+        return changed;
+    }
+
+    // The journal part of refresh(): replays records appended since the
+    // last load or catch-up into `tasks`, which may hold other shards'
+    // tasks as well. Returns false when the snapshot was replaced or the
+    // journal rewritten, so only a reload brings `tasks` up to date.
+    bool catchUp(TaskStore& tasks, bool& changed) const {
+        changed = false;
+        if (FileIdentity::of(filename) != snapshotIdentity) {
+            return false;
+        }
+
+        MappedFile journal(journalFilename);
+        size_t available = journal.terminatedSize();
+        if (journalStale) {
+            // Another writer may have replaced the stale journal since.
+            if (available == 0 || !journalMatches(journal, generation)) {
+                return true;
+            }
+            journalStale = false;
+        } else if (available == static_cast<size_t>(journalSize)) {
+            return true;
+        }
+        if (available < static_cast<size_t>(journalSize) ||
+            !replayJournal(tasks, journal, static_cast<size_t>(journalSize))) {
+            return false;
+        }
+        changed = true;
+        return true;
+    }
+
+    // Point access for single mutations on a store that is not loaded. Both
+    // are called under the write lock and leave the journal ready for
+    // record* calls with a null store.
+    //
+    // prepareAppend reads the next id from the snapshot header and the
+    // journal instead of parsing records; it returns false when the header
+    // carries no counter (text files written before #next-id, binary v1).
+    bool prepareAppend() const override {
+        CommandStats::Scope phase(CommandStats::Load);
+        MappedFile file(filename);
+        MappedFile journal(journalFilename);
+        attachJournal(file, journal);
+
+        nextTaskId = 1;
+        if (file.size() > 0 && !readNextIdHeader(file)) {
+            return false;
+        }
+        if (!journalStale) {
+            reserveJournalIds(journal);
+        }
+        return true;
+    }
+
+    // The id counter as the files on disk have it, read without the write
+    // lock and without attaching to the journal, so the counter only moves
+    // forward. A hint: another writer may take the id before it is locked.
+    int peekNextId() const {
+        MappedFile file(filename);
+        MappedFile journal(journalFilename);
+        if (file.size() > 0) {
+            readNextIdHeader(file);
+        }
+        if (journalMatches(journal, file.size() == 0 ? 0 : snapshotGeneration(file))) {
+            reserveJournalIds(journal);
+        }
+        return nextTaskId;
+    }
+
+    // The latest version of one task: its journal record if it has one,
+    // otherwise its snapshot record found through the id index. Returns
+    // nullptr when the task does not exist.
+    std::unique_ptr<Task> findTask(int taskId) const override {
+        CommandStats::Scope phase(CommandStats::Load);
+        MappedFile file(filename);
+        MappedFile journal(journalFilename);
+        attachJournal(file, journal);
+
+        TaskStore overlay;
+        std::unordered_set<int> removedIds;
+        readJournalOverlay(overlay, removedIds, generation);
+        size_t slot = overlay.find(taskId);
+        if (slot != TaskStore::npos) {
+            return std::make_unique<Task>(overlay.toTask(slot));
+        }
+        if (removedIds.count(taskId) != 0) {
+            return nullptr;
+        }
+
+        std::uint64_t position = locateInSnapshot(file, taskId);
+        if (position == kNotInSnapshot) {
+            return nullptr;
+        }
+        TaskFields fields;
+        if (!readSnapshotRecord(file, position, fields) || fields.id != taskId) {
+            return nullptr;
+        }
+        return std::make_unique<Task>(Task::fromFields(fields));
+    }
+
+    TaskStore loadTasks() const override {
+        CommandStats::Scope phase(CommandStats::Load);
+        TaskStore tasks;
+        MappedFile file(filename);
+        nextTaskId = 1;
+        generation = snapshotGeneration(file);
+        snapshotIdentity = file.identity();
+
+        MalformedLines malformed;
+        {
+            CommandStats::Scope parsePhase(CommandStats::Parse);
+            if (isBinary(file)) {
+                loadBinary(file, tasks);
+            } else if (chunkCountFor(file.size()) > 1) {
+                loadTextParallel(file, tasks, malformed);
+            } else {
+                file.forEachLine([&](const char* begin, const char* end) {
+                    if (*begin == '#') {
+                        parseTextHeader(begin, end);
+                        return;
+                    }
+                    TaskFields fields;
+                    if (Task::parseFileLine(begin, end, fields)) {
+                        reserveId(fields.id);
+                        tasks.put(fields);
+                    } else {
+                        malformed.add(static_cast<size_t>(begin - file.data()));
+                    }
+                });
+            }
+        }
+        if (malformed.count > 0) {
+            size_t line = 1 + static_cast<size_t>(
+                std::count(file.data(), file.data() + malformed.firstOffset, '\n'));
+            std::cerr << "Warning: Skipped " << malformed.count << " malformed line(s) in "
+                      << filename << " (first at line " << line << ")." << std::endl;
+        }
+
+        MappedFile journal(journalFilename);
+        journalSize = 0;
+        journalStale = !replayJournal(tasks, journal, 0);
+        CommandStats::current().setTaskCount(tasks.size());
+        return tasks;
+    }
+
+    // Streams the records selected by `filter` to visit(const TaskFields&)
+    // in list order without materializing the store. The predicate runs on
+    // the status and created columns first, and the scan stops once the
+    // page is full. Pending journal records are overlaid on the snapshot.
+    void scanTasks(const TaskFilter& filter,
+                   const std::function<void(const TaskFields&)>& visit) const override {
+        if (filter.order != TaskFilter::Order::Stored) {
+            scanSorted(filter, visit);
+            return;
+        }
+        CommandStats::Scope phase(CommandStats::Scan);
+        size_t examined = 0;
+        // The snapshot is mapped before the journal is read; if a writer
+        // compacts in between, the journal's generation no longer matches
+        // and the older snapshot is shown without it.
+        MappedFile file(filename);
+        TaskStore overlay;
+        std::unordered_set<int> removedIds;
+        readJournalOverlay(overlay, removedIds, snapshotGeneration(file));
+        std::vector<bool> overlayShown(overlay.slotCount(), false);
+        FilterCursor cursor(filter);
+
+        auto offer = [&](const TaskFields& fields) {
+            if (cursor.accept(fields.id, fields.completed, fields.createdAt)) {
+                visit(fields);
+            }
+            return !cursor.isDone();
+        };
+        auto isOverlaid = [&](int taskId) {
+            return (!overlay.empty() && overlay.find(taskId) != TaskStore::npos) ||
+                   (!removedIds.empty() && removedIds.count(taskId) != 0);
+        };
+        auto offerSnapshot = [&](const TaskFields& fields) {
+            ++examined;
+            if (!isOverlaid(fields.id)) {
+                return offer(fields);
+            }
+            size_t slot = overlay.find(fields.id);
+            if (slot == TaskStore::npos) {
+                return true; // removed by the journal
+            }
+            overlayShown[slot] = true;
+            return offer(overlay.fieldsAt(slot));
+        };
+
+        if (isBinary(file)) {
+            BinaryColumns columns = openBinary(file);
+            for (size_t row = 0; row < columns.count && !cursor.isDone(); ++row) {
+                if (ioMode == IoMode::Pipelined) {
+                    columns.readAhead(file, row);
+                }
+                int taskId = columns.id(row);
+                if (filter.matches(taskId, columns.completed(row), columns.createdAt(row)) ||
+                    isOverlaid(taskId)) {
+                    offerSnapshot(columns.fields(row));
+                }
+            }
+        } else if (filter.limit == TaskFilter::kUnlimited && chunkCountFor(file.size()) > 1) {
+            // Parses the next round of chunks while the current one is
+            // offered, so output never waits on a whole-file parse. Paged
+            // scans stay sequential to stop as early as possible.
+            size_t chunkCount = chunkCountFor(file.size());
+            size_t roundBytes = chunkCount * kParallelChunkBytes;
+            size_t position = 0;
+            auto startRound = [&]() {
+                size_t end = lineBoundary(file, position + roundBytes);
+                auto round = startTextChunks(file, position, end, chunkCount);
+                position = end;
+                return round;
+            };
+            auto round = startRound();
+            while (!round.empty()) {
+                auto next = position < file.size() ? startRound() : decltype(round)();
+                for (auto& chunk : round) {
+                    for (const auto& fields : chunk.get().records) {
+                        offerSnapshot(fields);
+                    }
+                }
+                round = std::move(next);
+            }
+        } else {
+            ReadAhead ahead(file, 0, file.size(), ioMode == IoMode::Pipelined);
+            file.scanLines([&](const char* begin, const char* end) {
+                TaskFields fields;
+                ahead.advance(static_cast<size_t>(begin - file.data()));
+                if (*begin == '#' || !Task::parseFileLine(begin, end, fields)) {
+                    return true;
+                }
+                return offerSnapshot(fields);
+            });
+        }
+
+        for (size_t slot = 0; slot < overlay.slotCount() && !cursor.isDone(); ++slot) {
+            if (!overlayShown[slot] && !overlay.isRemoved(slot)) {
+                offer(overlay.fieldsAt(slot));
+            }
+        }
+        CommandStats::current().setTaskCount(examined);
+    }
+
+    // scanTasks in filter.order: walks the snapshot's order index and
+    // merges in the (few) journal records, sorted on the spot. Only the
+    // records walked are read, so a page of the top k stops after k matches.
+    void scanSorted(const TaskFilter& filter,
+                    const std::function<void(const TaskFields&)>& visit) const {
+        CommandStats::Scope phase(CommandStats::Scan);
+        MappedFile file(filename);
+        std::uint64_t snapshotGen = snapshotGeneration(file);
+        TaskStore overlay;
+        std::unordered_set<int> removedIds;
+        readJournalOverlay(overlay, removedIds, snapshotGen);
+
+        auto overlayKey = [&](size_t slot) {
+            return TaskFilter::sortKey(filter.order, overlay.id(slot), overlay.createdAt(slot),
+                                       overlay.completedAt(slot));
+        };
+        std::vector<size_t> journalSlots;
+        for (size_t slot = 0; slot < overlay.slotCount(); ++slot) {
+            if (!overlay.isRemoved(slot)) {
+                journalSlots.push_back(slot);
+            }
+        }
+        std::sort(journalSlots.begin(), journalSlots.end(),
+                  [&](size_t a, size_t b) { return overlayKey(a) < overlayKey(b); });
+
+        if (file.size() > 0 && !orderIndexMatches(file, snapshotGen)) {
+            buildOrderIndex(file, snapshotGen);
+        }
+        MappedFile index(orderIndexFilename);
+        const char* positions = nullptr;
+        std::uint64_t count = 0;
+        if (file.size() > 0) {
+            if (!sidecarMatches(index, file, "TODS", kOrderIndexEntryBytes, snapshotGen)) {
+                throw std::runtime_error("Unable to build order index: " + orderIndexFilename);
+            }
+            std::memcpy(&count, index.data() + kSidecarHeaderSize - sizeof(count), sizeof(count));
+            size_t column = static_cast<size_t>(filter.order) - 1;
+            positions = index.data() + kSidecarHeaderSize + column * count * sizeof(std::uint64_t);
+        }
+
+        FilterCursor cursor(filter);
+        auto offer = [&](const TaskFields& fields) {
+            if (cursor.accept(fields.id, fields.completed, fields.createdAt)) {
+                visit(fields);
+            }
+        };
+        size_t examined = 0;
+        size_t row = 0;
+        size_t nextJournal = 0;
+        TaskFields snapshotFields;
+        bool haveSnapshot = false;
+        bool stale = false; // a position the sidecar was not built with
+        while (!cursor.isDone()) {
+            while (!haveSnapshot && row < count) {
+                std::uint64_t position = readColumnValue<std::uint64_t>(positions, row++);
+                ++examined;
+                if (!readSnapshotRecord(file, position, snapshotFields)) {
+                    stale = true;
+                    continue;
+                }
+                haveSnapshot = overlay.find(snapshotFields.id) == TaskStore::npos &&
+                               removedIds.count(snapshotFields.id) == 0;
+            }
+            bool journalFirst = nextJournal < journalSlots.size() &&
+                (!haveSnapshot ||
+                 overlayKey(journalSlots[nextJournal]) <
+                     TaskFilter::sortKey(filter.order, snapshotFields.id, snapshotFields.createdAt,
+                                         snapshotFields.completedAt));
+            if (journalFirst) {
+                offer(overlay.fieldsAt(journalSlots[nextJournal++]));
+            } else if (haveSnapshot) {
+                haveSnapshot = false;
+                offer(snapshotFields);
+            } else {
+                break;
+            }
+        }
+        if (stale) {
+            std::remove(orderIndexFilename.c_str()); // the next sorted listing rebuilds it
+        }
+        CommandStats::current().setTaskCount(examined);
+    }
+
+    // Writes a full snapshot of the next generation and renames it over the
+    // old one; the journal is folded into it and removed. Callers hold the
+    // write lock.
+    bool saveTasks(const TaskStore& tasks) const override {
+        return saveSlots(tasks, nullptr);
+    }
+
+    // saveTasks for a ShardedStorage shard: only the (live) `slots` of
+    // `tasks` make up the snapshot.
+    bool saveSlots(const TaskStore& tasks, const std::vector<size_t>* slots) const {
+        CommandStats::Scope phase(CommandStats::Save);
+        const std::string temporaryFilename = filename + ".tmp";
+        WriteBehindFile output;
+        if (!output.open(temporaryFilename, ioMode == IoMode::Pipelined,
+                         durability != Durability::None)) {
+            std::cerr << "Error: Unable to save tasks to file." << std::endl;
+            return false;
+        }
+
+        generation += 1;
+        std::ostream file(&output);
+        if (format == StorageFormat::Binary) {
+            writeBinary(file, tasks, slots);
+        } else {
+            writeText(file, tasks, slots);
+        }
+        bool written = file.flush() && output.close();
+        if (written) {
+            CommandStats::current().addBytesWritten(output.size());
+        }
+
+        // The data must be durable before the rename makes it the store,
+        // and the rename before the journal it replaces is removed.
+        bool synced = durability == Durability::None || syncFile(temporaryFilename);
+        if (!written || !synced || !replaceFile(temporaryFilename, filename)) {
+            std::remove(temporaryFilename.c_str());
+            generation -= 1;
+            std::cerr << "Error: Unable to save tasks to file." << std::endl;
+            return false;
+        }
+        if (durability != Durability::None) {
+            syncParentDirectory(filename);
+        }
+        snapshotIdentity = FileIdentity::of(filename);
+        clearJournal();
+        // Keeps sorted listings fast once someone has used them. An emptied
+        // sidecar (see completeInPlace) still counts as in use.
+        if (FileIdentity::of(orderIndexFilename) != FileIdentity()) {
+            buildOrderIndex(MappedFile(filename), generation);
+        }
+        return true;
+    }
+
+    // Each record* call persists a single mutation. In journal mode this is
+    // one appended line; the store is compacted once the journal grows past
+    // the threshold (or always rewritten when journaling is disabled).
+    // `tasks` is the caller's up-to-date store, or nullptr when the store is
+    // not loaded (after prepareAppend or findTask); it is then loaded only
+    // if the journal needs compacting.
+    bool recordAdded(const Task& task, const TaskStore* tasks) const override {
+        return recordChange('A', task.toJournalString(), tasks);
+    }
+
+    bool recordCompleted(const Task& task, const TaskStore* tasks) const override {
+        return completeInPlace(task) || recordChange('C', task.toJournalString(), tasks);
+    }
+
+    bool recordRemoved(int taskId, const TaskStore* tasks) const override {
+        return recordChange('R', std::to_string(taskId), tasks);
+    }
+
+    void removeFiles() const override {
+        for (const std::string* path : {&filename, &journalFilename, &idIndexFilename,
+                                        &orderIndexFilename, &lockFilename}) {
+            std::remove(path->c_str());
+        }
+    }
+
+    // True when a store has been written at `file`. Until the journal
+    // first compacts there is no snapshot yet, only the journal, the lock
+    // file and the id sidecar.
+    static bool hasFiles(const std::string& file) {
+        for (const char* suffix : {"", ".journal", ".lock", ".ids"}) {
+            if (std::ifstream(file + suffix).is_open()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    // Text snapshots start with comment lines carrying the id counter and
+    // the generation; older readers skip them as malformed task lines.
+    static constexpr const char* kNextIdPrefix = "#next-id=";
+    static constexpr const char* kGenerationPrefix = "#generation=";
+
+    static bool parseHeaderValue(const char* begin, const char* end, const char* prefix,
+                                 std::uint64_t& value) {
+        size_t prefixLength = std::strlen(prefix);
+        if (static_cast<size_t>(end - begin) <= prefixLength ||
+            std::memcmp(begin, prefix, prefixLength) != 0) {
+            return false;
+        }
+        std::uint64_t parsed = 0;
+        for (const char* it = begin + prefixLength; it != end; ++it) {
+            if (*it < '0' || *it > '9') {
+                return false;
+            }
+            parsed = parsed * 10 + static_cast<std::uint64_t>(*it - '0');
+        }
+        value = parsed;
+        return true;
+    }
+
+    // Whether the snapshot header persists the id counter; sets it if so.
+    bool readNextIdHeader(const MappedFile& file) const {
+        if (isBinary(file)) {
+            std::uint32_t version = 0;
+            std::memcpy(&version, file.data() + 4, sizeof(version));
+            if (version < 2) {
+                return false;
+            }
+            openBinary(file); // adopts the header's nextId
+            return true;
+        }
+        bool found = false;
+        file.scanLines([this, &found](const char* begin, const char* end) {
+            std::uint64_t value = 0;
+            if (*begin != '#') {
+                return false;
+            }
+            if (parseHeaderValue(begin, end, kNextIdPrefix, value)) {
+                found = true;
+                parseTextHeader(begin, end);
+            }
+            return true;
+        });
+        return found;
+    }
+
+    // Reserves the ids of the journal's add and completion records.
+    void reserveJournalIds(const MappedFile& journal) const {
+        journal.forEachLine([this](const char* begin, const char* end) {
+            const char* bar = (end - begin > 2)
+                ? static_cast<const char*>(std::memchr(begin + 2, '|', end - begin - 2)) : nullptr;
+            int taskId = 0;
+            if ((begin[0] == 'A' || begin[0] == 'C') && begin[1] == '|' && bar &&
+                parseTaskId(begin + 2, bar, taskId)) {
+                reserveId(taskId);
+            }
+        }, 0, journal.terminatedSize());
+    }
+
+    // Adopts the snapshot's generation and the journal's replayable length,
+    // as loadTasks does, so records can be appended without a load.
+    void attachJournal(const MappedFile& file, const MappedFile& journal) const {
+        generation = snapshotGeneration(file);
+        snapshotIdentity = file.identity();
+        journalStale = journal.size() > 0 && !journalMatches(journal, generation);
+        journalSize = journalStale ? 0 : static_cast<std::streamoff>(journal.terminatedSize());
+    }
+
+    // Sidecar index from task id to the start of its line (text) or its row
+    // (binary) in the current snapshot, sorted by id:
+    //   char magic[4] "TODI", uint32 version, uint64 generation,
+    //   uint64 snapshotSize, uint64 count, int32 id[count], uint64 position[count]
+    // It is built on first use after each snapshot by reading only the ids,
+    // and is ignored once the snapshot's generation or size changes.
+    static constexpr std::uint64_t kNotInSnapshot = UINT64_MAX;
+    static constexpr size_t kSidecarHeaderSize = 4 + sizeof(std::uint32_t) + 3 * sizeof(std::uint64_t);
+    static constexpr size_t kIdIndexEntryBytes = sizeof(std::int32_t) + sizeof(std::uint64_t);
+
+    // A sidecar whose position lies past the snapshot or at another task's
+    // record is stale, like one from an older snapshot, and is rebuilt.
+    std::uint64_t locateInSnapshot(const MappedFile& file, int taskId) const {
+        if (file.size() == 0) {
+            return kNotInSnapshot;
+        }
+        {
+            MappedFile index(idIndexFilename);
+            if (sidecarMatches(index, file, "TODI", kIdIndexEntryBytes, generation)) {
+                std::uint64_t position = locateInSnapshot(file, taskId, index);
+                if (position == kNotInSnapshot || holdsTask(file, position, taskId)) {
+                    return position;
+                }
+            }
+        }
+        buildIdIndex(file);
+        std::uint64_t position = locateInSnapshot(file, taskId, MappedFile(idIndexFilename));
+        return position != kNotInSnapshot && holdsTask(file, position, taskId) ? position
+                                                                               : kNotInSnapshot;
+    }
+
+    // True when the row (binary) or the line starting at `position` (text)
+    // is in the snapshot and holds `taskId`.
+    bool holdsTask(const MappedFile& file, std::uint64_t position, int taskId) const {
+        if (isBinary(file)) {
+            BinaryColumns columns = openBinary(file);
+            return position < columns.count && columns.id(static_cast<size_t>(position)) == taskId;
+        }
+        if (position >= file.size() || (position > 0 && file.data()[position - 1] != '\n')) {
+            return false;
+        }
+        const char* begin = file.data() + position;
+        const char* bar = static_cast<const char*>(std::memchr(begin, '|', file.size() - position));
+        int id = 0;
+        return bar && parseTaskId(begin, bar, id) && id == taskId;
+    }
+
+    std::uint64_t locateInSnapshot(const MappedFile& file, int taskId, const MappedFile& index) const {
+        if (!sidecarMatches(index, file, "TODI", kIdIndexEntryBytes, generation)) {
+            throw std::runtime_error("Unable to build id index: " + idIndexFilename);
+        }
+        std::uint64_t count = 0;
+        std::memcpy(&count, index.data() + kSidecarHeaderSize - sizeof(count), sizeof(count));
+        const char* ids = index.data() + kSidecarHeaderSize;
+        const char* positions = ids + count * sizeof(std::int32_t);
+
+        size_t low = 0;
+        size_t high = static_cast<size_t>(count);
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            std::int32_t id = readColumnValue<std::int32_t>(ids, mid);
+            if (id == taskId) {
+                return readColumnValue<std::uint64_t>(positions, mid);
+            }
+            if (id < taskId) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return kNotInSnapshot;
+    }
+
+    // Both sidecars share one header: magic, version 1, then the snapshot
+    // generation and size they were built from and their entry count.
+    static bool sidecarMatches(const MappedFile& index, const MappedFile& file, const char* magic,
+                               size_t entryBytes, std::uint64_t snapshotGen) {
+        if (index.size() < kSidecarHeaderSize || std::memcmp(index.data(), magic, 4) != 0) {
+            return false;
+        }
+        std::uint32_t version = 0;
+        std::uint64_t header[3];
+        std::memcpy(&version, index.data() + 4, sizeof(version));
+        std::memcpy(header, index.data() + 8, sizeof(header));
+        return version == 1 && header[0] == snapshotGen && header[1] == file.size() &&
+               header[2] <= (index.size() - kSidecarHeaderSize) / entryBytes &&
+               index.size() - kSidecarHeaderSize == header[2] * entryBytes;
+    }
+
+    static void writeSidecarHeader(std::ofstream& index, const char* magic, std::uint64_t snapshotGen,
+                                   const MappedFile& file, size_t count) {
+        std::uint32_t version = 1;
+        std::uint64_t header[3] = {snapshotGen, file.size(), count};
+        index.write(magic, 4);
+        index.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        index.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    // The record at a sidecar position: a line offset (text) or a row
+    // (binary). False if the position lies past the snapshot or the line
+    // does not parse.
+    bool readSnapshotRecord(const MappedFile& file, std::uint64_t position, TaskFields& fields) const {
+        if (isBinary(file)) {
+            BinaryColumns columns = openBinary(file);
+            if (position >= columns.count) {
+                return false;
+            }
+            fields = columns.fields(static_cast<size_t>(position));
+            return true;
+        }
+        if (position >= file.size()) {
+            return false;
+        }
+        const char* begin = file.data() + position;
+        const void* newline = std::memchr(begin, '\n', file.size() - position);
+        const char* end = newline ? static_cast<const char*>(newline) : file.data() + file.size();
+        return Task::parseFileLine(begin, end, fields);
+    }
+
+    void buildIdIndex(const MappedFile& file) const {
+        std::vector<std::pair<std::int32_t, std::uint64_t>> entries;
+        if (isBinary(file)) {
+            BinaryColumns columns = openBinary(file);
+            entries.reserve(columns.count);
+            for (size_t row = 0; row < columns.count; ++row) {
+                entries.emplace_back(columns.id(row), row);
+            }
+        } else {
+            file.forEachLine([&](const char* begin, const char* end) {
+                const char* bar = static_cast<const char*>(std::memchr(begin, '|', end - begin));
+                int taskId = 0;
+                if (*begin != '#' && bar && parseTaskId(begin, bar, taskId)) {
+                    entries.emplace_back(taskId, static_cast<std::uint64_t>(begin - file.data()));
+                }
+            });
+        }
+
+        // A later record for the same id replaces an earlier one, as on load.
+        std::stable_sort(entries.begin(), entries.end(),
+                         [](const std::pair<std::int32_t, std::uint64_t>& a,
+                            const std::pair<std::int32_t, std::uint64_t>& b) {
+                             return a.first < b.first;
+                         });
+        std::vector<std::int32_t> ids;
+        std::vector<std::uint64_t> positions;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (i + 1 < entries.size() && entries[i + 1].first == entries[i].first) {
+                continue;
+            }
+            ids.push_back(entries[i].first);
+            positions.push_back(entries[i].second);
+        }
+
+        const std::string temporaryFilename = idIndexFilename + ".tmp";
+        std::ofstream index(temporaryFilename, std::ios::binary | std::ios::trunc);
+        writeSidecarHeader(index, "TODI", generation, file, ids.size());
+        writeColumn(index, ids);
+        writeColumn(index, positions);
+        index.close();
+        if (!index || !replaceFile(temporaryFilename, idIndexFilename)) {
+            std::remove(temporaryFilename.c_str());
+        }
+    }
+
+    // Sidecar with the snapshot's positions in each sort order, for
+    // list --sort:
+    //   char magic[4] "TODS", uint32 version, uint64 generation,
+    //   uint64 snapshotSize, uint64 count, uint64 byId[count],
+    //   uint64 byCreated[count], uint64 byCompleted[count]
+    // It is built by the first sorted listing after a snapshot changes and
+    // then rewritten with every snapshot while it exists.
+    static constexpr size_t kOrderIndexEntryBytes = 3 * sizeof(std::uint64_t);
+
+    bool orderIndexMatches(const MappedFile& file, std::uint64_t snapshotGen) const {
+        MappedFile index(orderIndexFilename);
+        return sidecarMatches(index, file, "TODS", kOrderIndexEntryBytes, snapshotGen);
+    }
+
+    void buildOrderIndex(const MappedFile& file, std::uint64_t snapshotGen) const {
+        CommandStats::Scope phase(CommandStats::Index);
+        struct Entry {
+            int id;
+            std::int64_t createdAt;
+            std::int64_t completedAt;
+            std::uint64_t position;
+        };
+        std::vector<Entry> entries;
+        if (isBinary(file)) {
+            BinaryColumns columns = openBinary(file);
+            entries.reserve(columns.count);
+            for (size_t row = 0; row < columns.count; ++row) {
+                entries.push_back(Entry{columns.id(row), columns.createdAt(row),
+                                        columns.completedAt(row), row});
+            }
+        } else {
+            file.forEachLine([&](const char* begin, const char* end) {
+                TaskFields fields;
+                if (*begin != '#' && Task::parseFileLine(begin, end, fields)) {
+                    entries.push_back(Entry{fields.id, fields.createdAt, fields.completedAt,
+                                            static_cast<std::uint64_t>(begin - file.data())});
+                }
+            });
+        }
+
+        // A later record for the same id replaces an earlier one, as on load.
+        // Snapshots are normally written in id order already.
+        auto byId = [](const Entry& a, const Entry& b) { return a.id < b.id; };
+        if (!std::is_sorted(entries.begin(), entries.end(), byId)) {
+            std::stable_sort(entries.begin(), entries.end(), byId);
+        }
+        std::vector<Entry> unique;
+        unique.reserve(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (i + 1 == entries.size() || entries[i + 1].id != entries[i].id) {
+                unique.push_back(entries[i]);
+            }
+        }
+
+        const std::string temporaryFilename = orderIndexFilename + ".tmp";
+        std::ofstream index(temporaryFilename, std::ios::binary | std::ios::trunc);
+        writeSidecarHeader(index, "TODS", snapshotGen, file, unique.size());
+        const TaskFilter::Order orders[] = {TaskFilter::Order::Id, TaskFilter::Order::Created,
+                                            TaskFilter::Order::Completed};
+        std::vector<std::uint64_t> positions(unique.size());
+        for (TaskFilter::Order order : orders) {
+            std::vector<std::pair<std::pair<std::int64_t, int>, std::uint64_t>> keyed;
+            keyed.reserve(unique.size());
+            for (const Entry& entry : unique) {
+                keyed.emplace_back(TaskFilter::sortKey(order, entry.id, entry.createdAt,
+                                                       entry.completedAt),
+                                   entry.position);
+            }
+            if (!std::is_sorted(keyed.begin(), keyed.end())) {
+                std::sort(keyed.begin(), keyed.end());
+            }
+            for (size_t i = 0; i < keyed.size(); ++i) {
+                positions[i] = keyed[i].second;
+            }
+            writeColumn(index, positions);
+        }
+        index.close();
+        if (!index || !replaceFile(temporaryFilename, orderIndexFilename)) {
+            std::remove(temporaryFilename.c_str());
+        }
+    }
+
+    // Snapshots written before generations were introduced are generation 0.
+    std::uint64_t snapshotGeneration(const MappedFile& file) const {
+        if (isBinary(file)) {
+            return openBinary(file).generation;
+        }
+        std::uint64_t value = 0;
+        file.scanLines([&value](const char* begin, const char* end) {
+            if (*begin != '#') {
+                return false;
+            }
+            parseHeaderValue(begin, end, kGenerationPrefix, value);
+            return true;
+        });
+        return value;
+    }
+
+    void parseTextHeader(const char* begin, const char* end) const {
+        size_t prefixLength = std::strlen(kNextIdPrefix);
+        int value = 0;
+        if (static_cast<size_t>(end - begin) > prefixLength &&
+            std::memcmp(begin, kNextIdPrefix, prefixLength) == 0 &&
+            parseTaskId(begin + prefixLength, end, value) && value > nextTaskId) {
+            nextTaskId = value;
+        }
+    }
+
+    static bool isBinary(const MappedFile& file) {
+        return file.size() >= 4 && std::memcmp(file.data(), "TODB", 4) == 0;
+    }
+
+    static StorageFormat detectFormat(const std::string& path) {
+        MappedFile file(path);
+        return isBinary(file) ? StorageFormat::Binary : StorageFormat::Text;
+    }
+
+    // Validated column pointers into a mapped binary snapshot.
+    struct BinaryColumns {
+        size_t count;
+        std::uint64_t heapSize;
+        const char* createdColumn;
+        const char* completedColumn;
+        const char* idColumn;
+        const char* offsetColumn;
+        const char* statusColumn;
+        const char* heap;
+        std::uint64_t generation;
+
+        int id(size_t row) const { return readColumnValue<std::int32_t>(idColumn, row); }
+        bool completed(size_t row) const { return statusColumn[row] != 0; }
+        std::int64_t createdAt(size_t row) const {
+            return readColumnValue<std::int64_t>(createdColumn, row);
+        }
+        std::int64_t completedAt(size_t row) const {
+            return readColumnValue<std::int64_t>(completedColumn, row);
+        }
+
+        // Starts reading the rows of the block after `row`'s, once `row`
+        // enters a new block of kReadAheadRows, and of its own block on the
+        // first; for walks from row 0 up. The columns are interleaved
+        // streams, so the kernel's sequential read-ahead does not see them.
+        void readAhead(const MappedFile& file, size_t row) const {
+            if (row % kReadAheadRows != 0) {
+                return;
+            }
+            if (row == 0) {
+                willNeed(file, 0, kReadAheadRows);
+            }
+            willNeed(file, row + kReadAheadRows, row + 2 * kReadAheadRows);
+        }
+
+        void willNeed(const MappedFile& file, size_t from, size_t to) const {
+            to = std::min(to, count);
+            if (from >= to) {
+                return;
+            }
+            auto rows = [&](const char* column, size_t width) {
+                file.willNeed(static_cast<size_t>(column - file.data()) + from * width,
+                              static_cast<size_t>(column - file.data()) + to * width);
+            };
+            rows(createdColumn, sizeof(std::int64_t));
+            rows(completedColumn, sizeof(std::int64_t));
+            rows(idColumn, sizeof(std::int32_t));
+            rows(offsetColumn, sizeof(std::uint64_t));
+            rows(statusColumn, 1);
+            std::uint64_t heapBegin = std::min(readColumnValue<std::uint64_t>(offsetColumn, from), heapSize);
+            std::uint64_t heapEnd = std::min(readColumnValue<std::uint64_t>(offsetColumn, to), heapSize);
+            file.willNeed(static_cast<size_t>(heap - file.data() + heapBegin),
+                          static_cast<size_t>(heap - file.data() + heapEnd));
+        }
+
+        TaskFields fields(size_t row) const {
+            std::uint64_t descBegin = readColumnValue<std::uint64_t>(offsetColumn, row);
+            std::uint64_t descEnd = readColumnValue<std::uint64_t>(offsetColumn, row + 1);
+            if (descBegin > descEnd || descEnd > heapSize) {
+                throw std::runtime_error("Corrupt binary task file: description out of range");
+            }
+            TaskFields result;
+            result.id = id(row);
+            result.description = StringRef(heap + descBegin, heap + descEnd);
+            result.completed = completed(row);
+            result.createdAt = createdAt(row);
+            result.completedAt = completedAt(row);
+            return result;
+        }
+    };
+
+    BinaryColumns openBinary(const MappedFile& file) const {
+        BinaryHeader header = {};
+        if (file.size() < kBinaryHeaderV1Size) {
+            throw std::runtime_error("Corrupt binary task file: " + filename);
+        }
+        std::memcpy(&header, file.data(), kBinaryHeaderV1Size);
+
+        size_t headerSize = kBinaryHeaderV1Size;
+        if (header.version == 2) {
+            headerSize = kBinaryHeaderV2Size;
+        } else if (header.version == kBinaryVersion) {
+            headerSize = sizeof(header);
+        } else if (header.version != 1) {
+            throw std::runtime_error("Unsupported binary task file version in " + filename);
+        }
+        if (file.size() < headerSize) {
+            throw std::runtime_error("Corrupt binary task file: " + filename);
+        }
+        std::memcpy(&header, file.data(), headerSize);
+        if (header.nextId <= INT_MAX && static_cast<int>(header.nextId) > nextTaskId) {
+            nextTaskId = static_cast<int>(header.nextId);
+        }
+
+        const std::uint64_t count = header.count;
+        const std::uint64_t rowBytes = 2 * sizeof(std::int64_t) + sizeof(std::int32_t) +
+                                       sizeof(std::uint64_t) + sizeof(std::uint8_t);
+        // Compared by subtraction, so a huge count or heap size cannot wrap
+        // around to the file size.
+        const std::uint64_t available = file.size() - headerSize;
+        if (count > available / rowBytes ||
+            available - count * rowBytes < sizeof(std::uint64_t) ||
+            header.heapSize != available - count * rowBytes - sizeof(std::uint64_t)) {
+            throw std::runtime_error("Corrupt binary task file: " + filename);
+        }
+
+        BinaryColumns columns;
+        columns.count = static_cast<size_t>(count);
+        columns.heapSize = header.heapSize;
+        columns.createdColumn = file.data() + headerSize;
+        columns.completedColumn = columns.createdColumn + count * sizeof(std::int64_t);
+        columns.idColumn = columns.completedColumn + count * sizeof(std::int64_t);
+        columns.offsetColumn = columns.idColumn + count * sizeof(std::int32_t);
+        columns.statusColumn = columns.offsetColumn + (count + 1) * sizeof(std::uint64_t);
+        columns.heap = columns.statusColumn + count;
+        columns.generation = header.generation;
+        return columns;
+    }
+
+    size_t chunkCountFor(size_t bytes) const {
+        return std::max<size_t>(std::min(parseThreads, bytes / kParallelChunkBytes), 1);
+    }
+
+    // Start of the line following `position`, or the end of the file.
+    static size_t lineBoundary(const MappedFile& file, size_t position) {
+        if (position >= file.size()) {
+            return file.size();
+        }
+        const void* newline = std::memchr(file.data() + position, '\n', file.size() - position);
+        return newline ? static_cast<const char*>(newline) - file.data() + 1 : file.size();
+    }
+
+    // Splits [from, to) at line boundaries into up to `chunkCount` chunks and
+    // parses each on its own thread. The futures are in file order and the
+    // parsed descriptions point into the mapping.
+    // Task lines that failed to parse, counted so loads can report them
+    // instead of dropping them silently.
+    struct MalformedLines {
+        size_t count;
+        size_t firstOffset;
+
+        MalformedLines() : count(0), firstOffset(0) {}
+
+        void add(size_t offset) {
+            if (count++ == 0) {
+                firstOffset = offset;
+            }
+        }
+
+        void merge(const MalformedLines& later) {
+            if (later.count > 0) {
+                add(later.firstOffset);
+                count += later.count - 1;
+            }
+        }
+    };
+
+    struct ParsedChunk {
+        std::vector<TaskFields> records;
+        MalformedLines malformed;
+    };
+
+    std::vector<std::future<ParsedChunk>> startTextChunks(
+        const MappedFile& file, size_t from, size_t to, size_t chunkCount) const {
+        const bool readAhead = ioMode == IoMode::Pipelined;
+        std::vector<std::future<ParsedChunk>> chunks;
+        size_t begin = from;
+        for (size_t chunk = 1; chunk <= chunkCount && begin < to; ++chunk) {
+            size_t end = (chunk == chunkCount)
+                             ? to
+                             : std::min(lineBoundary(file, from + (to - from) * chunk / chunkCount), to);
+            chunks.push_back(std::async(std::launch::async, [&file, begin, end, readAhead]() {
+                ParsedChunk parsed;
+                ReadAhead ahead(file, begin, end, readAhead);
+                file.forEachLine([&](const char* lineBegin, const char* lineEnd) {
+                    TaskFields fields;
+                    ahead.advance(static_cast<size_t>(lineBegin - file.data()));
+                    if (*lineBegin == '#') {
+                        return;
+                    }
+                    if (Task::parseFileLine(lineBegin, lineEnd, fields)) {
+                        parsed.records.push_back(fields);
+                    } else {
+                        parsed.malformed.add(static_cast<size_t>(lineBegin - file.data()));
+                    }
+                }, begin, end);
+                return parsed;
+            }));
+            begin = end;
+        }
+        return chunks;
+    }
+
+    // Parsing runs on the worker threads; records are then put into the
+    // store in file order, so duplicate ids resolve exactly as they do in a
+    // sequential load.
+    void loadTextParallel(const MappedFile& file, TaskStore& tasks, MalformedLines& malformed) const {
+        file.scanLines([this](const char* begin, const char* end) {
+            if (*begin != '#') {
+                return false;
+            }
+            parseTextHeader(begin, end);
+            return true;
+        });
+
+        auto chunks = startTextChunks(file, 0, file.size(), chunkCountFor(file.size()));
+        std::vector<ParsedChunk> parsed;
+        size_t taskCount = 0;
+        size_t descriptionBytes = 0;
+        for (auto& chunk : chunks) {
+            parsed.push_back(chunk.get());
+            malformed.merge(parsed.back().malformed);
+            taskCount += parsed.back().records.size();
+            for (const auto& fields : parsed.back().records) {
+                descriptionBytes += fields.description.size();
+            }
+        }
+
+        tasks.reserve(taskCount, descriptionBytes);
+        for (const auto& chunk : parsed) {
+            for (const auto& fields : chunk.records) {
+                reserveId(fields.id);
+                tasks.put(fields);
+            }
+        }
+    }
+
+    void loadBinary(const MappedFile& file, TaskStore& tasks) const {
+        BinaryColumns columns = openBinary(file);
+        tasks.reserve(columns.count, columns.heapSize);
+        for (size_t row = 0; row < columns.count; ++row) {
+            if (ioMode == IoMode::Pipelined) {
+                columns.readAhead(file, row);
+            }
+            TaskFields fields = columns.fields(row);
+            reserveId(fields.id);
+            tasks.put(fields);
+        }
+    }
+
+    // Calls write(slot) for each live slot of `tasks`, or each of `slots`.
+    template <typename Write>
+    static void forEachSavedSlot(const TaskStore& tasks, const std::vector<size_t>* slots,
+                                 Write write) {
+        if (slots) {
+            for (size_t slot : *slots) {
+                write(slot);
+            }
+            return;
+        }
+        for (size_t slot = 0; slot < tasks.slotCount(); ++slot) {
+            if (!tasks.isRemoved(slot)) {
+                write(slot);
+            }
+        }
+    }
+
+    void writeText(std::ostream& file, const TaskStore& tasks,
+                   const std::vector<size_t>* slots) const {
+        ChunkedWriter writer(file);
+        char timestamp[32];
+
+        writer.append(StringRef(kNextIdPrefix))
+              .appendNumber(nextTaskId).append('\n');
+        writer.append(StringRef(kGenerationPrefix))
+              .appendNumber(static_cast<long long>(generation)).append('\n');
+        forEachSavedSlot(tasks, slots, [&](size_t slot) {
+            writer.appendNumber(tasks.id(slot)).append('|')
+                  .append(tasks.description(slot)).append('|')
+                  .append(tasks.isCompleted(slot) ? '1' : '0').append('|');
+            writer.append(timestamp, formatTimestamp(tasks.createdAt(slot), timestamp)).append('|');
+            writer.append(timestamp, formatTimestamp(tasks.completedAt(slot), timestamp)).append('\n');
+        });
+    }
+
+    // Streams one column at a time straight from `tasks` rather than
+    // copying the store into column vectors first, so each buffer is
+    // written while the next one is gathered.
+    void writeBinary(std::ostream& file, const TaskStore& tasks,
+                     const std::vector<size_t>* slots) const {
+        size_t count = 0;
+        std::uint64_t heapSize = 0;
+        forEachSavedSlot(tasks, slots, [&](size_t slot) {
+            ++count;
+            heapSize += tasks.description(slot).size();
+        });
+
+        BinaryHeader header;
+        std::memcpy(header.magic, "TODB", 4);
+        header.version = kBinaryVersion;
+        header.count = count;
+        header.heapSize = heapSize;
+        header.nextId = static_cast<std::uint64_t>(nextTaskId);
+        header.generation = generation;
+
+        ChunkedWriter writer(file);
+        auto appendValue = [&writer](auto value) {
+            writer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        appendValue(header);
+        forEachSavedSlot(tasks, slots, [&](size_t slot) {
+            appendValue(static_cast<std::int64_t>(tasks.createdAt(slot)));
+        });
+        forEachSavedSlot(tasks, slots, [&](size_t slot) {
+            appendValue(static_cast<std::int64_t>(tasks.completedAt(slot)));
+        });
+        forEachSavedSlot(tasks, slots, [&](size_t slot) {
+            appendValue(static_cast<std::int32_t>(tasks.id(slot)));
+        });
+        std::uint64_t offset = 0;
+        appendValue(offset);
+        forEachSavedSlot(tasks, slots, [&](size_t slot) {
+            offset += tasks.description(slot).size();
+            appendValue(offset);
+        });
+        forEachSavedSlot(tasks, slots, [&](size_t slot) {
+            appendValue(static_cast<std::uint8_t>(tasks.isCompleted(slot) ? 1 : 0));
+        });
+        forEachSavedSlot(tasks, slots, [&](size_t slot) {
+            writer.append(tasks.description(slot));
+        });
+    }
+
+    bool recordChange(char type, const std::string& payload, const TaskStore* tasks) const {
+        if (!journalEnabled) {
+            return tasks && saveTasks(*tasks);
+        }
+
+        if (!appendJournalRecord(type, payload)) {
+            return false;
+        }
+
+        if (journalSize >= compactionThreshold) {
+            // The record just appended is replayed by the load.
+            return tasks ? saveTasks(*tasks) : saveTasks(loadTasks());
+        }
+        return true;
+    }
+
+    // Binary snapshots keep the status and the completion time in
+    // fixed-width columns, so completing a task whose latest version is in
+    // the snapshot rewrites those 9 bytes with pwrite instead of growing the
+    // journal towards a full rewrite. The time is written before the status
+    // byte, so a torn update reads as still pending. Falls back to the
+    // journal for text snapshots, tasks with journal records and Windows.
+    bool completeInPlace(const Task& task) const {
+#ifndef _WIN32
+        MappedFile file(filename);
+        if (file.size() == 0 || !isBinary(file)) {
+            return false;
+        }
+        BinaryColumns columns = openBinary(file);
+        MappedFile journal(journalFilename);
+        if (columns.generation != generation ||
+            (journalMatches(journal, generation) && journalMentions(journal, task.getId()))) {
+            return false;
+        }
+        std::uint64_t row = locateInSnapshot(file, task.getId());
+        if (row == kNotInSnapshot || row >= columns.count) {
+            return false;
+        }
+
+        CommandStats::Scope phase(CommandStats::Save);
+        std::int64_t completedAt = task.getCompletedAt();
+        std::uint8_t status = 1;
+        off_t timeOffset = static_cast<off_t>(columns.completedColumn - file.data() +
+                                              row * sizeof(std::int64_t));
+        off_t statusOffset = static_cast<off_t>(columns.statusColumn - file.data() + row);
+        int fd = ::open(filename.c_str(), O_WRONLY);
+        if (fd < 0) {
+            return false;
+        }
+        bool written =
+            ::pwrite(fd, &completedAt, sizeof(completedAt), timeOffset) == sizeof(completedAt) &&
+            ::pwrite(fd, &status, sizeof(status), statusOffset) == sizeof(status) &&
+            (durability != Durability::Op || ::fsync(fd) == 0);
+        ::close(fd);
+        if (!written) {
+            // The journal record written instead supersedes a partial update.
+            return false;
+        }
+        CommandStats::current().addBytesWritten(sizeof(completedAt) + sizeof(status));
+        snapshotIdentity = FileIdentity::of(filename);
+        invalidateOrderIndex();
+        return true;
+#else
+        (void)task;
+        return false;
+#endif
+    }
+
+    // Whether the journal has an add or completion record for the task.
+    static bool journalMentions(const MappedFile& journal, int taskId) {
+        bool found = false;
+        journal.scanLines([&](const char* begin, const char* end) {
+            const char* bar = (end - begin > 2)
+                ? static_cast<const char*>(std::memchr(begin + 2, '|', end - begin - 2)) : nullptr;
+            int recordId = 0;
+            found = (begin[0] == 'A' || begin[0] == 'C') && begin[1] == '|' && bar &&
+                    parseTaskId(begin + 2, bar, recordId) && recordId == taskId;
+            return !found;
+        }, 0, journal.terminatedSize());
+        return found;
+    }
+
+    // An in-place completion changes the completed order without changing
+    // the snapshot's generation or size; the order sidecar is replaced by
+    // an empty file, which never matches, so the next sorted listing
+    // rebuilds it. Replaced rather than truncated: a reader may have it mapped.
+    void invalidateOrderIndex() const {
+        if (FileIdentity::of(orderIndexFilename) == FileIdentity()) {
+            return;
+        }
+        const std::string temporaryFilename = orderIndexFilename + ".tmp";
+        std::ofstream(temporaryFilename, std::ios::binary | std::ios::trunc).close();
+        if (!replaceFile(temporaryFilename, orderIndexFilename)) {
+            std::remove(orderIndexFilename.c_str());
+        }
+    }
+
+    bool appendJournalRecord(char type, const std::string& payload) const {
+        CommandStats::Scope phase(CommandStats::Journal);
+        if (journalStale) {
+            clearJournal();
+        }
+#ifndef _WIN32
+        // Everything past the replayed records is a record torn by a crash;
+        // cut it off so the next record starts on its own line.
+        if (FileIdentity::of(journalFilename).size > static_cast<std::uint64_t>(journalSize) &&
+            ::truncate(journalFilename.c_str(), static_cast<off_t>(journalSize)) != 0) {
+            std::cerr << "Error: Unable to repair journal file." << std::endl;
+            return false;
+        }
+#endif
+        bool creating = journalSize == 0;
+        std::ofstream journal(journalFilename, std::ios::app);
+        if (!journal.is_open()) {
+            std::cerr << "Error: Unable to write to journal file." << std::endl;
+            return false;
+        }
+
+        if (journalSize == 0) {
+            journal << 'G' << '|' << generation << '\n';
+        }
+        journal << type << '|' << payload << '\n';
+        journal.flush();
+        if (!journal) {
+            std::cerr << "Error: Unable to write to journal file." << std::endl;
+            return false;
+        }
+        CommandStats::current().addBytesWritten(
+            static_cast<std::uint64_t>(journal.tellp() - journalSize));
+        journalSize = journal.tellp();
+        journal.close();
+
+        if (durability == Durability::Op &&
+            (!syncFile(journalFilename) || (creating && !syncParentDirectory(journalFilename)))) {
+            std::cerr << "Error: Unable to sync journal file." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Removed rather than truncated: a reader may still have it mapped.
+    void clearJournal() const {
+        std::remove(journalFilename.c_str());
+        journalSize = 0;
+        journalStale = false;
+    }
+
+    // A journal opens with a `G|<generation>` record naming the snapshot it
+    // extends; journals written before generations existed extend generation 0.
+    static bool journalMatches(const MappedFile& journal, std::uint64_t snapshotGen) {
+        std::uint64_t journalGen = 0;
+        journal.scanLines([&journalGen](const char* begin, const char* end) {
+            if (end - begin > 2 && begin[0] == 'G' && begin[1] == '|') {
+                std::uint64_t value = 0;
+                for (const char* it = begin + 2; it != end && *it >= '0' && *it <= '9'; ++it) {
+                    value = value * 10 + static_cast<std::uint64_t>(*it - '0');
+                }
+                journalGen = value;
+            }
+            return false;
+        }, 0, journal.terminatedSize());
+        return journalGen == snapshotGen;
+    }
+
+    // Collects the journal's net effect without a snapshot underneath:
+    // the latest version of each added or completed task, and removed ids.
+    void readJournalOverlay(TaskStore& overlay, std::unordered_set<int>& removedIds,
+                            std::uint64_t snapshotGen) const {
+        MappedFile journal(journalFilename);
+        if (!journalMatches(journal, snapshotGen)) {
+            return;
+        }
+        journal.forEachLine([&](const char* begin, const char* end) {
+            if (end - begin < 2 || begin[1] != '|') {
+                return;
+            }
+            const char* payload = begin + 2;
+            TaskFields fields;
+            int taskId = 0;
+
+            if ((begin[0] == 'A' || begin[0] == 'C') &&
+                Task::parseJournalLine(payload, end, fields)) {
+                overlay.put(fields);
+                removedIds.erase(fields.id);
+            } else if (begin[0] == 'R' && parseTaskId(payload, end, taskId)) {
+                size_t slot = overlay.find(taskId);
+                if (slot != TaskStore::npos) {
+                    overlay.erase(slot);
+                }
+                removedIds.insert(taskId);
+            }
+        }, 0, journal.terminatedSize());
+    }
+
+    // Replays complete records from `from` onwards. Returns false, leaving
+    // `tasks` untouched, when the journal extends a different generation.
+    // Replay is idempotent, so re-reading records already applied is safe.
+    bool replayJournal(TaskStore& tasks, const MappedFile& journal, size_t from) const {
+        CommandStats::Scope phase(CommandStats::Replay);
+        if (journal.size() == 0) {
+            return true;
+        }
+        if (from == 0 && !journalMatches(journal, generation)) {
+            return false;
+        }
+
+        size_t available = journal.terminatedSize();
+        journal.forEachLine([&](const char* begin, const char* end) {
+            if (end - begin < 2 || begin[1] != '|') {
+                return;
+            }
+            const char* payload = begin + 2;
+
+            if (begin[0] == 'A' || begin[0] == 'C') {
+                TaskFields fields;
+                if (Task::parseJournalLine(payload, end, fields)) {
+                    reserveId(fields.id);
+                    tasks.put(fields);
+                }
+            } else if (begin[0] == 'R') {
+                int taskId = 0;
+                if (parseTaskId(payload, end, taskId)) {
+                    size_t slot = tasks.find(taskId);
+                    if (slot != TaskStore::npos) {
+                        tasks.erase(slot);
+                    }
+                }
+            }
+        }, from, available);
+        journalSize = static_cast<std::streamoff>(available);
+        return true;
+    }
+};
+
+// A store partitioned by id over several TodoStorage shards: task `id`
+// lives in shard (id - 1) % N, so consecutive ids spread over every shard.
+//   <file>.shards             manifest: "shards=N" and "base-generation=G"
+//   <file>.shard-K-of-N       shard K's snapshot, with its own journal,
+//                             lock file and sidecar indexes
+// A single add, complete or remove locks and writes only the shard that
+// owns the id; whole-store operations (batches, compact, archive, migrate)
+// lock every shard in order. Loads and scans read the shards in parallel
+// and merge their records by id, or by the requested sort key, so the
+// order matches a single store. The store's generation is the base plus
+// the sum of the shards' generations and moves whenever any shard is
+// rewritten.
+class ShardedStorage : public StorageBackend {
+public:
+    static constexpr size_t kMaxShards = 64;
+
+private:
+    static constexpr size_t kNoShard = static_cast<size_t>(-1);
+
+    // Owned copies of scanned records, handed from a shard's scan thread to
+    // the merging thread in batches.
+    struct RecordBatch {
+        std::vector<TaskFields> records;
+        std::vector<size_t> offsets;
+        std::string text;
+
+        void add(const TaskFields& fields) {
+            records.push_back(fields);
+            offsets.push_back(text.size());
+            text.append(fields.description.data(), fields.description.size());
+        }
+
+        // Points the descriptions at `text`, once it has stopped growing and
+        // the batch has reached its reader (moving `text` may move its bytes).
+        void seal() {
+            for (size_t i = 0; i < records.size(); ++i) {
+                records[i].description =
+                    StringRef(text.data() + offsets[i], records[i].description.size());
+            }
+        }
+    };
+
+    // Bounded queue between one shard's scan and the merge. The scan
+    // blocks once kDepth batches wait, so a full listing holds a few
+    // thousand records per shard rather than the store.
+    class ShardFeed {
+    private:
+        static constexpr size_t kBatchRecords = 1024;
+        static constexpr size_t kDepth = 4;
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<RecordBatch> ready;
+        RecordBatch filling;
+        bool finished;
+        bool cancelled;
+        std::exception_ptr failure;
+
+    public:
+        struct Cancelled {};
+
+        ShardFeed() : finished(false), cancelled(false) {}
+
+        void push(const TaskFields& fields) {
+            filling.add(fields);
+            if (filling.records.size() >= kBatchRecords) {
+                handOff();
+            }
+        }
+
+        void finish(std::exception_ptr error) {
+            if (!error && !filling.records.empty()) {
+                handOff();
+            }
+            std::lock_guard<std::mutex> guard(mutex);
+            finished = true;
+            failure = error;
+            changed.notify_all();
+        }
+
+        // The next batch, or false once the scan has ended. Rethrows what
+        // the scan threw.
+        bool next(RecordBatch& batch) {
+            std::unique_lock<std::mutex> guard(mutex);
+            changed.wait(guard, [this]() { return !ready.empty() || finished; });
+            if (ready.empty()) {
+                if (failure) {
+                    std::rethrow_exception(failure);
+                }
+                return false;
+            }
+            batch = std::move(ready.front());
+            ready.pop_front();
+            changed.notify_all();
+            batch.seal();
+            return true;
+        }
+
+        void cancel() {
+            std::lock_guard<std::mutex> guard(mutex);
+            cancelled = true;
+            changed.notify_all();
+        }
+
+    private:
+        void handOff() {
+            std::unique_lock<std::mutex> guard(mutex);
+            changed.wait(guard, [this]() { return ready.size() < kDepth || cancelled; });
+            if (cancelled) {
+                throw Cancelled();
+            }
+            ready.push_back(std::move(filling));
+            filling = RecordBatch();
+            changed.notify_all();
+        }
+    };
+
+    std::string filename;
+    std::string manifestFilename;
+    std::vector<std::unique_ptr<TodoStorage>> shards;
+    std::uint64_t baseGeneration;
+    mutable bool manifestCurrent;
+    mutable size_t appendShard; // locked by lockForTask(kNewTask)
+    mutable int appendHint;
+
+public:
+    ShardedStorage(const std::string& file, size_t count)
+        : filename(file), manifestFilename(manifestPath(file)), baseGeneration(0),
+          manifestCurrent(false), appendShard(kNoShard), appendHint(1) {
+        for (size_t shard = 0; shard < count; ++shard) {
+            shards.push_back(std::make_unique<TodoStorage>(
+                file + ".shard-" + std::to_string(shard) + "-of-" + std::to_string(count)));
+        }
+        size_t recorded = 0;
+        if (readManifest(file, recorded, baseGeneration)) {
+            manifestCurrent = recorded == count;
+        }
+        setParseThreads(TodoStorage::defaultParseThreads());
+    }
+
+    static std::string manifestPath(const std::string& file) { return file + ".shards"; }
+
+    // Reads the manifest of a sharded store at `file`; false when there is
+    // none or it is unreadable.
+    static bool readManifest(const std::string& file, size_t& count, std::uint64_t& base) {
+        std::ifstream manifest(manifestPath(file));
+        std::string line;
+        bool found = false;
+        while (std::getline(manifest, line)) {
+            size_t equals = line.find('=');
+            std::uint64_t value = 0;
+            if (equals == std::string::npos || equals + 1 == line.size() ||
+                line.find_first_not_of("0123456789", equals + 1) != std::string::npos) {
+                continue;
+            }
+            value = std::strtoull(line.c_str() + equals + 1, nullptr, 10);
+            if (line.compare(0, equals, "shards") == 0 && value >= 2 && value <= kMaxShards) {
+                count = static_cast<size_t>(value);
+                found = true;
+            } else if (line.compare(0, equals, "base-generation") == 0) {
+                base = value;
+            }
+        }
+        return found;
+    }
+
+    const std::string& getFilename() const override { return filename; }
+    StorageFormat getFormat() const override { return shards.front()->getFormat(); }
+    bool isJournaled() const override { return true; }
+
+    void setFormat(StorageFormat newFormat) override {
+        for (auto& shard : shards) {
+            shard->setFormat(newFormat);
+        }
+    }
+
+    Durability getDurability() const override { return shards.front()->getDurability(); }
+    void setDurability(Durability level) override {
+        for (auto& shard : shards) {
+            shard->setDurability(level);
+        }
+    }
+
+    IoMode getIoMode() const override { return shards.front()->getIoMode(); }
+    void setIoMode(IoMode mode) override {
+        for (auto& shard : shards) {
+            shard->setIoMode(mode);
+        }
+    }
+
+    // Shards are parsed at the same time, so they split the threads.
+    void setParseThreads(size_t threads) override {
+        for (auto& shard : shards) {
+            shard->setParseThreads(threads / shards.size());
+        }
+    }
+
+    std::streamoff journalBytes() const override {
+        std::streamoff total = 0;
+        for (const auto& shard : shards) {
+            total += shard->journalBytes();
+        }
+        return total;
+    }
+
+    std::uint64_t getGeneration() const override {
+        std::uint64_t total = baseGeneration;
+        for (const auto& shard : shards) {
+            total += shard->getGeneration();
+        }
+        return total;
+    }
+
+    std::uint64_t currentGeneration() const override {
+        std::uint64_t total = baseGeneration;
+        for (const auto& shard : shards) {
+            total += shard->currentGeneration();
+        }
+        return total;
+    }
+
+    void continueGeneration(std::uint64_t previous) override {
+        std::uint64_t own = getGeneration();
+        if (previous > own) {
+            baseGeneration += previous - own;
+            manifestCurrent = false;
+        }
+    }
+
+    int getNextId() const override {
+        int next = 1;
+        for (const auto& shard : shards) {
+            next = std::max(next, shard->getNextId());
+        }
+        return next;
+    }
+
+    void reserveId(int taskId) const override {
+        if (taskId > 0) {
+            shards[shardOf(taskId)]->reserveId(taskId);
+        }
+    }
+
+    // After lockForTask(kNewTask) the id must belong to the locked shard:
+    // the first one at or after the candidate and the counters seen. When
+    // writers race for the same shard, the later one skips ahead to its
+    // next id, leaving a gap of at most N - 1 ids.
+    int claimId(int candidate) const override {
+        if (appendShard == kNoShard) {
+            reserveId(candidate);
+            return candidate;
+        }
+        int taskId = std::max(candidate, std::max(appendHint, shards[appendShard]->getNextId()));
+        while (shardOf(taskId) != appendShard) {
+            ++taskId;
+        }
+        shards[appendShard]->reserveId(taskId);
+        return taskId;
+    }
+
+    // Shards are always locked in index order, so whole-store writers
+    // cannot deadlock with each other; single mutations hold one lock.
+    FileLock lockForWrite() const override {
+        appendShard = kNoShard;
+        FileLock lock;
+        for (const auto& shard : shards) {
+            lock.add(shard->getLockFilename());
+        }
+        return lock;
+    }
+
+    // A new task goes to the shard of the next id as the files have it.
+    // When another writer took that id while this one waited for the lock,
+    // the counters are read again; after a few rounds claimId() skips ahead
+    // instead.
+    FileLock lockForTask(int taskId) const override {
+        appendShard = kNoShard;
+        if (taskId != kNewTask) {
+            return shards[shardOf(taskId)]->lockForWrite();
+        }
+        FileLock lock;
+        for (int attempt = 0; attempt < 4; ++attempt) {
+            int hint = 1;
+            for (const auto& shard : shards) {
+                hint = std::max(hint, shard->peekNextId());
+            }
+            size_t shard = shardOf(hint);
+            lock.release(); // flock would also block on this process's own lock
+            lock = shards[shard]->lockForWrite();
+            appendShard = shard;
+            appendHint = hint;
+            if (shards[shard]->peekNextId() <= hint) {
+                break;
+            }
+        }
+        return lock;
+    }
+
+    // Journal records of every shard are replayed into the merged store; a
+    // replaced shard snapshot reloads all shards.
+    bool refresh(TaskStore& tasks) const override {
+        bool changed = false;
+        for (const auto& shard : shards) {
+            bool replayed = false;
+            if (!shard->catchUp(tasks, replayed)) {
+                tasks = loadTasks();
+                return true;
+            }
+            changed = changed || replayed;
+        }
+        return changed;
+    }
+
+    bool prepareAppend() const override {
+        if (appendShard != kNoShard) {
+            return shards[appendShard]->prepareAppend();
+        }
+        bool prepared = true;
+        for (const auto& shard : shards) {
+            prepared = shard->prepareAppend() && prepared;
+        }
+        return prepared;
+    }
+
+    std::unique_ptr<Task> findTask(int taskId) const override {
+        return shards[shardOf(taskId)]->findTask(taskId);
+    }
+
+    TaskStore loadTasks() const override {
+        CommandStats::Scope phase(CommandStats::Load);
+        std::vector<TaskStore> parts =
+            inParallel<TaskStore>([this](size_t shard) { return shards[shard]->loadTasks(); });
+
+        size_t taskCount = 0;
+        size_t descriptionBytes = 0;
+        for (const auto& part : parts) {
+            taskCount += part.size();
+            for (size_t slot = 0; slot < part.slotCount(); ++slot) {
+                descriptionBytes += part.description(slot).size();
+            }
+        }
+        TaskStore tasks;
+        tasks.reserve(taskCount, descriptionBytes);
+
+        // Each shard keeps its tasks in id order; a heap of the shards'
+        // next ids interleaves them.
+        std::vector<size_t> cursor(parts.size(), 0);
+        auto skipRemoved = [&](size_t part) {
+            while (cursor[part] < parts[part].slotCount() && parts[part].isRemoved(cursor[part])) {
+                ++cursor[part];
+            }
+            return cursor[part] < parts[part].slotCount();
+        };
+        typedef std::pair<int, size_t> Head;
+        std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+        for (size_t part = 0; part < parts.size(); ++part) {
+            if (skipRemoved(part)) {
+                heads.push(Head(parts[part].id(cursor[part]), part));
+            }
+        }
+        while (!heads.empty()) {
+            size_t part = heads.top().second;
+            heads.pop();
+            tasks.put(parts[part].fieldsAt(cursor[part]++));
+            if (skipRemoved(part)) {
+                heads.push(Head(parts[part].id(cursor[part]), part));
+            }
+        }
+        CommandStats::current().setTaskCount(tasks.size());
+        return tasks;
+    }
+
+    // Every shard is scanned on a thread of its own, each stopping after
+    // the most records the page can take from it, and the records are
+    // merged in the filter's order. The page itself is cut here.
+    void scanTasks(const TaskFilter& filter,
+                   const std::function<void(const TaskFields&)>& visit) const override {
+        CommandStats::Scope phase(CommandStats::Scan);
+        TaskFilter shardFilter = filter;
+        shardFilter.offset = 0;
+        if (filter.limit != TaskFilter::kUnlimited) {
+            shardFilter.limit = filter.offset + filter.limit;
+        }
+
+        std::vector<std::unique_ptr<ShardFeed>> feeds;
+        std::vector<std::thread> scanners;
+        struct Stop {
+            std::vector<std::unique_ptr<ShardFeed>>& feeds;
+            std::vector<std::thread>& scanners;
+            ~Stop() {
+                for (auto& feed : feeds) {
+                    feed->cancel();
+                }
+                for (auto& scanner : scanners) {
+                    scanner.join();
+                }
+            }
+        } stop{feeds, scanners};
+        for (size_t shard = 0; shard < shards.size(); ++shard) {
+            feeds.push_back(std::make_unique<ShardFeed>());
+        }
+        for (size_t shard = 0; shard < shards.size(); ++shard) {
+            ShardFeed* feed = feeds[shard].get();
+            const TodoStorage* storage = shards[shard].get();
+            scanners.emplace_back([feed, storage, &shardFilter]() {
+                std::exception_ptr error;
+                try {
+                    storage->scanTasks(shardFilter,
+                                       [feed](const TaskFields& fields) { feed->push(fields); });
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                feed->finish(error);
+            });
+        }
+
+        auto key = [&filter](const TaskFields& fields) {
+            // Stored order is id order, as in a single store.
+            return TaskFilter::sortKey(filter.order, fields.id, fields.createdAt,
+                                       fields.completedAt);
+        };
+        std::vector<RecordBatch> batches(shards.size());
+        std::vector<size_t> position(shards.size(), 0);
+        typedef std::pair<std::pair<std::int64_t, int>, size_t> Head;
+        std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+        auto advance = [&](size_t shard) {
+            if (position[shard] == batches[shard].records.size()) {
+                position[shard] = 0;
+                if (!feeds[shard]->next(batches[shard])) {
+                    return;
+                }
+            }
+            heads.push(Head(key(batches[shard].records[position[shard]]), shard));
+        };
+        for (size_t shard = 0; shard < shards.size(); ++shard) {
+            advance(shard);
+        }
+
+        FilterCursor cursor(filter);
+        size_t merged = 0;
+        while (!heads.empty() && !cursor.isDone()) {
+            size_t shard = heads.top().second;
+            heads.pop();
+            const TaskFields& fields = batches[shard].records[position[shard]];
+            ++merged;
+            if (cursor.accept(fields.id, fields.completed, fields.createdAt)) {
+                visit(fields);
+            }
+            ++position[shard];
+            advance(shard);
+        }
+        CommandStats::current().setTaskCount(merged);
+    }
+
+    // Rewrites every shard, in parallel, then the manifest.
+    bool saveTasks(const TaskStore& tasks) const override {
+        std::vector<std::vector<size_t>> slots(shards.size());
+        for (size_t slot = 0; slot < tasks.slotCount(); ++slot) {
+            if (!tasks.isRemoved(slot)) {
+                slots[shardOf(tasks.id(slot))].push_back(slot);
+            }
+        }
+        std::vector<char> saved = inParallel<char>([&](size_t shard) -> char {
+            return shards[shard]->saveSlots(tasks, &slots[shard]);
+        });
+        bool allSaved = std::find(saved.begin(), saved.end(), 0) == saved.end();
+        return writeManifest() && allSaved;
+    }
+
+    // A record goes to the owning shard only, which compacts its journal
+    // from its own files; `tasks` (the merged store) is not needed.
+    bool recordAdded(const Task& task, const TaskStore* tasks) const override {
+        (void)tasks;
+        return shards[shardOf(task.getId())]->recordAdded(task, nullptr) && writeManifest();
+    }
+
+    bool recordCompleted(const Task& task, const TaskStore* tasks) const override {
+        (void)tasks;
+        return shards[shardOf(task.getId())]->recordCompleted(task, nullptr) && writeManifest();
+    }
+
+    bool recordRemoved(int taskId, const TaskStore* tasks) const override {
+        (void)tasks;
+        return shards[shardOf(taskId)]->recordRemoved(taskId, nullptr) && writeManifest();
+    }
+
+    size_t shardCount() const override { return shards.size(); }
+    size_t shardOf(int taskId) const override {
+        return static_cast<size_t>(static_cast<unsigned int>(taskId - 1) % shards.size());
+    }
+    std::string shardFilename(size_t shard) const override {
+        return shards[shard]->getFilename();
+    }
+
+    // The manifest goes first, unless it already describes the layout
+    // that replaced this one: without it the shard files are not a store.
+    void removeFiles() const override {
+        size_t count = 0;
+        std::uint64_t base = 0;
+        if (readManifest(filename, count, base) && count == shards.size()) {
+            std::remove(manifestFilename.c_str());
+        }
+        for (const auto& shard : shards) {
+            shard->removeFiles();
+        }
+    }
+
+private:
+    // Runs work(shard) for every shard index at once, shard 0 on this thread.
+    template <typename Result, typename Work>
+    std::vector<Result> inParallel(Work work) const {
+        std::vector<std::future<Result>> pending;
+        for (size_t shard = 1; shard < shards.size(); ++shard) {
+            pending.push_back(std::async(std::launch::async, [&work, shard]() {
+                return work(shard);
+            }));
+        }
+        std::vector<Result> results;
+        results.reserve(shards.size());
+        results.push_back(work(0));
+        for (auto& result : pending) {
+            results.push_back(result.get());
+        }
+        return results;
+    }
+
+    // Written (by rename) after the first write to the shards and whenever
+    // the base generation changes. The temporary name is per process, so
+    // writers holding different shard locks do not share it.
+    bool writeManifest() const {
+        if (manifestCurrent) {
+            return true;
+        }
+        std::string temporaryFilename = manifestFilename + ".tmp";
+#ifndef _WIN32
+        temporaryFilename += "." + std::to_string(::getpid());
+#endif
+        std::ofstream manifest(temporaryFilename, std::ios::trunc);
+        manifest << "shards=" << shards.size() << "\n"
+                 << "base-generation=" << baseGeneration << "\n";
+        manifest.close();
+        bool synced = getDurability() == Durability::None || syncFile(temporaryFilename);
+        if (!manifest || !synced || !replaceFile(temporaryFilename, manifestFilename)) {
+            std::remove(temporaryFilename.c_str());
+            std::cerr << "Error: Unable to write shard manifest " << manifestFilename << "."
+                      << std::endl;
+            return false;
+        }
+        if (getDurability() != Durability::None) {
+            syncParentDirectory(manifestFilename);
+        }
+        manifestCurrent = true;
+        return true;
+    }
+};
+
+#ifdef TODO_WITH_SQLITE
+// StorageBackend on an embedded SQLite database in WAL mode, kept in
+// "<store>.sqlite". Every task is a row keyed by id, so point lookups and
+// single mutations are indexed B-tree operations instead of journal
+// appends, sorted listings walk an index, and a batch is one transaction
+// instead of a snapshot rewrite. Writers still serialize on a lock file of
+// their own (TodoManager's refresh-then-mutate protocol relies on it);
+// readers never lock. Built with -DTODO_WITH_SQLITE and -lsqlite3.
+//
+// Durability maps onto PRAGMA synchronous: with none nothing is synced; a
+// single change is synced only with op (FULL, otherwise NORMAL, which WAL
+// makes durable at the next checkpoint); snapshots and batches are always
+// FULL unless durability is none.
+class SqliteStorage : public StorageBackend {
+private:
+    // Resets its prepared statement when done, so an abandoned scan does
+    // not keep a read transaction open. Bind values in column order.
+    class Query {
+    private:
+        sqlite3_stmt* statement;
+        int bound;
+
+    public:
+        explicit Query(sqlite3_stmt* prepared) : statement(prepared), bound(0) {}
+        ~Query() {
+            sqlite3_reset(statement);
+            sqlite3_clear_bindings(statement);
+        }
+
+        Query(const Query&) = delete;
+        Query& operator=(const Query&) = delete;
+
+        Query& bind(std::int64_t value) {
+            sqlite3_bind_int64(statement, ++bound, value);
+            return *this;
+        }
+
+        Query& bind(StringRef text) {
+            sqlite3_bind_text(statement, ++bound, text.data(), static_cast<int>(text.size()),
+                              SQLITE_STATIC);
+            return *this;
+        }
+
+        // True while there is a row to read.
+        bool step() {
+            int result = sqlite3_step(statement);
+            if (result != SQLITE_ROW && result != SQLITE_DONE) {
+                throw std::runtime_error(std::string("SQLite: ") +
+                                         sqlite3_errmsg(sqlite3_db_handle(statement)));
+            }
+            return result == SQLITE_ROW;
+        }
+
+        std::int64_t integer(int column) const { return sqlite3_column_int64(statement, column); }
+
+        // Valid until the next step.
+        StringRef text(int column) const {
+            const char* chars = reinterpret_cast<const char*>(sqlite3_column_text(statement, column));
+            return chars ? StringRef(chars, static_cast<size_t>(sqlite3_column_bytes(statement, column)))
+                         : StringRef();
+        }
+
+        // A row selected as `id, description, completed, created_at,
+        // completed_at`.
+        TaskFields fields() const {
+            TaskFields result;
+            result.id = static_cast<int>(integer(0));
+            result.description = text(1);
+            result.completed = integer(2) != 0;
+            result.createdAt = integer(3);
+            result.completedAt = integer(4);
+            return result;
+        }
+    };
+
+    static constexpr const char* kCreateIndexes =
+        "CREATE INDEX IF NOT EXISTS tasks_by_created ON tasks (created_at, id);"
+        "CREATE INDEX IF NOT EXISTS tasks_by_completed ON tasks (completed_at DESC, id)";
+
+    std::string filename;
+    std::string databaseFilename;
+    std::string lockFilename;
+    sqlite3* db;
+    mutable std::unordered_map<std::string, sqlite3_stmt*> statements;
+    Durability durability;
+    IoMode ioMode;
+    mutable int nextTaskId;
+    mutable std::uint64_t generation;
+    mutable std::int64_t loadedVersion; // PRAGMA data_version of the last load
+    mutable bool inTransaction;
+
+public:
+    explicit SqliteStorage(const std::string& file)
+        : filename(file), databaseFilename(databasePath(file)),
+          lockFilename(databaseFilename + ".lock"), db(nullptr), durability(Durability::Batch),
+          ioMode(IoMode::Pipelined), nextTaskId(1), generation(0), loadedVersion(-1),
+          inTransaction(false) {
+        if (sqlite3_open(databaseFilename.c_str(), &db) != SQLITE_OK) {
+            std::string message = db ? sqlite3_errmsg(db) : "out of memory";
+            sqlite3_close(db);
+            throw std::runtime_error("Unable to open " + databaseFilename + ": " + message);
+        }
+        sqlite3_busy_timeout(db, 10000);
+        exec("PRAGMA journal_mode=WAL");
+        exec("PRAGMA cache_size=-65536"); // 64 MiB
+        exec("CREATE TABLE IF NOT EXISTS tasks ("
+             "id INTEGER PRIMARY KEY, description TEXT NOT NULL, completed INTEGER NOT NULL, "
+             "created_at INTEGER NOT NULL, completed_at INTEGER NOT NULL)");
+        exec(kCreateIndexes);
+        exec("CREATE TABLE IF NOT EXISTS store (key TEXT PRIMARY KEY, value INTEGER NOT NULL)");
+        readCounters();
+    }
+
+    ~SqliteStorage() override { close(); }
+
+    SqliteStorage(const SqliteStorage&) = delete;
+    SqliteStorage& operator=(const SqliteStorage&) = delete;
+
+    static std::string databasePath(const std::string& file) { return file + ".sqlite"; }
+
+    // True when the database at `file` has committed a snapshot. A
+    // migration into SQLite that did not get that far leaves an empty
+    // database next to the files it was migrating.
+    static bool holdsStore(const std::string& file) {
+        sqlite3* handle = nullptr;
+        bool committed = false;
+        if (sqlite3_open_v2(databasePath(file).c_str(), &handle, SQLITE_OPEN_READONLY, nullptr) ==
+            SQLITE_OK) {
+            sqlite3_stmt* query = nullptr;
+            if (sqlite3_prepare_v2(handle, "SELECT 1 FROM store WHERE key = 'generation'", -1,
+                                   &query, nullptr) == SQLITE_OK) {
+                committed = sqlite3_step(query) == SQLITE_ROW;
+            }
+            sqlite3_finalize(query);
+        }
+        sqlite3_close(handle);
+        return committed;
+    }
+
+    const std::string& getFilename() const override { return filename; }
+
+    // Rows have no file format; a store migrated out of SQLite is text
+    // unless `migrate binary` says otherwise.
+    StorageFormat getFormat() const override { return StorageFormat::Text; }
+    void setFormat(StorageFormat newFormat) override { (void)newFormat; }
+
+    Durability getDurability() const override { return durability; }
+    void setDurability(Durability level) override { durability = level; }
+    // SQLite does its own paging; kept so migrations carry the setting.
+    IoMode getIoMode() const override { return ioMode; }
+    void setIoMode(IoMode mode) override { ioMode = mode; }
+    void setParseThreads(size_t threads) override { (void)threads; }
+
+    // Single changes never need the store loaded, as with a journal.
+    bool isJournaled() const override { return true; }
+    std::streamoff journalBytes() const override { return 0; }
+
+    std::uint64_t getGeneration() const override { return generation; }
+    std::uint64_t currentGeneration() const override {
+        Query query(statement("SELECT value FROM store WHERE key = 'generation'"));
+        return query.step() ? static_cast<std::uint64_t>(query.integer(0)) : 0;
+    }
+
+    int getNextId() const override { return nextTaskId; }
+    void reserveId(int taskId) const override {
+        if (taskId >= nextTaskId) {
+            nextTaskId = taskId + 1;
+        }
+    }
+    int claimId(int candidate) const override {
+        reserveId(candidate);
+        return candidate;
+    }
+
+    FileLock lockForWrite() const override { return FileLock(lockFilename); }
+    FileLock lockForTask(int taskId) const override {
+        (void)taskId;
+        return lockForWrite();
+    }
+
+    // Reloads `tasks` when another connection committed since the load.
+    bool refresh(TaskStore& tasks) const override {
+        if (dataVersion() == loadedVersion) {
+            return false;
+        }
+        tasks = loadTasks();
+        return true;
+    }
+
+    bool prepareAppend() const override {
+        readCounters();
+        return true;
+    }
+
+    std::unique_ptr<Task> findTask(int taskId) const override {
+        CommandStats::Scope phase(CommandStats::Load);
+        Query query(statement("SELECT id, description, completed, created_at, completed_at "
+                              "FROM tasks WHERE id = ?"));
+        query.bind(taskId);
+        return query.step() ? std::make_unique<Task>(Task::fromFields(query.fields())) : nullptr;
+    }
+
+    TaskStore loadTasks() const override {
+        CommandStats::Scope phase(CommandStats::Parse);
+        loadedVersion = dataVersion();
+        readCounters();
+        TaskStore tasks;
+        {
+            Query size(statement("SELECT count(*), total(length(CAST(description AS BLOB))) "
+                                 "FROM tasks"));
+            size.step();
+            tasks.reserve(static_cast<size_t>(size.integer(0)), static_cast<size_t>(size.integer(1)));
+        }
+        Query query(statement("SELECT id, description, completed, created_at, completed_at "
+                              "FROM tasks ORDER BY id"));
+        while (query.step()) {
+            TaskFields fields = query.fields();
+            reserveId(fields.id);
+            tasks.put(fields);
+        }
+        CommandStats::current().setTaskCount(tasks.size());
+        return tasks;
+    }
+
+    // Status, creation window and id range are pushed into the query and
+    // every order is an index walk; FilterCursor applies the exact id set
+    // and the page. Filters that are off bind their widest range, so each
+    // order has one prepared statement whatever the values.
+    void scanTasks(const TaskFilter& filter,
+                   const std::function<void(const TaskFields&)>& visit) const override {
+        CommandStats::Scope phase(CommandStats::Scan);
+        if (filter.ids && filter.ids->empty()) {
+            return;
+        }
+        static const std::string select =
+            "SELECT id, description, completed, created_at, completed_at FROM tasks "
+            "WHERE completed BETWEEN ? AND ? AND created_at >= ? AND created_at < ? "
+            "AND id BETWEEN ? AND ?";
+        static const std::string byId = select + " ORDER BY id";
+        static const std::string byCreated = select + " ORDER BY created_at, id";
+        static const std::string completed =
+            select + " AND completed_at != 0 ORDER BY completed_at DESC, id";
+        static const std::string pending = select + " AND completed_at = 0 ORDER BY id";
+        // Completed order is newest completion first with pending tasks
+        // last, as in TaskFilter::sortKey: two index walks.
+        std::vector<const std::string*> parts;
+        switch (filter.order) {
+        case TaskFilter::Order::Created:
+            parts.push_back(&byCreated);
+            break;
+        case TaskFilter::Order::Completed:
+            parts.push_back(&completed);
+            parts.push_back(&pending);
+            break;
+        default:
+            parts.push_back(&byId);
+            break;
+        }
+
+        FilterCursor cursor(filter);
+        size_t examined = 0;
+        for (const std::string* sql : parts) {
+            Query query(statement(sql->c_str()));
+            query.bind(std::int64_t(filter.status == TaskFilter::Status::Done ? 1 : 0))
+                .bind(std::int64_t(filter.status == TaskFilter::Status::Pending ? 0 : 1))
+                .bind(filter.createdFrom != 0 ? filter.createdFrom : INT64_MIN)
+                .bind(filter.createdUntil != 0 ? filter.createdUntil : INT64_MAX)
+                .bind(filter.ids ? std::int64_t(filter.ids->front()) : INT64_MIN)
+                .bind(filter.ids ? std::int64_t(filter.ids->back()) : INT64_MAX);
+            while (!cursor.isDone() && query.step()) {
+                TaskFields fields = query.fields();
+                ++examined;
+                if (cursor.accept(fields.id, fields.completed, fields.createdAt)) {
+                    visit(fields);
+                }
+            }
+        }
+        CommandStats::current().setTaskCount(examined);
+    }
+
+    // Replaces every row in one transaction and starts the next generation.
+    // The secondary indexes are dropped for the rewrite and rebuilt with
+    // one sort each, which is several times faster than updating them per
+    // row.
+    bool saveTasks(const TaskStore& tasks) const override {
+        CommandStats::Scope phase(CommandStats::Save);
+        bool saved = transaction(true, [&]() {
+            Query(statement("DELETE FROM tasks")).step();
+            execOrThrow("DROP INDEX IF EXISTS tasks_by_created;"
+                        "DROP INDEX IF EXISTS tasks_by_completed");
+            for (size_t slot = 0; slot < tasks.slotCount(); ++slot) {
+                if (!tasks.isRemoved(slot)) {
+                    putRow(tasks.fieldsAt(slot));
+                }
+            }
+            execOrThrow(kCreateIndexes);
+            raiseCounter("generation", static_cast<std::int64_t>(generation + 1));
+        });
+        if (!saved) {
+            return false;
+        }
+        generation += 1;
+        // A full rewrite leaves a WAL the size of the store behind.
+        sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr);
+        loadedVersion = dataVersion();
+        return true;
+    }
+
+    bool recordAdded(const Task& task, const TaskStore* tasks) const override {
+        (void)tasks;
+        return recordPut(task);
+    }
+
+    bool recordCompleted(const Task& task, const TaskStore* tasks) const override {
+        (void)tasks;
+        return recordPut(task);
+    }
+
+    bool recordRemoved(int taskId, const TaskStore* tasks) const override {
+        (void)tasks;
+        CommandStats::Scope phase(CommandStats::Journal);
+        return transaction(false, [&]() {
+            Query(statement("DELETE FROM tasks WHERE id = ?")).bind(taskId).step();
+        });
+    }
+
+    // A batch runs as one transaction; the record* calls in between join it.
+    bool beginTransaction() const override {
+        if (!setSynchronous(true) || !exec("BEGIN IMMEDIATE")) {
+            return false;
+        }
+        inTransaction = true;
+        return true;
+    }
+
+    bool commitTransaction() const override {
+        inTransaction = false;
+        if (exec("COMMIT")) {
+            return true;
+        }
+        exec("ROLLBACK");
+        return false;
+    }
+
+    void continueGeneration(std::uint64_t previous) override {
+        generation = std::max(generation, previous);
+    }
+
+    void removeFiles() const override {
+        const_cast<SqliteStorage*>(this)->close();
+        for (const char* suffix : {"", "-wal", "-shm", ".lock"}) {
+            std::remove((databaseFilename + suffix).c_str());
+        }
+    }
+
+private:
+    void close() {
+        for (auto& entry : statements) {
+            sqlite3_finalize(entry.second);
+        }
+        statements.clear();
+        sqlite3_close(db);
+        db = nullptr;
+    }
+
+    void execOrThrow(const char* sql) const {
+        char* message = nullptr;
+        if (sqlite3_exec(db, sql, nullptr, nullptr, &message) != SQLITE_OK) {
+            std::string error = message ? message : sqlite3_errmsg(db);
+            sqlite3_free(message);
+            throw std::runtime_error("SQLite: " + error);
+        }
+    }
+
+    bool exec(const char* sql) const {
+        char* message = nullptr;
+        if (sqlite3_exec(db, sql, nullptr, nullptr, &message) != SQLITE_OK) {
+            std::cerr << "Error: SQLite: " << (message ? message : sqlite3_errmsg(db)) << std::endl;
+            sqlite3_free(message);
+            return false;
+        }
+        return true;
+    }
+
+    // Prepared once per connection.
+    sqlite3_stmt* statement(const char* sql) const {
+        auto found = statements.find(sql);
+        if (found != statements.end()) {
+            return found->second;
+        }
+        sqlite3_stmt* prepared = nullptr;
+        if (sqlite3_prepare_v2(db, sql, -1, &prepared, nullptr) != SQLITE_OK) {
+            throw std::runtime_error(std::string("SQLite: ") + sqlite3_errmsg(db));
+        }
+        statements.emplace(sql, prepared);
+        return prepared;
+    }
+
+    std::int64_t dataVersion() const {
+        Query query(statement("PRAGMA data_version"));
+        return query.step() ? query.integer(0) : -1;
+    }
+
+    void readCounters() const {
+        Query query(statement("SELECT key, value FROM store"));
+        while (query.step()) {
+            std::string key = query.text(0).str();
+            if (key == "generation") {
+                generation = static_cast<std::uint64_t>(query.integer(1));
+            } else if (key == "next_id" && query.integer(1) <= INT_MAX) {
+                nextTaskId = std::max(nextTaskId, static_cast<int>(query.integer(1)));
+            }
+        }
+        Query highest(statement("SELECT max(id) FROM tasks"));
+        if (highest.step() && highest.integer(0) > 0) {
+            reserveId(static_cast<int>(highest.integer(0)));
+        }
+    }
+
+    // Counters only move forward, so a writer with a stale view cannot
+    // hand out an id twice.
+    void raiseCounter(const char* key, std::int64_t value) const {
+        Query(statement("INSERT INTO store (key, value) VALUES (?, ?) "
+                        "ON CONFLICT (key) DO UPDATE SET value = max(value, excluded.value)"))
+            .bind(StringRef(key)).bind(value).step();
+    }
+
+    void putRow(const TaskFields& fields) const {
+        Query(statement("INSERT OR REPLACE INTO tasks (id, description, completed, created_at, "
+                        "completed_at) VALUES (?, ?, ?, ?, ?)"))
+            .bind(fields.id).bind(fields.description).bind(fields.completed ? 1 : 0)
+            .bind(fields.createdAt).bind(fields.completedAt).step();
+    }
+
+    bool recordPut(const Task& task) const {
+        CommandStats::Scope phase(CommandStats::Journal);
+        return transaction(false, [&]() {
+            putRow(task.fields());
+            raiseCounter("next_id", nextTaskId);
+        });
+    }
+
+    bool setSynchronous(bool snapshot) const {
+        if (durability == Durability::None) {
+            return exec("PRAGMA synchronous=OFF");
+        }
+        return exec(snapshot || durability == Durability::Op ? "PRAGMA synchronous=FULL"
+                                                             : "PRAGMA synchronous=NORMAL");
+    }
+
+    // Runs `work` in a transaction of its own, or inside the open batch.
+    // False, rolled back, when a statement fails.
+    template <typename Work>
+    bool transaction(bool snapshot, Work work) const {
+        if (inTransaction) {
+            try {
+                work();
+                return true;
+            } catch (const std::runtime_error& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                return false;
+            }
+        }
+        if (!setSynchronous(snapshot) || !exec("BEGIN IMMEDIATE")) {
+            return false;
+        }
+        try {
+            work();
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            exec("ROLLBACK");
+            return false;
+        }
+        if (!exec("COMMIT")) {
+            exec("ROLLBACK");
+            return false;
+        }
+        return true;
+    }
+};
+#endif
+
+// Splits text into lowercase search tokens: runs of ASCII letters and
+// digits. Bytes outside ASCII are kept inside tokens so UTF-8 words stay whole.
+inline std::vector<std::string> tokenize(StringRef text) {
+    std::vector<std::string> tokens;
+    std::string current;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text.data()[i]);
+        if (std::isalnum(c) || c >= 0x80) {
+            current += static_cast<char>(c < 0x80 ? std::tolower(c) : c);
+        } else if (!current.empty()) {
+            tokens.push_back(current);
+            current.clear();
+        }
+    }
+    if (!current.empty()) {
+        tokens.push_back(current);
+    }
+    std::sort(tokens.begin(), tokens.end());
+    tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+    return tokens;
+}
+
+// Keeps the ids present in every list, in ascending order.
+inline std::vector<int> intersectPostings(std::vector<std::vector<int>> lists) {
+    if (lists.empty()) {
+        return std::vector<int>();
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const std::vector<int>& a, const std::vector<int>& b) { return a.size() < b.size(); });
+
+    std::vector<int> result = lists[0];
+    for (size_t i = 1; i < lists.size() && !result.empty(); ++i) {
+        std::vector<int> narrowed;
+        std::set_intersection(result.begin(), result.end(), lists[i].begin(), lists[i].end(),
+                              std::back_inserter(narrowed));
+        result.swap(narrowed);
+    }
+    return result;
+}
+
+// In-memory inverted index from token to the sorted ids whose description
+// contains it.
+class InvertedIndex {
+private:
+    std::unordered_map<std::string, std::vector<int>> postings;
+
+public:
+    void add(int taskId, StringRef description) {
+        for (const auto& token : tokenize(description)) {
+            std::vector<int>& ids = postings[token];
+            // Ids are allocated in increasing order, so this is an append.
+            ids.insert(std::upper_bound(ids.begin(), ids.end(), taskId), taskId);
+        }
+    }
+
+    void remove(int taskId, StringRef description) {
+        for (const auto& token : tokenize(description)) {
+            auto found = postings.find(token);
+            if (found == postings.end()) {
+                continue;
+            }
+            std::vector<int>& ids = found->second;
+            auto position = std::lower_bound(ids.begin(), ids.end(), taskId);
+            if (position != ids.end() && *position == taskId) {
+                ids.erase(position);
+            }
+            if (ids.empty()) {
+                postings.erase(found);
+            }
+        }
+    }
+
+    // Indexes every task, or those `selects` accepts by id.
+    void build(const TaskStore& tasks, const std::function<bool(int)>& selects = nullptr) {
+        postings.clear();
+        for (size_t slot = 0; slot < tasks.slotCount(); ++slot) {
+            if (!tasks.isRemoved(slot) && (!selects || selects(tasks.id(slot)))) {
+                add(tasks.id(slot), tasks.description(slot));
+            }
+        }
+    }
+
+    std::vector<int> query(const std::vector<std::string>& terms) const {
+        std::vector<std::vector<int>> lists;
+        for (const auto& term : terms) {
+            auto found = postings.find(term);
+            if (found == postings.end()) {
+                return std::vector<int>();
+            }
+            lists.push_back(found->second);
+        }
+        return intersectPostings(std::move(lists));
+    }
+
+    // Binary snapshot, tokens sorted so lookups can binary-search the map:
+    //   char   magic[4] "TODX", uint32 version, uint64 tokenCount,
+    //   uint64 postingCount, uint64 heapSize
+    //   uint64 tokenOffset[tokenCount+1]    into the token heap
+    //   uint64 postingOffset[tokenCount+1]  into the postings column
+    //   int32  postings[postingCount]
+    //   char   heap[heapSize]
+    bool save(const std::string& path) const {
+        std::vector<const std::pair<const std::string, std::vector<int>>*> entries;
+        entries.reserve(postings.size());
+        for (const auto& entry : postings) {
+            entries.push_back(&entry);
+        }
+        std::sort(entries.begin(), entries.end(),
+                  [](const std::pair<const std::string, std::vector<int>>* a,
+                     const std::pair<const std::string, std::vector<int>>* b) {
+                      return a->first < b->first;
+                  });
+
+        std::vector<std::uint64_t> tokenOffsets(1, 0);
+        std::vector<std::uint64_t> postingOffsets(1, 0);
+        std::vector<std::int32_t> allPostings;
+        std::string heap;
+        for (const auto* entry : entries) {
+            heap += entry->first;
+            tokenOffsets.push_back(heap.size());
+            allPostings.insert(allPostings.end(), entry->second.begin(), entry->second.end());
+            postingOffsets.push_back(allPostings.size());
+        }
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::uint32_t version = 1;
+        std::uint64_t counts[3] = {entries.size(), allPostings.size(), heap.size()};
+        file.write("TODX", 4);
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        file.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+        writeColumn(file, tokenOffsets);
+        writeColumn(file, postingOffsets);
+        writeColumn(file, allPostings);
+        file.write(heap.data(), static_cast<std::streamsize>(heap.size()));
+        if (file) {
+            CommandStats::current().addBytesWritten(static_cast<std::uint64_t>(file.tellp()));
+        }
+        return static_cast<bool>(file);
+    }
+};
+
+// Persisted search index for one store: a sorted binary snapshot that is
+// queried in place through a mapping, plus an append-only log of changes
+// made since the snapshot was written. The log is folded into a new
+// snapshot once it passes a size threshold.
+class SearchIndexFile {
+private:
+    static constexpr std::streamoff kDefaultRebuildThreshold = 256 << 10; // 256 KiB
+    static constexpr size_t kHeaderSize = 4 + sizeof(std::uint32_t) + 3 * sizeof(std::uint64_t);
+
+    std::string snapshotFilename;
+    std::string logFilename;
+    std::streamoff rebuildThreshold;
+    std::string pendingLog;
+    std::streamoff logSize;
+
+public:
+    explicit SearchIndexFile(const std::string& storeFilename,
+                             std::streamoff threshold = kDefaultRebuildThreshold)
+        : snapshotFilename(storeFilename + ".index"), logFilename(storeFilename + ".index.log"),
+          rebuildThreshold(threshold), logSize(0) {}
+
+    // False for a snapshot whose header does not describe the file, which
+    // is then rebuilt like a missing one.
+    bool exists() const {
+        MappedFile snapshot(snapshotFilename);
+        return snapshot.isOpen() && sizesMatch(snapshot);
+    }
+
+    void stageAdded(int taskId, StringRef description) { stage('+', taskId, description); }
+    void stageRemoved(int taskId, StringRef description) { stage('-', taskId, description); }
+
+    // Appends staged changes to the log; true when the log has grown large
+    // enough that the caller should rebuild the snapshot.
+    bool flush() {
+        if (pendingLog.empty()) {
+            return false;
+        }
+        CommandStats::Scope phase(CommandStats::Index);
+        if (!repairLog()) {
+            // The next search rebuilds an index that is missing.
+            remove();
+            return false;
+        }
+        std::ofstream log(logFilename, std::ios::app | std::ios::binary);
+        log << pendingLog;
+        CommandStats::current().addBytesWritten(pendingLog.size());
+        log.flush();
+        pendingLog.clear();
+        logSize = log ? static_cast<std::streamoff>(log.tellp()) : 0;
+        return logSize >= rebuildThreshold;
+    }
+
+    // Replaces the snapshot by rename and removes the log, so concurrent
+    // queries keep reading the files they already mapped.
+    bool rebuild(const TaskStore& tasks, const std::function<bool(int)>& selects = nullptr) {
+        CommandStats::Scope phase(CommandStats::Index);
+        InvertedIndex index;
+        index.build(tasks, selects);
+        pendingLog.clear();
+        const std::string temporaryFilename = snapshotFilename + ".tmp";
+        if (!index.save(temporaryFilename) || !replaceFile(temporaryFilename, snapshotFilename)) {
+            std::remove(temporaryFilename.c_str());
+            std::cerr << "Error: Unable to write search index." << std::endl;
+            return false;
+        }
+        std::remove(logFilename.c_str());
+        logSize = 0;
+        return true;
+    }
+
+    void remove() {
+        pendingLog.clear();
+        std::remove(snapshotFilename.c_str());
+        std::remove(logFilename.c_str());
+        logSize = 0;
+    }
+
+    // Ids whose description contains every term, in ascending order.
+    std::vector<int> query(const std::vector<std::string>& terms) const {
+        CommandStats::Scope phase(CommandStats::Index);
+        MappedFile snapshot(snapshotFilename);
+        MappedFile log(logFilename);
+
+        std::vector<std::vector<int>> lists;
+        for (const auto& term : terms) {
+            std::vector<int> ids = lookup(snapshot, term);
+            applyLog(log, term, ids);
+            if (ids.empty()) {
+                return std::vector<int>();
+            }
+            lists.push_back(std::move(ids));
+        }
+        return intersectPostings(std::move(lists));
+    }
+
+private:
+    // Cuts off a line torn by a crash in the middle of flush(), so the
+    // next change starts on a line of its own instead of completing it.
+    bool repairLog() const {
+#ifndef _WIN32
+        std::ifstream log(logFilename, std::ios::binary);
+        char last = '\n';
+        if (log.seekg(-1, std::ios::end)) {
+            log.get(last);
+        }
+        if (last != '\n') {
+            MappedFile torn(logFilename);
+            if (::truncate(logFilename.c_str(), static_cast<off_t>(torn.terminatedSize())) != 0) {
+                std::cerr << "Error: Unable to repair search index log." << std::endl;
+                return false;
+            }
+        }
+#endif
+        return true;
+    }
+
+    void stage(char operation, int taskId, StringRef description) {
+        pendingLog += operation;
+        pendingLog += '|';
+        pendingLog += std::to_string(taskId);
+        pendingLog += '|';
+        pendingLog.append(description.data(), description.size());
+        pendingLog += '\n';
+    }
+
+    // True when the header's counts account for exactly the rest of the
+    // file. Each count is bounded by the bytes left before it is
+    // multiplied, so a huge one cannot wrap around to the file size.
+    static bool sizesMatch(const MappedFile& snapshot) {
+        if (snapshot.size() < kHeaderSize || std::memcmp(snapshot.data(), "TODX", 4) != 0) {
+            return false;
+        }
+        std::uint64_t counts[3];
+        std::memcpy(counts, snapshot.data() + 8, sizeof(counts));
+        std::uint64_t left = snapshot.size() - kHeaderSize;
+        if (counts[0] >= left / (2 * sizeof(std::uint64_t))) {
+            return false;
+        }
+        left -= 2 * (counts[0] + 1) * sizeof(std::uint64_t);
+        if (counts[1] > left / sizeof(std::int32_t)) {
+            return false;
+        }
+        left -= counts[1] * sizeof(std::int32_t);
+        return counts[2] == left;
+    }
+
+    std::vector<int> lookup(const MappedFile& snapshot, const std::string& term) const {
+        std::vector<int> ids;
+        if (snapshot.size() < kHeaderSize || std::memcmp(snapshot.data(), "TODX", 4) != 0) {
+            return ids;
+        }
+        if (!sizesMatch(snapshot)) {
+            throw std::runtime_error("Corrupt search index: " + snapshotFilename);
+        }
+
+        std::uint64_t counts[3];
+        std::memcpy(counts, snapshot.data() + 8, sizeof(counts));
+        const std::uint64_t tokenCount = counts[0];
+        const std::uint64_t postingCount = counts[1];
+        const std::uint64_t heapSize = counts[2];
+
+        const char* tokenOffsets = snapshot.data() + kHeaderSize;
+        const char* postingOffsets = tokenOffsets + (tokenCount + 1) * sizeof(std::uint64_t);
+        const char* postings = postingOffsets + (tokenCount + 1) * sizeof(std::uint64_t);
+        const char* heap = postings + postingCount * sizeof(std::int32_t);
+
+        size_t low = 0;
+        size_t high = static_cast<size_t>(tokenCount);
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            std::uint64_t begin = readColumnValue<std::uint64_t>(tokenOffsets, mid);
+            std::uint64_t end = readColumnValue<std::uint64_t>(tokenOffsets, mid + 1);
+            if (begin > end || end > heapSize) {
+                throw std::runtime_error("Corrupt search index: " + snapshotFilename);
+            }
+            int order = term.compare(0, std::string::npos, heap + begin, end - begin);
+            if (order == 0) {
+                std::uint64_t first = readColumnValue<std::uint64_t>(postingOffsets, mid);
+                std::uint64_t last = readColumnValue<std::uint64_t>(postingOffsets, mid + 1);
+                if (first > last || last > postingCount) {
+                    throw std::runtime_error("Corrupt search index: " + snapshotFilename);
+                }
+                for (std::uint64_t i = first; i < last; ++i) {
+                    ids.push_back(readColumnValue<std::int32_t>(postings, i));
+                }
+                return ids;
+            }
+            if (order < 0) {
+                high = mid;
+            } else {
+                low = mid + 1;
+            }
+        }
+        return ids;
+    }
+
+    // Only complete lines count: a crash in the middle of flush() leaves
+    // a torn one at the end.
+    static void applyLog(const MappedFile& log, const std::string& term, std::vector<int>& ids) {
+        log.forEachLine([&](const char* begin, const char* end) {
+            const char* bar = end - begin > 2
+                ? static_cast<const char*>(std::memchr(begin + 2, '|', end - begin - 2)) : nullptr;
+            int taskId = 0;
+            if (!bar || begin[1] != '|' || !parseTaskId(begin + 2, bar, taskId)) {
+                return;
+            }
+            std::vector<std::string> tokens = tokenize(StringRef(bar + 1, end));
+            if (!std::binary_search(tokens.begin(), tokens.end(), term)) {
+                return;
+            }
+            auto position = std::lower_bound(ids.begin(), ids.end(), taskId);
+            bool present = position != ids.end() && *position == taskId;
+            if (begin[0] == '+' && !present) {
+                ids.insert(position, taskId);
+            } else if (begin[0] == '-' && present) {
+                ids.erase(position);
+            }
+        }, 0, log.terminatedSize());
+    }
+};
+
+// The search index of a store, one SearchIndexFile per shard so that each
+// is only written under its shard's lock. Queries ask every shard's index
+// at once and merge the ids.
+class ShardedSearchIndex {
+private:
+    const StorageBackend* storage;
+    std::vector<SearchIndexFile> shards;
+    std::vector<bool> overdue; // log past its rebuild threshold
+
+public:
+    explicit ShardedSearchIndex(const StorageBackend& store) : storage(&store) {
+        for (size_t shard = 0; shard < store.shardCount(); ++shard) {
+            shards.emplace_back(store.shardFilename(shard));
+        }
+        overdue.assign(shards.size(), false);
+    }
+
+    bool exists() const {
+        for (const auto& shard : shards) {
+            if (!shard.exists()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void stageAdded(int taskId, StringRef description) {
+        shards[storage->shardOf(taskId)].stageAdded(taskId, description);
+    }
+
+    void stageRemoved(int taskId, StringRef description) {
+        shards[storage->shardOf(taskId)].stageRemoved(taskId, description);
+    }
+
+    // True when some shard's log should be folded by rebuildOverdue().
+    bool flush() {
+        bool rebuild = false;
+        for (size_t shard = 0; shard < shards.size(); ++shard) {
+            if (shards[shard].flush()) {
+                overdue[shard] = true;
+            }
+            rebuild = rebuild || overdue[shard];
+        }
+        return rebuild;
+    }
+
+    bool rebuild(const TaskStore& tasks) {
+        bool rebuilt = true;
+        for (size_t shard = 0; shard < shards.size(); ++shard) {
+            rebuilt = rebuildShard(tasks, shard) && rebuilt;
+        }
+        return rebuilt;
+    }
+
+    bool rebuildOverdue(const TaskStore& tasks) {
+        bool rebuilt = true;
+        for (size_t shard = 0; shard < shards.size(); ++shard) {
+            if (overdue[shard]) {
+                rebuilt = rebuildShard(tasks, shard) && rebuilt;
+            }
+        }
+        return rebuilt;
+    }
+
+    std::vector<int> query(const std::vector<std::string>& terms) const {
+        if (shards.size() == 1) {
+            return shards.front().query(terms);
+        }
+        std::vector<std::future<std::vector<int>>> pending;
+        for (size_t shard = 1; shard < shards.size(); ++shard) {
+            const SearchIndexFile* index = &shards[shard];
+            pending.push_back(std::async(std::launch::async, [index, &terms]() {
+                return index->query(terms);
+            }));
+        }
+        std::vector<int> ids = shards.front().query(terms);
+        for (auto& shardIds : pending) {
+            std::vector<int> found = shardIds.get();
+            std::vector<int> merged;
+            merged.reserve(ids.size() + found.size());
+            std::merge(ids.begin(), ids.end(), found.begin(), found.end(),
+                       std::back_inserter(merged));
+            ids.swap(merged);
+        }
+        return ids;
+    }
+
+    void remove() {
+        for (auto& shard : shards) {
+            shard.remove();
+        }
+    }
+
+private:
+    bool rebuildShard(const TaskStore& tasks, size_t shard) {
+        overdue[shard] = false;
+        if (shards.size() == 1) {
+            return shards[shard].rebuild(tasks);
+        }
+        return shards[shard].rebuild(tasks, [this, shard](int taskId) {
+            return storage->shardOf(taskId) == shard;
+        });
+    }
+};
+
+// Byte-oriented LZ77 in the LZ4 block layout, used for archive blocks.
+// Each sequence is a token whose high and low nibbles hold the literal
+// length and the match length minus 4 (15 means more length bytes follow,
+// each adding up to 255), then the literals, then a 2-byte little-endian
+// distance back into the last 64 KiB. The final sequence has literals only.
+// Matches are found with a single-probe hash of the next 4 bytes, which is
+// enough for task lines that repeat timestamps and vocabulary.
+inline void appendLzLength(std::string& out, size_t length) {
+    while (length >= 255) {
+        out += static_cast<char>(255);
+        length -= 255;
+    }
+    out += static_cast<char>(length);
+}
+
+inline void appendLzSequence(std::string& out, const char* literals, size_t literalCount,
+                             size_t distance, size_t matchLength) {
+    size_t matchCode = matchLength >= 4 ? matchLength - 4 : 0;
+    unsigned token = static_cast<unsigned>(std::min<size_t>(literalCount, 15) << 4);
+    if (matchLength > 0) {
+        token |= static_cast<unsigned>(std::min<size_t>(matchCode, 15));
+    }
+    out += static_cast<char>(token);
+    if (literalCount >= 15) {
+        appendLzLength(out, literalCount - 15);
+    }
+    out.append(literals, literalCount);
+    if (matchLength > 0) {
+        out += static_cast<char>(distance & 0xFF);
+        out += static_cast<char>(distance >> 8);
+        if (matchCode >= 15) {
+            appendLzLength(out, matchCode - 15);
+        }
+    }
+}
+
+inline std::string compressBlock(const char* data, size_t size) {
+    static constexpr size_t kMinMatch = 4;
+    static constexpr size_t kMaxDistance = 65535;
+    static constexpr int kHashBits = 13;
+
+    std::string out;
+    out.reserve(size / 2 + 16);
+    std::vector<std::uint32_t> table(size_t(1) << kHashBits, 0); // position + 1
+    size_t anchor = 0;
+    size_t position = 0;
+    while (size >= kMinMatch && position <= size - kMinMatch) {
+        std::uint32_t sequence;
+        std::memcpy(&sequence, data + position, sizeof(sequence));
+        std::uint32_t hash = (sequence * 2654435761u) >> (32 - kHashBits);
+        size_t candidate = table[hash];
+        table[hash] = static_cast<std::uint32_t>(position + 1);
+        if (candidate == 0 || position - (candidate - 1) > kMaxDistance ||
+            std::memcmp(data + candidate - 1, data + position, kMinMatch) != 0) {
+            ++position;
+            continue;
+        }
+        size_t match = candidate - 1;
+        size_t length = kMinMatch;
+        while (position + length < size && data[match + length] == data[position + length]) {
+            ++length;
+        }
+        appendLzSequence(out, data + anchor, position - anchor, position - match, length);
+        position += length;
+        anchor = position;
+    }
+    appendLzSequence(out, data + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+// Reads a length continued past 15 in 255-byte steps; false on truncation.
+inline bool readLzLength(const unsigned char* data, size_t size, size_t& position, size_t& length) {
+    unsigned char next = 255;
+    while (next == 255) {
+        if (position >= size) {
+            return false;
+        }
+        next = data[position++];
+        length += next;
+    }
+    return true;
+}
+
+// Inverse of compressBlock; false when the input is not a well-formed
+// block that expands to exactly `rawSize` bytes. No input byte expands to
+// more than 255 output bytes, so a larger `rawSize` is refused before the
+// output is allocated.
+inline bool decompressBlock(const char* compressed, size_t size, size_t rawSize, std::string& out) {
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(compressed);
+    if (rawSize / 255 > size) {
+        return false;
+    }
+    out.resize(rawSize);
+    size_t written = 0;
+    size_t position = 0;
+    while (position < size) {
+        unsigned token = data[position++];
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLzLength(data, size, position, literals)) {
+            return false;
+        }
+        if (literals > size - position || literals > rawSize - written) {
+            return false;
+        }
+        std::memcpy(&out[written], compressed + position, literals);
+        written += literals;
+        position += literals;
+        if (position == size) {
+            break;
+        }
+
+        if (size - position < 2) {
+            return false;
+        }
+        size_t distance = data[position] | (static_cast<size_t>(data[position + 1]) << 8);
+        position += 2;
+        size_t length = token & 15;
+        if (length == 15 && !readLzLength(data, size, position, length)) {
+            return false;
+        }
+        length += 4;
+        if (distance == 0 || distance > written || length > rawSize - written) {
+            return false;
+        }
+        // A match closer than its length overlaps the bytes it produces
+        // and is copied byte by byte.
+        char* target = &out[written];
+        const char* source = target - distance;
+        if (distance >= length) {
+            std::memcpy(target, source, length);
+        } else {
+            for (size_t i = 0; i < length; ++i) {
+                target[i] = source[i];
+            }
+        }
+        written += length;
+    }
+    return written == rawSize;
+}
+
+// Cold storage for completed tasks, next to the store as <store>.archive.
+// Tasks are moved here by `archive` (or TODO_ARCHIVE_DAYS) and are only
+// read by `list --all` and `search --all`, which decompress one block at a
+// time. Layout, in native byte order:
+//   char   magic[4] "TODA", uint32 version
+//   blocks              compressed journal-format lines, about 64 KiB raw each
+//   ArchiveBlock[count] block index
+//   Trailer             index offset, block count, magic and version again
+// Every block is tagged with the generation of the store snapshot that no
+// longer holds its tasks. Until that snapshot exists (a crash between
+// writing the archive and saving the store) the block is ignored by
+// readers and dropped by the next archive write, so a task never shows up
+// twice.
+class TaskArchive {
+private:
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr size_t kHeaderSize = 4 + sizeof(std::uint32_t);
+    static constexpr size_t kBlockRawBytes = 64 << 10;
+
+    struct ArchiveBlock {
+        std::uint64_t offset;
+        std::uint64_t generation;
+        std::uint32_t compressedSize;
+        std::uint32_t rawSize;
+        std::uint32_t count;
+        std::int32_t firstId;
+        std::int32_t lastId;
+        std::uint32_t reserved;
+        std::int64_t minCreatedAt;
+        std::int64_t maxCreatedAt;
+    };
+
+    struct Trailer {
+        std::uint64_t indexOffset;
+        std::uint64_t blockCount;
+        char magic[4];
+        std::uint32_t version;
+    };
+
+    std::string filename;
+
+public:
+    explicit TaskArchive(const std::string& storeFilename) : filename(storeFilename + ".archive") {}
+
+    const std::string& getFilename() const { return filename; }
+
+    // Writes `records` as new blocks tagged `generation` after the blocks
+    // committed by `liveGeneration` or earlier, and replaces the archive by
+    // rename. The caller then saves the store snapshot of `generation`
+    // without the records.
+    bool append(const std::vector<Task>& records, std::uint64_t liveGeneration,
+                std::uint64_t generation, Durability durability, IoMode ioMode) const {
+        CommandStats::Scope phase(CommandStats::Save);
+        const std::string temporaryFilename = filename + ".tmp";
+        WriteBehindFile output;
+        if (!output.open(temporaryFilename, ioMode == IoMode::Pipelined,
+                         durability != Durability::None)) {
+            std::cerr << "Error: Unable to write archive." << std::endl;
+            return false;
+        }
+        std::ostream file(&output);
+
+        const std::uint32_t version = kVersion;
+        file.write("TODA", 4);
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        std::uint64_t offset = kHeaderSize;
+        std::vector<ArchiveBlock> index;
+        {
+            MappedFile existing(filename);
+            for (ArchiveBlock block : readIndex(existing)) {
+                if (block.generation > liveGeneration) {
+                    continue;
+                }
+                file.write(existing.data() + block.offset, block.compressedSize);
+                block.offset = offset;
+                offset += block.compressedSize;
+                index.push_back(block);
+            }
+        }
+
+        std::string raw;
+        size_t first = 0;
+        for (size_t i = 0; i < records.size(); ++i) {
+            raw += records[i].toJournalString();
+            raw += '\n';
+            if (raw.size() < kBlockRawBytes && i + 1 < records.size()) {
+                continue;
+            }
+            ArchiveBlock block = describeBlock(records, first, i + 1);
+            std::string compressed = compressBlock(raw.data(), raw.size());
+            file.write(compressed.data(), static_cast<std::streamsize>(compressed.size()));
+            block.offset = offset;
+            block.generation = generation;
+            block.compressedSize = static_cast<std::uint32_t>(compressed.size());
+            block.rawSize = static_cast<std::uint32_t>(raw.size());
+            offset += compressed.size();
+            index.push_back(block);
+            raw.clear();
+            first = i + 1;
+        }
+
+        Trailer trailer;
+        trailer.indexOffset = offset;
+        trailer.blockCount = index.size();
+        std::memcpy(trailer.magic, "TODA", 4);
+        trailer.version = kVersion;
+        file.write(reinterpret_cast<const char*>(index.data()),
+                   static_cast<std::streamsize>(index.size() * sizeof(ArchiveBlock)));
+        file.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+        bool written = file.flush() && output.close();
+        if (written) {
+            CommandStats::current().addBytesWritten(output.size());
+        }
+
+        bool synced = durability == Durability::None || syncFile(temporaryFilename);
+        if (!written || !synced || !replaceFile(temporaryFilename, filename)) {
+            std::remove(temporaryFilename.c_str());
+            std::cerr << "Error: Unable to write archive." << std::endl;
+            return false;
+        }
+        if (durability != Durability::None) {
+            syncParentDirectory(filename);
+        }
+        return true;
+    }
+
+    // Visits the archived tasks committed by `liveGeneration` that pass
+    // `filter` and contain every one of `terms`, in archive order. Blocks
+    // outside the filter's ids or creation window are not decompressed.
+    template <typename Visit>
+    void scan(const TaskFilter& filter, const std::vector<std::string>& terms,
+              std::uint64_t liveGeneration, Visit visit) const {
+        if (filter.status == TaskFilter::Status::Pending) {
+            return;
+        }
+        CommandStats::Scope phase(CommandStats::Scan);
+        MappedFile file(filename);
+        FilterCursor cursor(filter);
+        std::string raw;
+        for (const ArchiveBlock& block : readIndex(file)) {
+            if (cursor.isDone()) {
+                break;
+            }
+            if (block.generation > liveGeneration || !overlaps(block, filter)) {
+                continue;
+            }
+            if (!decompressBlock(file.data() + block.offset, block.compressedSize,
+                                 block.rawSize, raw)) {
+                throw std::runtime_error("Corrupt archive block: " + filename);
+            }
+            const char* cursorPosition = raw.data();
+            const char* end = raw.data() + raw.size();
+            while (cursorPosition < end && !cursor.isDone()) {
+                const char* newline =
+                    static_cast<const char*>(std::memchr(cursorPosition, '\n', end - cursorPosition));
+                const char* lineEnd = newline ? newline : end;
+                TaskFields fields;
+                if (Task::parseJournalLine(cursorPosition, lineEnd, fields) &&
+                    containsTerms(fields.description, terms) &&
+                    cursor.accept(fields.id, fields.completed, fields.createdAt)) {
+                    visit(fields);
+                }
+                cursorPosition = lineEnd + 1;
+            }
+        }
+    }
+
+    // Tasks in the blocks committed by `liveGeneration`.
+    size_t count(std::uint64_t liveGeneration) const {
+        MappedFile file(filename);
+        size_t total = 0;
+        for (const ArchiveBlock& block : readIndex(file)) {
+            if (block.generation <= liveGeneration) {
+                total += block.count;
+            }
+        }
+        return total;
+    }
+
+private:
+    static ArchiveBlock describeBlock(const std::vector<Task>& records, size_t first, size_t last) {
+        ArchiveBlock block = ArchiveBlock();
+        block.count = static_cast<std::uint32_t>(last - first);
+        block.firstId = records[first].getId();
+        block.lastId = records[first].getId();
+        block.minCreatedAt = records[first].getCreatedAt();
+        block.maxCreatedAt = records[first].getCreatedAt();
+        for (size_t i = first; i < last; ++i) {
+            block.firstId = std::min(block.firstId, records[i].getId());
+            block.lastId = std::max(block.lastId, records[i].getId());
+            block.minCreatedAt = std::min(block.minCreatedAt, records[i].getCreatedAt());
+            block.maxCreatedAt = std::max(block.maxCreatedAt, records[i].getCreatedAt());
+        }
+        return block;
+    }
+
+    static bool overlaps(const ArchiveBlock& block, const TaskFilter& filter) {
+        if ((filter.createdFrom != 0 && block.maxCreatedAt < filter.createdFrom) ||
+            (filter.createdUntil != 0 && block.minCreatedAt >= filter.createdUntil)) {
+            return false;
+        }
+        if (filter.ids) {
+            auto next = std::lower_bound(filter.ids->begin(), filter.ids->end(), block.firstId);
+            return next != filter.ids->end() && *next <= block.lastId;
+        }
+        return true;
+    }
+
+    static bool containsTerms(StringRef description, const std::vector<std::string>& terms) {
+        if (terms.empty()) {
+            return true;
+        }
+        std::vector<std::string> tokens = tokenize(description);
+        for (const auto& term : terms) {
+            if (!std::binary_search(tokens.begin(), tokens.end(), term)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The block index of a mapped archive; empty when there is no archive.
+    std::vector<ArchiveBlock> readIndex(const MappedFile& file) const {
+        std::vector<ArchiveBlock> index;
+        if (file.size() == 0) {
+            return index;
+        }
+        Trailer trailer;
+        if (file.size() < kHeaderSize + sizeof(Trailer) ||
+            std::memcmp(file.data(), "TODA", 4) != 0) {
+            throw std::runtime_error("Corrupt archive: " + filename);
+        }
+        std::memcpy(&trailer, file.data() + file.size() - sizeof(Trailer), sizeof(Trailer));
+        if (std::memcmp(trailer.magic, "TODA", 4) != 0 || trailer.version != kVersion ||
+            trailer.indexOffset < kHeaderSize || trailer.indexOffset > file.size() ||
+            trailer.blockCount > file.size() / sizeof(ArchiveBlock) ||
+            trailer.indexOffset + trailer.blockCount * sizeof(ArchiveBlock) + sizeof(Trailer) !=
+                file.size()) {
+            throw std::runtime_error("Corrupt archive: " + filename);
+        }
+        index.resize(static_cast<size_t>(trailer.blockCount));
+        std::memcpy(index.data(), file.data() + trailer.indexOffset,
+                    index.size() * sizeof(ArchiveBlock));
+        for (const ArchiveBlock& block : index) {
+            if (block.offset < kHeaderSize || block.offset > trailer.indexOffset ||
+                block.compressedSize > trailer.indexOffset - block.offset) {
+                throw std::runtime_error("Corrupt archive: " + filename);
+            }
+        }
+        return index;
+    }
+};
+
+enum class ExportFormat { JsonLines, Csv };
+
+// A task read by `import`. Ids are not imported: every record becomes a
+// new task, so imports never collide with existing ids.
+struct ImportedTask {
+    std::string description;
+    bool completed;
+    std::int64_t createdAt;   // 0: stamped with the import time
+    std::int64_t completedAt;
+
+    ImportedTask() : completed(false), createdAt(0), completedAt(0) {}
+};
+
+// Record layouts for `export` and `import`, one task per record. JSON
+// Lines objects and CSV rows (RFC 4180 quoting, under a header row) carry
+// id, description, completed, created_at and completed_at. Times use the
+// store's local "YYYY-MM-DD HH:MM:SS" form; a pending task's completed_at
+// is null in JSON and empty in CSV.
+class TaskRecordFormat {
+public:
+    static void writeHeader(ChunkedWriter& writer, ExportFormat format) {
+        if (format == ExportFormat::Csv) {
+            writer.append(StringRef("id,description,completed,created_at,completed_at\n"));
+        }
+    }
+
+    static void write(ChunkedWriter& writer, ExportFormat format, const TaskFields& fields) {
+        char created[32];
+        char completed[32];
+        StringRef createdText(created, formatTimestamp(fields.createdAt, created));
+        StringRef completedText(completed, formatTimestamp(fields.completedAt, completed));
+        if (format == ExportFormat::Csv) {
+            writer.appendNumber(fields.id).append(',');
+            appendCsvField(writer, fields.description);
+            writer.append(fields.completed ? StringRef(",1,") : StringRef(",0,"))
+                  .append(createdText).append(',').append(completedText).append('\n');
+            return;
+        }
+        writer.append(StringRef("{\"id\":")).appendNumber(fields.id)
+              .append(StringRef(",\"description\":"));
+        appendJsonString(writer, fields.description);
+        writer.append(fields.completed ? StringRef(",\"completed\":true")
+                                       : StringRef(",\"completed\":false"))
+              .append(StringRef(",\"created_at\":"));
+        appendJsonString(writer, createdText);
+        writer.append(StringRef(",\"completed_at\":"));
+        if (completedText.size() == 0) {
+            writer.append(StringRef("null"));
+        } else {
+            appendJsonString(writer, completedText);
+        }
+        writer.append(StringRef("}\n"));
+    }
+
+    // One JSON object per line. Unknown keys are skipped if their values
+    // are strings, numbers, booleans or null.
+    static bool parseJson(StringRef line, ImportedTask& task) {
+        const char* cursor = line.data();
+        const char* end = line.data() + line.size();
+        bool described = false;
+        std::string key;
+        std::string value;
+
+        skipSpace(cursor, end);
+        if (cursor == end || *cursor++ != '{') {
+            return false;
+        }
+        skipSpace(cursor, end);
+        if (cursor != end && *cursor == '}') {
+            return false; // no description
+        }
+        for (;;) {
+            skipSpace(cursor, end);
+            if (!parseJsonString(cursor, end, key)) {
+                return false;
+            }
+            skipSpace(cursor, end);
+            if (cursor == end || *cursor++ != ':') {
+                return false;
+            }
+            skipSpace(cursor, end);
+
+            if (key == "description") {
+                if (!parseJsonString(cursor, end, task.description)) {
+                    return false;
+                }
+                described = true;
+            } else if (key == "completed") {
+                if (matchLiteral(cursor, end, "true")) {
+                    task.completed = true;
+                } else if (matchLiteral(cursor, end, "false")) {
+                    task.completed = false;
+                } else {
+                    return false;
+                }
+            } else if (key == "created_at" || key == "completed_at") {
+                std::int64_t timestamp = 0;
+                if (!matchLiteral(cursor, end, "null")) {
+                    if (!parseJsonString(cursor, end, value) ||
+                        !parseOptionalTimestamp(value, timestamp)) {
+                        return false;
+                    }
+                }
+                (key == "created_at" ? task.createdAt : task.completedAt) = timestamp;
+            } else if (!skipJsonValue(cursor, end, value)) {
+                return false;
+            }
+
+            skipSpace(cursor, end);
+            if (cursor == end) {
+                return false;
+            }
+            char separator = *cursor++;
+            if (separator == '}') {
+                break;
+            }
+            if (separator != ',') {
+                return false;
+            }
+        }
+        skipSpace(cursor, end);
+        return cursor == end && described;
+    }
+
+    // True while `record` ends inside a quoted CSV field, i.e. the field
+    // holds a line break and the next input line belongs to this record.
+    static bool isOpenCsvRecord(const std::string& record) {
+        return std::count(record.begin(), record.end(), '"') % 2 != 0;
+    }
+
+    // Splits one CSV record into unquoted fields.
+    static bool splitCsv(const std::string& record, std::vector<std::string>& fields) {
+        fields.assign(1, std::string());
+        bool quoted = false;
+        for (size_t i = 0; i < record.size(); ++i) {
+            char c = record[i];
+            if (quoted) {
+                if (c != '"') {
+                    fields.back() += c;
+                } else if (i + 1 < record.size() && record[i + 1] == '"') {
+                    fields.back() += '"';
+                    ++i;
+                } else {
+                    quoted = false;
+                }
+            } else if (c == '"' && fields.back().empty()) {
+                quoted = true;
+            } else if (c == ',') {
+                fields.emplace_back();
+            } else {
+                fields.back() += c;
+            }
+        }
+        return !quoted;
+    }
+
+    // Column positions of the CSV fields `import` reads, taken from the
+    // header row; npos for a column the file does not have.
+    struct CsvColumns {
+        size_t description;
+        size_t completed;
+        size_t createdAt;
+        size_t completedAt;
+
+        CsvColumns() : description(1), completed(2), createdAt(3), completedAt(4) {}
+
+        // False when `header` has no description column.
+        bool assign(const std::vector<std::string>& header) {
+            description = completed = createdAt = completedAt = std::string::npos;
+            for (size_t column = 0; column < header.size(); ++column) {
+                std::string name = header[column];
+                std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+                if (name == "description") {
+                    description = column;
+                } else if (name == "completed") {
+                    completed = column;
+                } else if (name == "created_at") {
+                    createdAt = column;
+                } else if (name == "completed_at") {
+                    completedAt = column;
+                }
+            }
+            return description != std::string::npos;
+        }
+    };
+
+    static bool parseCsv(const std::vector<std::string>& fields, const CsvColumns& columns,
+                         ImportedTask& task) {
+        auto field = [&fields](size_t column) {
+            return column < fields.size() ? fields[column] : std::string();
+        };
+        if (columns.description >= fields.size()) {
+            return false;
+        }
+        task.description = fields[columns.description];
+        std::string completed = field(columns.completed);
+        std::transform(completed.begin(), completed.end(), completed.begin(), ::tolower);
+        if (completed == "1" || completed == "true") {
+            task.completed = true;
+        } else if (completed.empty() || completed == "0" || completed == "false") {
+            task.completed = false;
+        } else {
+            return false;
+        }
+        return parseOptionalTimestamp(field(columns.createdAt), task.createdAt) &&
+               parseOptionalTimestamp(field(columns.completedAt), task.completedAt);
+    }
+
+private:
+    static void appendJsonString(ChunkedWriter& writer, StringRef text) {
+        static const char hex[] = "0123456789abcdef";
+        writer.append('"');
+        const char* run = text.data();
+        const char* end = text.data() + text.size();
+        for (const char* cursor = run; cursor != end; ++cursor) {
+            unsigned char c = static_cast<unsigned char>(*cursor);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            writer.append(run, static_cast<size_t>(cursor - run));
+            run = cursor + 1;
+            if (c == '"' || c == '\\') {
+                writer.append('\\').append(static_cast<char>(c));
+            } else if (c == '\n') {
+                writer.append(StringRef("\\n"));
+            } else if (c == '\t') {
+                writer.append(StringRef("\\t"));
+            } else {
+                char escape[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                writer.append(escape, sizeof(escape));
+            }
+        }
+        writer.append(run, static_cast<size_t>(end - run)).append('"');
+    }
+
+    // Quotes only fields that need it.
+    static void appendCsvField(ChunkedWriter& writer, StringRef text) {
+        const char* begin = text.data();
+        const char* end = text.data() + text.size();
+        if (std::find_if(begin, end, [](char c) {
+                return c == ',' || c == '"' || c == '\n' || c == '\r';
+            }) == end) {
+            writer.append(text);
+            return;
+        }
+        writer.append('"');
+        for (const char* cursor = begin; cursor != end; ++cursor) {
+            if (*cursor == '"') {
+                writer.append('"');
+            }
+            writer.append(*cursor);
+        }
+        writer.append('"');
+    }
+
+    static void skipSpace(const char*& cursor, const char* end) {
+        while (cursor != end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')) {
+            ++cursor;
+        }
+    }
+
+    static bool matchLiteral(const char*& cursor, const char* end, const char* literal) {
+        size_t length = std::strlen(literal);
+        if (static_cast<size_t>(end - cursor) < length || std::memcmp(cursor, literal, length) != 0) {
+            return false;
+        }
+        cursor += length;
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, std::uint32_t codePoint) {
+        if (codePoint < 0x80) {
+            out += static_cast<char>(codePoint);
+        } else if (codePoint < 0x800) {
+            out += static_cast<char>(0xC0 | (codePoint >> 6));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            out += static_cast<char>(0xE0 | (codePoint >> 12));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (codePoint >> 18));
+            out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    static bool parseHex4(const char*& cursor, const char* end, std::uint32_t& value) {
+        if (end - cursor < 4) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = *cursor++;
+            value <<= 4;
+            if (c >= '0' && c <= '9') {
+                value |= static_cast<std::uint32_t>(c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                value |= static_cast<std::uint32_t>(c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                value |= static_cast<std::uint32_t>(c - 'A' + 10);
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool parseJsonString(const char*& cursor, const char* end, std::string& out) {
+        out.clear();
+        if (cursor == end || *cursor++ != '"') {
+            return false;
+        }
+        while (cursor != end) {
+            const char* run = cursor;
+            while (cursor != end && *cursor != '"' && *cursor != '\\') {
+                ++cursor;
+            }
+            out.append(run, static_cast<size_t>(cursor - run));
+            if (cursor == end) {
+                return false;
+            }
+            if (*cursor++ == '"') {
+                return true;
+            }
+            if (cursor == end) {
+                return false;
+            }
+            char escape = *cursor++;
+            switch (escape) {
+            case '"': case '\\': case '/': out += escape; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                std::uint32_t codePoint = 0;
+                if (!parseHex4(cursor, end, codePoint)) {
+                    return false;
+                }
+                if (codePoint >= 0xD800 && codePoint < 0xDC00) {
+                    std::uint32_t low = 0;
+                    if (!matchLiteral(cursor, end, "\\u") || !parseHex4(cursor, end, low) ||
+                        low < 0xDC00 || low >= 0xE000) {
+                        return false;
+                    }
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(out, codePoint);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    // Skips a scalar value; objects and arrays are not accepted.
+    static bool skipJsonValue(const char*& cursor, const char* end, std::string& scratch) {
+        if (cursor != end && *cursor == '"') {
+            return parseJsonString(cursor, end, scratch);
+        }
+        const char* start = cursor;
+        while (cursor != end && *cursor != ',' && *cursor != '}' && *cursor != ' ' &&
+               *cursor != '{' && *cursor != '[') {
+            ++cursor;
+        }
+        return cursor != start && (cursor == end || (*cursor != '{' && *cursor != '['));
+    }
+
+    static bool parseOptionalTimestamp(const std::string& text, std::int64_t& timestamp) {
+        if (text.empty()) {
+            timestamp = 0;
+            return true;
+        }
+        timestamp = parseTimestamp(StringRef(text));
+        return timestamp != 0;
+    }
+};
+
+class TodoManager {
+private:
+    TaskStore tasks;
+    std::unique_ptr<StorageBackend> storage;
+    ShardedSearchIndex searchIndex;
+    TaskArchive archive;
+    std::shared_ptr<const StoreVersion> version; // see publishVersion()
+    InvertedIndex residentIndex;
+    bool residentIndexBuilt;
+    int archiveAfterDays; // negative: archive only on request
+    int nextId;
+    bool loaded;
+    bool batchActive;
+    bool batchDirty;
+    bool batchTransaction; // the batch's records go into a storage transaction
+    FileLock batchLock;
+
+public:
+    // The store is loaded on first use, so read-only commands such as a
+    // filtered list can stream from storage instead.
+    explicit TodoManager(std::unique_ptr<StorageBackend> stor)
+        : storage(std::move(stor)), searchIndex(*storage),
+          archive(storage->getFilename()), residentIndexBuilt(false), archiveAfterDays(-1),
+          nextId(1), loaded(false),
+          batchActive(false), batchDirty(false), batchTransaction(false) {}
+
+    // A resident store (server mode) also picks up what other processes
+    // wrote since the last command.
+    void ensureLoaded() {
+        if (!loaded) {
+            tasks = storage->loadTasks();
+            nextId = storage->getNextId();
+            loaded = true;
+        } else if (!batchActive) {
+            synchronize();
+        }
+    }
+
+    bool addTask(const std::string& description) {
+        if (isDescriptionEmpty(description)) {
+            std::cout << "Error: Task description cannot be empty." << std::endl;
+            return false;
+        }
+
+        // Without a loaded store the id comes from the snapshot header and
+        // the journal, and the task is only appended.
+        FileLock lock = beginMutation(StorageBackend::kNewTask);
+        if (!loaded && !storage->prepareAppend()) {
+            ensureLoaded();
+        }
+        if (!loaded) {
+            nextId = storage->getNextId();
+        }
+
+        CommandStats::Scope phase(CommandStats::Mutate);
+        int taskId = allocateTaskId();
+        Task newTask(taskId, trimString(description));
+        if (loaded) {
+            tasks.put(newTask.fields());
+        }
+
+        if (persistAdded(newTask)) {
+            indexAdded(taskId, newTask.getDescription());
+            std::cout << "Task added successfully with ID: " << taskId << std::endl;
+            return true;
+        }
+        return false;
+    }
+
+    // Served from memory once loaded; otherwise streamed from storage so
+    // that only the selected records are visited. With `archiveTerms` the
+    // archived tasks containing every term follow the live ones, and the
+    // page spans both.
+    void listTasks(const TaskFilter& filter = TaskFilter(),
+                   const std::vector<std::string>* archiveTerms = nullptr) const {
+        CommandStats::Scope phase(CommandStats::Render);
+
+        // The live part is not paged on its own when the archive follows:
+        // it renders up to offset + limit and skips the first offset here,
+        // so the archive knows how much of the page is left.
+        TaskFilter liveFilter = filter;
+        size_t skip = 0;
+        if (archiveTerms && filter.offset > 0) {
+            skip = filter.offset;
+            liveFilter.offset = 0;
+            if (filter.limit != TaskFilter::kUnlimited) {
+                liveFilter.limit = filter.offset + filter.limit;
+            }
+        }
+
+        ChunkedWriter writer(std::cout);
+        size_t matched = 0;
+        size_t shown = 0;
+        bool titled = false;
+        auto title = [&]() {
+            if (!titled) {
+                titled = true;
+                writer.append(StringRef("\n=== Todo List ===\n"));
+            }
+        };
+        auto render = [&](const TaskFields& fields) {
+            if (matched++ < skip) {
+                return;
+            }
+            title();
+            ++shown;
+            appendListLine(writer, fields);
+        };
+
+        if (loaded && filter.order != TaskFilter::Order::Stored) {
+            renderSorted(liveFilter, render);
+        } else if (loaded) {
+            FilterCursor cursor(liveFilter);
+            for (size_t slot = 0; slot < tasks.slotCount() && !cursor.isDone(); ++slot) {
+                if (!tasks.isRemoved(slot) &&
+                    cursor.accept(tasks.id(slot), tasks.isCompleted(slot), tasks.createdAt(slot))) {
+                    render(tasks.fieldsAt(slot));
+                }
+            }
+        } else {
+            storage->scanTasks(liveFilter, render);
+        }
+
+        if (archiveTerms && (filter.limit == TaskFilter::kUnlimited || shown < filter.limit)) {
+            TaskFilter archivedFilter = filter;
+            archivedFilter.ids = nullptr;
+            archivedFilter.offset = (matched < skip) ? skip - matched : 0;
+            if (filter.limit != TaskFilter::kUnlimited) {
+                archivedFilter.limit = filter.limit - shown;
+            }
+            skip = 0;
+            bool headed = false;
+            archive.scan(archivedFilter, *archiveTerms, storage->currentGeneration(),
+                         [&](const TaskFields& fields) {
+                if (!headed) {
+                    headed = true;
+                    title();
+                    writer.append(StringRef("--- Archived ---\n"));
+                }
+                render(fields);
+            });
+        }
+        finishListing(writer, std::cout, shown, filter);
+    }
+
+    // A stored-order listing of a published version, for a server read
+    // worker: the same output as listTasks, written to `out`.
+    static void listVersion(const StoreVersion& version, const TaskFilter& filter,
+                            std::ostream& out) {
+        ChunkedWriter writer(out);
+        size_t shown = 0;
+        version.scan(filter, [&](const TaskFields& fields) {
+            if (shown++ == 0) {
+                writer.append(StringRef("\n=== Todo List ===\n"));
+            }
+            appendListLine(writer, fields);
+        });
+        finishListing(writer, out, shown, filter);
+    }
+
+    // Streams the tasks `filter` selects as records, straight from storage
+    // unless the store is loaded, then the archived ones with
+    // `includeArchive`. Only the filter's predicate applies.
+    void exportTasks(const TaskFilter& filter, ExportFormat format, bool includeArchive) const {
+        CommandStats::Scope phase(CommandStats::Render);
+        ChunkedWriter writer(std::cout);
+        TaskRecordFormat::writeHeader(writer, format);
+        auto write = [&](const TaskFields& fields) {
+            TaskRecordFormat::write(writer, format, fields);
+        };
+        if (loaded) {
+            for (size_t slot = 0; slot < tasks.slotCount(); ++slot) {
+                if (!tasks.isRemoved(slot) &&
+                    filter.matches(tasks.id(slot), tasks.isCompleted(slot), tasks.createdAt(slot))) {
+                    write(tasks.fieldsAt(slot));
+                }
+            }
+        } else {
+            storage->scanTasks(filter, write);
+        }
+        if (includeArchive) {
+            archive.scan(filter, std::vector<std::string>(), storage->currentGeneration(), write);
+        }
+        writer.flush();
+        std::cout.flush();
+    }
+
+    // exportTasks for a server read worker, from a published version.
+    static void exportVersion(const StoreVersion& version, const TaskFilter& filter,
+                              ExportFormat format, std::ostream& out) {
+        ChunkedWriter writer(out);
+        TaskRecordFormat::writeHeader(writer, format);
+        version.scan(filter, [&](const TaskFields& fields) {
+            TaskRecordFormat::write(writer, format, fields);
+        });
+        writer.flush();
+        out.flush();
+    }
+
+    // Adds an imported record as a new task with its own status and times.
+    // Meant to run inside a batch, so an import is saved once.
+    bool importTask(const ImportedTask& record) {
+        std::string description = trimString(record.description);
+        // Journal and text lines end at a line break.
+        std::replace(description.begin(), description.end(), '\n', ' ');
+        std::replace(description.begin(), description.end(), '\r', ' ');
+        if (description.empty()) {
+            return false;
+        }
+
+        FileLock lock = beginMutation(StorageBackend::kNewTask);
+        CommandStats::Scope phase(CommandStats::Mutate);
+        int taskId = allocateTaskId();
+        const std::int64_t now = static_cast<std::int64_t>(std::time(nullptr));
+        std::int64_t createdAt = record.createdAt != 0 ? record.createdAt : now;
+        std::int64_t completedAt = 0;
+        if (record.completed) {
+            completedAt = record.completedAt != 0 ? record.completedAt : now;
+        }
+        Task task = Task::fromFields(TaskFields{taskId, StringRef(description), record.completed,
+                                                createdAt, completedAt});
+        tasks.put(task.fields());
+        if (!persistAdded(task)) {
+            return false;
+        }
+        indexAdded(taskId, task.getDescription());
+        return true;
+    }
+
+    // The version readers on other threads may use, current as of the
+    // last publishVersion(). Called on the thread that owns the manager.
+    std::shared_ptr<const StoreVersion> currentVersion() const { return version; }
+
+    // Publishes the loaded store after a mutation; chunks it did not touch
+    // are shared with the previous version.
+    void publishVersion() {
+        if (loaded) {
+            version = StoreVersion::publish(tasks, version);
+        }
+    }
+
+    static void appendListLine(ChunkedWriter& writer, const TaskFields& fields) {
+        static const StringRef done("✓");
+        static const StringRef pending("○");
+        writer.appendNumber(fields.id).append(StringRef(". ["))
+              .append(fields.completed ? done : pending).append(StringRef("] "))
+              .append(fields.description).append('\n');
+    }
+
+    static void finishListing(ChunkedWriter& writer, std::ostream& out, size_t shown,
+                              const TaskFilter& filter) {
+        if (shown == 0) {
+            writer.flush();
+            if (filter.selectsEverything()) {
+                out << "No tasks found. Add a task with 'add <description>'" << std::endl;
+            } else {
+                out << "No tasks match the given filters." << std::endl;
+            }
+            return;
+        }
+        writer.append('\n');
+        writer.flush();
+        out.flush();
+    }
+
+    // A resident store is ordered on demand; only the requested page is
+    // sorted, so a top-k listing costs O(n log k).
+    template <typename Render>
+    void renderSorted(const TaskFilter& filter, Render& render) const {
+        std::vector<size_t> matched;
+        for (size_t slot = 0; slot < tasks.slotCount(); ++slot) {
+            if (!tasks.isRemoved(slot) &&
+                filter.matches(tasks.id(slot), tasks.isCompleted(slot), tasks.createdAt(slot))) {
+                matched.push_back(slot);
+            }
+        }
+        size_t first = std::min(filter.offset, matched.size());
+        size_t last = (filter.limit == TaskFilter::kUnlimited)
+            ? matched.size() : std::min(matched.size(), first + filter.limit);
+        auto key = [&](size_t slot) {
+            return TaskFilter::sortKey(filter.order, tasks.id(slot), tasks.createdAt(slot),
+                                       tasks.completedAt(slot));
+        };
+        std::partial_sort(matched.begin(), matched.begin() + last, matched.end(),
+                          [&](size_t a, size_t b) { return key(a) < key(b); });
+        for (size_t i = first; i < last; ++i) {
+            render(tasks.fieldsAt(matched[i]));
+        }
+    }
+
+    // Answers from the persisted index without loading the store; a
+    // resident store (server mode) keeps its own in-memory index instead.
+    // The archive has no index; with `includeArchive` its blocks are
+    // decompressed and their descriptions tokenized one by one.
+    void searchTasks(const std::string& query, bool includeArchive = false) {
+        std::vector<std::string> terms = tokenize(query);
+        if (terms.empty()) {
+            std::cout << "Error: Please provide search terms." << std::endl;
+            return;
+        }
+
+        std::vector<int> ids;
+        if (loaded) {
+            if (!residentIndexBuilt) {
+                CommandStats::Scope phase(CommandStats::Index);
+                residentIndex.build(tasks);
+                residentIndexBuilt = true;
+            }
+            ids = residentIndex.query(terms);
+        } else {
+            if (!searchIndex.exists()) {
+                ensureLoaded();
+                FileLock lock = lockStore();
+                if (!searchIndex.rebuild(tasks)) {
+                    return;
+                }
+            }
+            ids = searchIndex.query(terms);
+        }
+
+        if (ids.empty() && !includeArchive) {
+            std::cout << "No tasks match \"" << query << "\"." << std::endl;
+            return;
+        }
+        TaskFilter filter;
+        filter.ids = &ids;
+        listTasks(filter, includeArchive ? &terms : nullptr);
+    }
+
+    bool rebuildSearchIndex() {
+        ensureLoaded();
+        FileLock lock = lockStore();
+        if (!searchIndex.rebuild(tasks)) {
+            return false;
+        }
+        std::cout << "Search index rebuilt for " << tasks.size() << " task(s)." << std::endl;
+        return true;
+    }
+
+    bool completeTask(int taskId) {
+        FileLock lock = beginMutation(taskId);
+        CommandStats::Scope phase(CommandStats::Mutate);
+        std::unique_ptr<Task> task = findTask(taskId);
+        if (!task) {
+            std::cout << "Error: Task with ID " << taskId << " not found." << std::endl;
+            return false;
+        }
+
+        if (task->getIsCompleted()) {
+            std::cout << "Task " << taskId << " is already completed." << std::endl;
+            return false;
+        }
+
+        task->markComplete();
+        if (loaded) {
+            tasks.markCompleted(tasks.find(taskId), task->getCompletedAt());
+        }
+        if (persistCompleted(*task)) {
+            std::cout << "Task " << taskId << " marked as completed." << std::endl;
+            return true;
+        }
+        return false;
+    }
+
+    bool removeTask(int taskId) {
+        FileLock lock = beginMutation(taskId);
+        CommandStats::Scope phase(CommandStats::Mutate);
+        std::unique_ptr<Task> task = findTask(taskId);
+        if (!task) {
+            std::cout << "Error: Task with ID " << taskId << " not found." << std::endl;
+            return false;
+        }
+
+        if (loaded) {
+            tasks.erase(tasks.find(taskId));
+        }
+        if (persistRemoved(taskId)) {
+            indexRemoved(taskId, task->getDescription());
+            std::cout << "Task " << taskId << " removed successfully." << std::endl;
+            return true;
+        }
+        return false;
+    }
+
+    // Between beginBatch and commitBatch mutations only touch memory;
+    // commitBatch then writes a single snapshot (and fsync) for all of them. The write
+    // lock is held for the whole batch so the snapshot cannot drop records
+    // appended by other processes. A storage with transactions instead
+    // records each mutation inside one transaction, committed at the end.
+    void beginBatch() {
+        ensureLoaded();
+        batchLock = lockStore();
+        batchActive = true;
+        batchTransaction = storage->getDurability() != Durability::Op &&
+                           storage->beginTransaction();
+    }
+
+    bool commitBatch() {
+        if (batchDirty) {
+            archiveExpired();
+        }
+        batchActive = false;
+        flushSearchIndex();
+        bool saved = true;
+        if (batchTransaction) {
+            batchTransaction = false;
+            saved = storage->commitTransaction();
+        }
+        if (batchDirty) {
+            batchDirty = false;
+            saved = storage->saveTasks(tasks);
+        }
+        batchLock.release();
+        return saved;
+    }
+
+    bool isLoaded() const { return loaded; }
+    size_t taskCount() const { return tasks.size(); }
+
+    bool migrateStorage(StorageFormat format) {
+        ensureLoaded();
+        FileLock lock = lockStore();
+        const char* formatName = (format == StorageFormat::Binary) ? "binary" : "text";
+        storage->setFormat(format);
+        if (storage->saveTasks(tasks)) {
+            std::cout << "Migrated " << tasks.size() << " task(s) to " << formatName
+                      << " format." << std::endl;
+            return true;
+        }
+        return false;
+    }
+
+    // Moves the store to `target`, another layout at the same path (a
+    // different shard count, or SQLite), and then deletes the old layout's
+    // files, so a crash leaves one complete layout or the other. Ids, times
+    // and the generation sequence carry over; the caller picks the
+    // target's format. `layout` names it in the report. Run it while no
+    // other process uses the store.
+    bool migrateLayout(std::unique_ptr<StorageBackend> target, const std::string& layout) {
+        ensureLoaded();
+        FileLock lock = lockStore();
+        FileLock targetLock = target->lockForWrite();
+        target->setDurability(storage->getDurability());
+        target->setIoMode(storage->getIoMode());
+        target->continueGeneration(storage->getGeneration());
+        if (nextId > 1) {
+            target->reserveId(nextId - 1);
+        }
+        flushSearchIndex();
+        bool indexed = searchIndex.exists();
+        if (!target->saveTasks(tasks)) {
+            target->removeFiles();
+            return false;
+        }
+        searchIndex.remove();
+        storage->removeFiles();
+        storage = std::move(target);
+        searchIndex = ShardedSearchIndex(*storage);
+        if (indexed) {
+            searchIndex.rebuild(tasks);
+        }
+        std::cout << "Migrated " << tasks.size() << " task(s) to " << layout << "." << std::endl;
+        return true;
+    }
+
+    size_t shardCount() const { return storage->shardCount(); }
+    StorageFormat storageFormat() const { return storage->getFormat(); }
+
+    // Bulk forms of completeTask and removeTask: every task in `selection`
+    // that passes `filter` is changed in one pass over the loaded store and
+    // saved once, as in a batch. Explicitly named ids that do not exist are
+    // reported; gaps inside ranges are not.
+    bool completeMatching(const IdSelection& selection, const TaskFilter& filter) {
+        return applyToMatching(selection, filter, false);
+    }
+
+    bool removeMatching(const IdSelection& selection, const TaskFilter& filter) {
+        return applyToMatching(selection, filter, true);
+    }
+
+    // Folds the journal into a fresh snapshot and packs the tombstoned
+    // slots of the resident store, whatever the automatic thresholds say.
+    bool compactStore() {
+        ensureLoaded();
+        FileLock lock = lockStore();
+        size_t tombstones = tasks.tombstoneCount();
+        std::streamoff journalBytes = storage->journalBytes();
+        size_t archived = archiveExpired();
+        flushSearchIndex();
+        tasks.compact();
+        if (storage->saveTasks(tasks)) {
+            std::cout << "Compacted " << tasks.size() << " task(s): folded " << journalBytes
+                      << " journal byte(s), reclaimed " << tombstones << " removed slot(s)";
+            if (archived > 0) {
+                std::cout << ", archived " << archived << " completed task(s)";
+            }
+            std::cout << "." << std::endl;
+            return true;
+        }
+        return false;
+    }
+
+    // Completed tasks older than TODO_ARCHIVE_DAYS days are also moved
+    // whenever a batch, `compact` or a journal compaction rewrites the
+    // snapshot anyway.
+    void setArchivePolicy(int days) { archiveAfterDays = days; }
+
+    // Moves tasks completed more than `days` days ago to the archive and
+    // saves the store without them.
+    bool archiveCompleted(int days) {
+        ensureLoaded();
+        FileLock lock = lockStore();
+        size_t moved = 0;
+        if (!moveToArchive(days, moved)) {
+            return false;
+        }
+        flushSearchIndex();
+        if (moved == 0) {
+            std::cout << "No tasks completed more than " << days << " day(s) ago to archive."
+                      << std::endl;
+            return true;
+        }
+        if (!storage->saveTasks(tasks)) {
+            return false;
+        }
+        std::cout << "Archived " << moved << " task(s) to " << archive.getFilename() << " ("
+                  << archive.count(storage->getGeneration()) << " archived in total)." << std::endl;
+        return true;
+    }
+
+private:
+    // Takes the qualifying tasks out of the loaded store once the archive
+    // holds them; the caller saves the store, which commits the new blocks.
+    // False (with the store untouched) when the archive cannot be written.
+    bool moveToArchive(int days, size_t& moved) {
+        CommandStats::Scope phase(CommandStats::Mutate);
+        const std::int64_t cutoff =
+            static_cast<std::int64_t>(std::time(nullptr)) - std::int64_t(days) * 24 * 60 * 60;
+        std::vector<Task> records;
+        for (size_t slot = 0; slot < tasks.slotCount(); ++slot) {
+            if (!tasks.isRemoved(slot) && tasks.isCompleted(slot) && tasks.completedAt(slot) <= cutoff) {
+                records.push_back(tasks.toTask(slot));
+            }
+        }
+        moved = records.size();
+        if (records.empty()) {
+            return true;
+        }
+        std::uint64_t generation = storage->getGeneration();
+        if (!archive.append(records, generation, generation + 1, storage->getDurability(),
+                            storage->getIoMode())) {
+            moved = 0;
+            return false;
+        }
+        for (const Task& task : records) {
+            if (residentIndexBuilt) {
+                residentIndex.remove(task.getId(), task.getDescription());
+            }
+            searchIndex.stageRemoved(task.getId(), task.getDescription());
+            tasks.erase(tasks.find(task.getId()));
+        }
+        return true;
+    }
+
+    // Applies TODO_ARCHIVE_DAYS to a loaded store that is about to be
+    // saved; returns the number of tasks moved.
+    size_t archiveExpired() {
+        size_t moved = 0;
+        if (archiveAfterDays < 0 || !moveToArchive(archiveAfterDays, moved)) {
+            return 0;
+        }
+        return moved;
+    }
+
+    bool applyToMatching(const IdSelection& selection, const TaskFilter& filter, bool remove) {
+        beginBatch();
+        std::vector<int> matched;
+        size_t alreadyCompleted = 0;
+        {
+            CommandStats::Scope phase(CommandStats::Mutate);
+            for (const auto& range : selection.ranges) {
+                if (range.first == range.second && tasks.find(range.first) == TaskStore::npos) {
+                    std::cout << "Error: Task with ID " << range.first << " not found." << std::endl;
+                }
+            }
+            // Slots are collected first: erasing may compact the store.
+            for (size_t slot = 0; slot < tasks.slotCount(); ++slot) {
+                if (tasks.isRemoved(slot) || !selection.contains(tasks.id(slot)) ||
+                    !filter.matches(tasks.id(slot), tasks.isCompleted(slot), tasks.createdAt(slot))) {
+                    continue;
+                }
+                if (!remove && tasks.isCompleted(slot)) {
+                    ++alreadyCompleted;
+                    continue;
+                }
+                matched.push_back(tasks.id(slot));
+            }
+        }
+
+        bool persisted = true;
+        for (int taskId : matched) {
+            CommandStats::Scope phase(CommandStats::Mutate);
+            size_t slot = tasks.find(taskId);
+            if (remove) {
+                std::string description = tasks.description(slot).str();
+                tasks.erase(slot);
+                persisted = persistRemoved(taskId) && persisted;
+                indexRemoved(taskId, description);
+            } else {
+                Task task = tasks.toTask(slot);
+                task.markComplete();
+                tasks.markCompleted(slot, task.getCompletedAt());
+                persisted = persistCompleted(task) && persisted;
+            }
+        }
+        if (!commitBatch() || !persisted) {
+            return false;
+        }
+
+        std::cout << (remove ? "Removed " : "Completed ") << matched.size() << " task(s)";
+        if (alreadyCompleted > 0) {
+            std::cout << "; " << alreadyCompleted << " already completed";
+        }
+        std::cout << "." << std::endl;
+        return !matched.empty();
+    }
+
+    // Takes the write lock and catches up a loaded store with other
+    // writers, so ids and the journal stay consistent across processes.
+    // Callers that need the whole store load it first, outside the lock.
+    // Inside a batch the lock is already held.
+    FileLock lockStore() {
+        if (batchActive) {
+            return FileLock();
+        }
+        return synchronized(storage->lockForWrite());
+    }
+
+    // A single add, complete or remove on a journaled store that is not
+    // loaded is applied as one journal append, without parsing the store.
+    // Only what the mutation of `taskId` writes is locked.
+    FileLock beginMutation(int taskId) {
+        if (!storage->isJournaled()) {
+            ensureLoaded();
+        }
+        if (batchActive) {
+            return FileLock();
+        }
+        return synchronized(storage->lockForTask(taskId));
+    }
+
+    FileLock synchronized(FileLock lock) {
+        if (loaded) {
+            synchronize();
+        }
+        return lock;
+    }
+
+    std::unique_ptr<Task> findTask(int taskId) const {
+        if (!loaded) {
+            return storage->findTask(taskId);
+        }
+        size_t slot = tasks.find(taskId);
+        return slot == TaskStore::npos ? nullptr : std::make_unique<Task>(tasks.toTask(slot));
+    }
+
+    void synchronize() {
+        if (storage->refresh(tasks)) {
+            residentIndexBuilt = false;
+            nextId = std::max(nextId, storage->getNextId());
+        }
+    }
+
+    // Index changes are staged per mutation and written with the mutation,
+    // or once per batch.
+    void indexAdded(int taskId, StringRef description) {
+        if (residentIndexBuilt) {
+            residentIndex.add(taskId, description);
+        }
+        searchIndex.stageAdded(taskId, description);
+        if (!batchActive) {
+            flushSearchIndex();
+        }
+    }
+
+    void indexRemoved(int taskId, StringRef description) {
+        if (residentIndexBuilt) {
+            residentIndex.remove(taskId, description);
+        }
+        searchIndex.stageRemoved(taskId, description);
+        if (!batchActive) {
+            flushSearchIndex();
+        }
+    }
+
+    void flushSearchIndex() {
+        if (searchIndex.flush()) {
+            ensureLoaded();
+            searchIndex.rebuildOverdue(tasks);
+        }
+    }
+
+    // A batch folds its mutations into one snapshot unless every operation
+    // has to be durable on its own.
+    bool defersWrites() const {
+        return batchActive && !batchTransaction && storage->getDurability() != Durability::Op;
+    }
+
+    bool persistAdded(const Task& task) {
+        if (defersWrites()) {
+            batchDirty = true;
+            return true;
+        }
+        std::uint64_t generation = storage->getGeneration();
+        return applyArchivePolicy(generation,
+                                  storage->recordAdded(task, loaded ? &tasks : nullptr));
+    }
+
+    bool persistCompleted(const Task& task) {
+        if (defersWrites()) {
+            batchDirty = true;
+            return true;
+        }
+        std::uint64_t generation = storage->getGeneration();
+        return applyArchivePolicy(generation,
+                                  storage->recordCompleted(task, loaded ? &tasks : nullptr));
+    }
+
+    bool persistRemoved(int taskId) {
+        if (defersWrites()) {
+            batchDirty = true;
+            return true;
+        }
+        std::uint64_t generation = storage->getGeneration();
+        return applyArchivePolicy(generation,
+                                  storage->recordRemoved(taskId, loaded ? &tasks : nullptr));
+    }
+
+    // A record that compacted the journal into a new snapshot is followed
+    // by the TODO_ARCHIVE_DAYS pass, so the policy needs no explicit
+    // command. A sharded store only holds one shard's lock here; it
+    // applies the policy on batches, `compact` and `archive`.
+    bool applyArchivePolicy(std::uint64_t generationBefore, bool recorded) {
+        if (!recorded || archiveAfterDays < 0 || storage->getGeneration() == generationBefore ||
+            storage->shardCount() > 1) {
+            return recorded;
+        }
+        ensureLoaded();
+        if (archiveExpired() == 0) {
+            return true;
+        }
+        if (!batchActive) {
+            flushSearchIndex();
+        }
+        return storage->saveTasks(tasks);
+    }
+
+    int allocateTaskId() {
+        int taskId = storage->claimId(nextId);
+        nextId = taskId + 1;
+        return taskId;
+    }
+
+    bool isDescriptionEmpty(const std::string& description) const {
+        return trimString(description).empty();
+    }
+
+    std::string trimString(const std::string& str) const {
+        size_t start = str.find_first_not_of(" \t\n\r");
+        if (start == std::string::npos) {
+            return "";
+        }
+        size_t end = str.find_last_not_of(" \t\n\r");
+        return str.substr(start, end - start + 1);
+    }
+};
+
+// Wire format shared by TodoServer and TodoClient. A request is the
+// argument count, each argument length-prefixed, then optional input for
+// `batch` until the client shuts down its write side:
+//   <argc>\n { <length>\n<bytes> } <stdin bytes...>
+// The response is the command's output, ending when the server closes.
+struct ServerRequest {
+    std::vector<std::string> args;
+    std::string input;
+
+    std::string encode() const {
+        std::string wire = std::to_string(args.size()) + "\n";
+        for (const auto& arg : args) {
+            wire += std::to_string(arg.size()) + "\n" + arg;
+        }
+        return wire + input;
+    }
+
+    static bool decode(const std::string& wire, ServerRequest& request) {
+        size_t cursor = 0;
+        size_t count = 0;
+        if (!readLength(wire, cursor, count)) {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            size_t length = 0;
+            if (!readLength(wire, cursor, length) || wire.size() - cursor < length) {
+                return false;
+            }
+            request.args.push_back(wire.substr(cursor, length));
+            cursor += length;
+        }
+        request.input = wire.substr(cursor);
+        return true;
+    }
+
+private:
+    static bool readLength(const std::string& wire, size_t& cursor, size_t& value) {
+        size_t newline = wire.find('\n', cursor);
+        int parsed = 0;
+        if (newline == std::string::npos ||
+            !parseTaskId(wire.data() + cursor, wire.data() + newline, parsed)) {
+            return false;
+        }
+        value = static_cast<size_t>(parsed);
+        cursor = newline + 1;
+        return true;
+    }
+};
+
+#ifndef _WIN32
+inline bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = ::send(fd, data, length, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// Reads until the peer shuts down its write side. Fails with ETIMEDOUT
+// once `timeoutMs` has passed in all, so a peer that goes quiet (or
+// trickles bytes) cannot hold the reader.
+inline bool readAll(int fd, std::string& out, int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    char buffer[64 * 1024];
+    for (;;) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        pollfd pending = {fd, POLLIN, 0};
+        int ready = left > 0 ? ::poll(&pending, 1, static_cast<int>(left)) : 0;
+        if (ready == 0) {
+            errno = ETIMEDOUT;
+            return false;
+        }
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        ssize_t received = ::read(fd, buffer, sizeof(buffer));
+        if (received == 0) {
+            return true;
+        }
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        out.append(buffer, static_cast<size_t>(received));
+    }
+}
+
+inline bool makeSocketAddress(const std::string& path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+inline int connectToSocket(const std::string& path) {
+    sockaddr_un address;
+    if (!makeSocketAddress(path, address)) {
+        return -1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+static volatile std::sig_atomic_t serverStopRequested = 0;
+
+// Keeps one TodoManager resident and serves CLI invocations over a Unix
+// domain socket. Requests run one at a time on the server thread; output
+// written to std::cout and std::cerr while handling one is sent back to
+// the client. A read handler may instead turn a request into a job that
+// renders its whole response on a worker thread, from a snapshot taken
+// when the request arrived, so long listings overlap with each other and
+// with the writes that follow them.
+class TodoServer {
+public:
+    using Handler = std::function<void(int, char**)>;
+    using ReadJob = std::function<std::string()>;
+    // Returns an empty job when the request has to run on the server thread.
+    using ReadHandler = std::function<ReadJob(int, char**)>;
+
+private:
+    static constexpr int kDefaultRequestTimeoutMs = 5000;
+
+    std::string socketPath;
+    Handler handler;
+    ReadHandler readHandler;
+    int requestTimeoutMs;
+
+#ifndef _WIN32
+    // Fixed set of worker threads; each job answers and closes one client.
+    class ReadPool {
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::pair<int, ReadJob>> queue;
+        std::mutex mutex;
+        std::condition_variable ready;
+        bool stopping;
+
+    public:
+        explicit ReadPool(size_t threadCount) : stopping(false) {
+            for (size_t i = 0; i < threadCount; ++i) {
+                workers.emplace_back([this]() { work(); });
+            }
+        }
+
+        // Finishes the queued jobs before returning.
+        ~ReadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            ready.notify_all();
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+        void submit(int client, ReadJob job) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.emplace_back(client, std::move(job));
+            }
+            ready.notify_one();
+        }
+
+    private:
+        void work() {
+            for (;;) {
+                std::pair<int, ReadJob> next;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    ready.wait(lock, [this]() { return stopping || !queue.empty(); });
+                    if (queue.empty()) {
+                        return;
+                    }
+                    next = std::move(queue.front());
+                    queue.pop_front();
+                }
+                std::string response;
+                try {
+                    response = next.second();
+                } catch (const std::exception& e) {
+                    response = std::string("Error: ") + e.what() + "\n";
+                }
+                writeAll(next.first, response.data(), response.size());
+                ::close(next.first);
+            }
+        }
+    };
+#endif
+
+public:
+    TodoServer(const std::string& path, Handler requestHandler,
+               ReadHandler requestReadHandler = ReadHandler())
+        : socketPath(path), handler(std::move(requestHandler)),
+          readHandler(std::move(requestReadHandler)), requestTimeoutMs(kDefaultRequestTimeoutMs) {}
+
+    // How long a client may take to send its request, and to take each
+    // part of the response, before the server gives up on it.
+    void setRequestTimeout(int milliseconds) { requestTimeoutMs = milliseconds; }
+
+    bool run() {
+#ifdef _WIN32
+        std::cout << "Error: Server mode is not supported on this platform." << std::endl;
+        return false;
+#else
+        int listener = openListener();
+        if (listener < 0) {
+            return false;
+        }
+
+        installStopHandlers();
+        std::cout << "Serving todo requests on " << socketPath << std::endl;
+
+        ReadPool readers(readHandler ? std::max(1u, std::thread::hardware_concurrency()) : 0);
+        while (!serverStopRequested) {
+            int client = ::accept(listener, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Error: Failed to accept connection." << std::endl;
+                break;
+            }
+            handleConnection(client, readers);
+        }
+
+        ::close(listener);
+        ::unlink(socketPath.c_str());
+        std::cout << "Server stopped." << std::endl;
+        return true;
+#endif
+    }
+
+private:
+#ifndef _WIN32
+    int openListener() const {
+        int existing = connectToSocket(socketPath);
+        if (existing >= 0) {
+            ::close(existing);
+            std::cout << "Error: A server is already running on " << socketPath << std::endl;
+            return -1;
+        }
+        ::unlink(socketPath.c_str()); // Stale socket left behind by a crashed server.
+
+        sockaddr_un address;
+        if (!makeSocketAddress(socketPath, address)) {
+            std::cout << "Error: Socket path is too long: " << socketPath << std::endl;
+            return -1;
+        }
+
+        int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0 ||
+            ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listener, SOMAXCONN) != 0) {
+            std::cout << "Error: Unable to listen on " << socketPath << std::endl;
+            if (listener >= 0) {
+                ::close(listener);
+            }
+            return -1;
+        }
+        return listener;
+    }
+
+    static void installStopHandlers() {
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_handler = [](int) { serverStopRequested = 1; };
+        sigemptyset(&action.sa_mask);
+        ::sigaction(SIGINT, &action, nullptr);
+        ::sigaction(SIGTERM, &action, nullptr);
+    }
+
+    // Answers and closes the client, here or through a read worker.
+    void handleConnection(int client, ReadPool& readers) {
+        timeval sendTimeout = {requestTimeoutMs / 1000, (requestTimeoutMs % 1000) * 1000};
+        ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+
+        std::string wire;
+        ServerRequest request;
+        bool received = readAll(client, wire, requestTimeoutMs);
+        if (!received || !ServerRequest::decode(wire, request)) {
+            const char* error = !received && errno == ETIMEDOUT
+                                    ? "Error: Timed out waiting for the request.\n"
+                                    : "Error: Malformed request.\n";
+            writeAll(client, error, std::strlen(error));
+            ::close(client);
+            return;
+        }
+
+        std::vector<char*> argv;
+        static char programName[] = "todo";
+        argv.push_back(programName);
+        for (auto& arg : request.args) {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+
+        if (readHandler) {
+            ReadJob job = readHandler(static_cast<int>(argv.size() - 1), argv.data());
+            if (job) {
+                readers.submit(client, std::move(job));
+                return;
+            }
+        }
+
+        std::ostringstream output;
+        std::istringstream input(request.input);
+        std::streambuf* previousOut = std::cout.rdbuf(output.rdbuf());
+        std::streambuf* previousErr = std::cerr.rdbuf(output.rdbuf());
+        std::streambuf* previousIn = std::cin.rdbuf(input.rdbuf());
+        try {
+            handler(static_cast<int>(argv.size() - 1), argv.data());
+        } catch (const std::exception& e) {
+            output << "Error: " << e.what() << std::endl;
+        }
+        std::cout.rdbuf(previousOut);
+        std::cerr.rdbuf(previousErr);
+        std::cin.rdbuf(previousIn);
+
+        std::string response = output.str();
+        writeAll(client, response.data(), response.size());
+        ::close(client);
+    }
+#endif
+};
+
+// Forwards a CLI invocation to a running TodoServer, if there is one.
+class TodoClient {
+private:
+    static constexpr int kDefaultResponseTimeoutMs = 60000;
+
+    std::string socketPath;
+    int responseTimeoutMs;
+
+public:
+    explicit TodoClient(const std::string& path)
+        : socketPath(path), responseTimeoutMs(kDefaultResponseTimeoutMs) {}
+
+    // How long to wait for the server to answer. The request may still
+    // run after that, so the command is not retried in-process.
+    void setResponseTimeout(int milliseconds) { responseTimeoutMs = milliseconds; }
+
+    // Returns false when no server is listening so the caller can run the
+    // command in-process instead.
+    bool forward(int argc, char* argv[]) const {
+#ifdef _WIN32
+        (void)argc;
+        (void)argv;
+        return false;
+#else
+        if (argc >= 2 && std::string(argv[1]) == "serve") {
+            return false;
+        }
+
+        int fd = connectToSocket(socketPath);
+        if (fd < 0) {
+            return false;
+        }
+
+        ServerRequest request;
+        for (int i = 1; i < argc; ++i) {
+            request.args.push_back(argv[i]);
+        }
+        if (!attachBatchInput(request)) {
+            ::close(fd);
+            return true;
+        }
+
+        timeval sendTimeout = {responseTimeoutMs / 1000, (responseTimeoutMs % 1000) * 1000};
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+        std::string wire = request.encode();
+        std::string response;
+        bool delivered = writeAll(fd, wire.data(), wire.size()) &&
+                         ::shutdown(fd, SHUT_WR) == 0 &&
+                         readAll(fd, response, responseTimeoutMs);
+        bool timedOut = !delivered && (errno == ETIMEDOUT || errno == EAGAIN ||
+                                       errno == EWOULDBLOCK);
+        ::close(fd);
+
+        if (timedOut) {
+            std::cerr << "Error: The todo server on " << socketPath << " did not answer in time."
+                      << std::endl;
+        } else if (!delivered) {
+            std::cerr << "Error: Lost connection to todo server." << std::endl;
+        }
+        std::cout << response << std::flush;
+        return true;
+#endif
+    }
+
+private:
+    // The server cannot see the client's stdin or working directory, so
+    // batch and import input is read here and shipped with the request.
+    static bool attachBatchInput(ServerRequest& request) {
+        if (!request.args.empty() && request.args[0] == "import") {
+            return attachImportInput(request);
+        }
+        if (request.args.empty() ||
+            (request.args[0] != "batch" && request.args[0] != "--stdin")) {
+            return true;
+        }
+
+        if (request.args.size() >= 2) {
+            std::ifstream file(request.args[1], std::ios::binary);
+            if (!file.is_open()) {
+                std::cout << "Error: Unable to open batch file: " << request.args[1] << std::endl;
+                return false;
+            }
+            request.input.assign(std::istreambuf_iterator<char>(file),
+                                 std::istreambuf_iterator<char>());
+            request.args.resize(1);
+        } else {
+            request.input.assign(std::istreambuf_iterator<char>(std::cin),
+                                 std::istreambuf_iterator<char>());
+        }
+        return true;
+    }
+
+    // A file argument is replaced by its contents, with --format csv made
+    // explicit when the name was what selected CSV.
+    static bool attachImportInput(ServerRequest& request) {
+        std::vector<std::string> args(1, request.args[0]);
+        std::string path;
+        bool formatGiven = false;
+        for (size_t i = 1; i < request.args.size(); ++i) {
+            std::string option = request.args[i];
+            std::transform(option.begin(), option.end(), option.begin(), ::tolower);
+            if (option == "--format" && i + 1 < request.args.size()) {
+                args.push_back(request.args[i]);
+                args.push_back(request.args[++i]);
+                formatGiven = true;
+            } else if (path.empty() && !option.empty() && option[0] != '-') {
+                path = request.args[i];
+                if (!formatGiven && option.size() > 4 &&
+                    option.compare(option.size() - 4, 4, ".csv") == 0) {
+                    args.push_back("--format");
+                    args.push_back("csv");
+                    formatGiven = true;
+                }
+            } else {
+                args.push_back(request.args[i]);
+            }
+        }
+
+        if (path.empty()) {
+            request.input.assign(std::istreambuf_iterator<char>(std::cin),
+                                 std::istreambuf_iterator<char>());
+        } else {
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open()) {
+                std::cout << "Error: Unable to open import file: " << path << std::endl;
+                return false;
+            }
+            request.input.assign(std::istreambuf_iterator<char>(file),
+                                 std::istreambuf_iterator<char>());
+        }
+        request.args = args;
+        return true;
+    }
+};
+
+// Where the store lives and how it is laid out: `--store PATH` and
+// `--shards N` before the command, or TODO_STORE and TODO_SHARDS. The shard
+// count applies when a store is created; a command that asks an existing
+// store for a different count is refused until `migrate --shards N`.
+struct StoreOptions {
+    std::string path;
+    size_t shards; // 0: the layout on disk, or a single file for a new store
+
+    StoreOptions() : path("todos.txt"), shards(0) {}
+
+    // The server socket sits next to the store: todos.txt is served on
+    // todos.sock.
+    std::string socketPath() const {
+        std::string base = path;
+        if (base.size() > 4 && base.compare(base.size() - 4, 4, ".txt") == 0) {
+            base.resize(base.size() - 4);
+        }
+        return base + ".sock";
+    }
+
+    // Reads the environment, then takes the options in front of the
+    // command out of argv; `args` gets the rest. False after reporting a
+    // malformed option.
+    bool parse(int argc, char* argv[], std::vector<char*>& args) {
+        const char* storePath = std::getenv("TODO_STORE");
+        if (storePath && *storePath) {
+            path = storePath;
+        }
+        const char* shardCount = std::getenv("TODO_SHARDS");
+        if (shardCount && *shardCount && !parseShardCount(shardCount, shards)) {
+            std::cerr << "Error: Unknown TODO_SHARDS '" << shardCount << "'; expected 1 to "
+                      << ShardedStorage::kMaxShards << ". Using the store's layout." << std::endl;
+        }
+
+        args.assign(argv, argv + std::min(argc, 1));
+        int i = 1;
+        for (; i < argc; i += 2) {
+            std::string option = argv[i];
+            if (option != "--store" && option != "--shards") {
+                break;
+            }
+            if (i + 1 >= argc || (option == "--store" && !*argv[i + 1]) ||
+                (option == "--shards" && !parseShardCount(argv[i + 1], shards))) {
+                std::cout << "Error: Please provide " << (option == "--store" ? "a path" : "a shard count from 1 to 64")
+                          << " after " << option << "." << std::endl;
+                std::cout << "Usage: ./todo [--store PATH] [--shards N] <command> [arguments]"
+                          << std::endl;
+                return false;
+            }
+            if (option == "--store") {
+                path = argv[i + 1];
+            }
+        }
+        args.insert(args.end(), argv + std::min(i, argc), argv + argc);
+        return true;
+    }
+
+    static bool parseShardCount(const char* text, size_t& count) {
+        int value = 0;
+        if (!parseTaskId(text, text + std::strlen(text), value) || value < 1 ||
+            static_cast<size_t>(value) > ShardedStorage::kMaxShards) {
+            return false;
+        }
+        count = static_cast<size_t>(value);
+        return true;
+    }
+
+    // An SQLite store sits in "<path>.sqlite" (see SqliteStorage).
+    static bool hasDatabase(const std::string& file) {
+        return std::ifstream(file + ".sqlite").is_open();
+    }
+
+    static std::unique_ptr<StorageBackend> openDatabase(const std::string& file) {
+#ifdef TODO_WITH_SQLITE
+        return std::make_unique<SqliteStorage>(file);
+#else
+        throw std::runtime_error("This build has no SQLite support for " + file +
+                                 ".sqlite; build with -DTODO_WITH_SQLITE and -lsqlite3.");
+#endif
+    }
+
+    // The layout found at `path`: a shard manifest, the files of a single
+    // store, or nothing yet, in which case `shards` decides.
+    size_t existingShards() const {
+        size_t count = 0;
+        std::uint64_t base = 0;
+        if (ShardedStorage::readManifest(path, count, base)) {
+            return count;
+        }
+        return TodoStorage::hasFiles(path) ? 1 : 0;
+    }
+
+    static std::unique_ptr<StorageBackend> openLayout(const std::string& file, size_t count) {
+        if (count <= 1) {
+            return std::make_unique<TodoStorage>(file);
+        }
+        return std::make_unique<ShardedStorage>(file, count);
+    }
+
+    // A database next to store files is the target of a migration that
+    // may not have committed; it wins only once it has.
+    std::unique_ptr<StorageBackend> open() const {
+        size_t existing = existingShards();
+        if (hasDatabase(path)) {
+#ifdef TODO_WITH_SQLITE
+            if (existing == 0 || SqliteStorage::holdsStore(path)) {
+                return openDatabase(path);
+            }
+#else
+            return openDatabase(path);
+#endif
+        }
+        return openLayout(path, existing != 0 ? existing : shards);
+    }
+};
+
+class TodoCLI {
+private:
+    static constexpr int kDefaultArchiveDays = 30;
+
+    StoreOptions options;
+    std::unique_ptr<TodoManager> manager;
+    bool serving;
+
+public:
+    explicit TodoCLI(const StoreOptions& storeOptions) : options(storeOptions), serving(false) {
+        manager = std::make_unique<TodoManager>(configure(options.open()));
+        const char* archiveDays = std::getenv("TODO_ARCHIVE_DAYS");
+        int days = 0;
+        if (archiveDays && *archiveDays) {
+            if (parseTaskId(archiveDays, archiveDays + std::strlen(archiveDays), days) && days >= 0) {
+                manager->setArchivePolicy(days);
+            } else {
+                std::cerr << "Error: Unknown TODO_ARCHIVE_DAYS '" << archiveDays
+                          << "'; expected a number of days. Archiving only on request." << std::endl;
+            }
+        }
+    }
+
+    // `--stats` (anywhere on the command line) or TODO_STATS=1 reports the
+    // command's phase timings, I/O bytes and allocations as a JSON line on
+    // stderr.
+    void run(int argc, char* argv[]) {
+        std::vector<char*> args;
+        bool statsRequested = statsFromEnvironment();
+        for (int i = 0; i < argc; ++i) {
+            if (i > 0 && std::strcmp(argv[i], "--stats") == 0) {
+                statsRequested = true;
+            } else {
+                args.push_back(argv[i]);
+            }
+        }
+        std::string command = args.size() > 1 ? toLowerCase(args[1]) : "help";
+        bool measure = statsRequested && command != "serve";
+
+        CommandStats& stats = CommandStats::current();
+        if (measure) {
+            stats.begin();
+        }
+        dispatch(static_cast<int>(args.size()), args.data());
+        if (measure) {
+            if (manager->isLoaded()) {
+                stats.setTaskCount(manager->taskCount());
+            }
+            stats.report(std::cerr, command);
+        }
+    }
+
+private:
+    static bool statsFromEnvironment() {
+        const char* value = std::getenv("TODO_STATS");
+        return value && *value && std::strcmp(value, "0") != 0;
+    }
+
+    void dispatch(int argc, char* argv[]) {
+        if (argc < 2) {
+            showHelp();
+            return;
+        }
+
+        std::string command = toLowerCase(argv[1]);
+        if (options.shards != 0 && options.shards != manager->shardCount() && command != "migrate") {
+            std::cout << "Error: " << options.path << " has " << manager->shardCount()
+                      << " shard(s), not " << options.shards << "; run 'migrate --shards "
+                      << options.shards << "' to change that." << std::endl;
+            return;
+        }
+
+        if (command == "add") {
+            handleAddCommand(argc, argv);
+        } else if (command == "list") {
+            handleListCommand(argc, argv);
+        } else if (command == "complete") {
+            handleCompleteCommand(argc, argv);
+        } else if (command == "remove") {
+            handleRemoveCommand(argc, argv);
+        } else if (command == "search") {
+            handleSearchCommand(argc, argv);
+        } else if (command == "migrate") {
+            handleMigrateCommand(argc, argv);
+        } else if (command == "compact") {
+            manager->compactStore();
+        } else if (command == "archive") {
+            handleArchiveCommand(argc, argv);
+        } else if (command == "export") {
+            handleExportCommand(argc, argv);
+        } else if (command == "import") {
+            handleImportCommand(argc, argv);
+        } else if (command == "batch" || command == "--stdin") {
+            handleBatchCommand(argc, argv);
+        } else if (command == "serve") {
+            handleServeCommand();
+        } else if (command == "help" || command == "--help" || command == "-h") {
+            showHelp();
+        } else {
+            std::cout << "Unknown command: " << command << std::endl;
+            showHelp();
+        }
+    }
+
+    void handleAddCommand(int argc, char* argv[]) {
+        if (argc < 3) {
+            std::cout << "Error: Please provide a task description." << std::endl;
+            std::cout << "Usage: ./todo add <task description>" << std::endl;
+            return;
+        }
+
+        std::string description = buildDescriptionFromArgs(argc, argv, 2);
+        manager->addTask(description);
+    }
+
+    enum class OptionResult { Parsed, Unknown, Invalid };
+
+    // Status and creation-date options shared by list, complete and remove.
+    // Consumes the option's value, if any, by advancing `i`. Errors go to
+    // `out`.
+    OptionResult parseFilterOption(int argc, char* argv[], int& i, TaskFilter& filter,
+                                   std::ostream& out) const {
+        std::string option = toLowerCase(argv[i]);
+        bool hasValue = i + 1 < argc;
+
+        if (option == "--pending") {
+            filter.status = TaskFilter::Status::Pending;
+        } else if (option == "--done") {
+            filter.status = TaskFilter::Status::Done;
+        } else if ((option == "--since" || option == "--until" || option == "--before") && hasValue) {
+            std::int64_t dayStart = parseTimestamp(std::string(argv[i + 1]) + " 00:00:00");
+            if (dayStart == 0) {
+                out << "Error: " << option << " expects a date as YYYY-MM-DD." << std::endl;
+                return OptionResult::Invalid;
+            }
+            if (option == "--since") {
+                filter.createdFrom = dayStart;
+            } else if (option == "--until") {
+                filter.createdUntil = dayStart + 24 * 60 * 60;
+            } else {
+                filter.createdUntil = dayStart;
+            }
+            ++i;
+        } else {
+            return OptionResult::Unknown;
+        }
+        return OptionResult::Parsed;
+    }
+
+    void handleListCommand(int argc, char* argv[]) {
+        TaskFilter filter;
+        bool includeArchive = false;
+        if (!parseListOptions(argc, argv, filter, includeArchive, std::cout)) {
+            return;
+        }
+        static const std::vector<std::string> everyArchivedTask;
+        manager->listTasks(filter, includeArchive ? &everyArchivedTask : nullptr);
+    }
+
+    // False, after writing the error to `out`, for an invalid list command.
+    bool parseListOptions(int argc, char* argv[], TaskFilter& filter, bool& includeArchive,
+                          std::ostream& out) const {
+        for (int i = 2; i < argc; ++i) {
+            std::string option = toLowerCase(argv[i]);
+            bool hasValue = i + 1 < argc;
+
+            OptionResult result = parseFilterOption(argc, argv, i, filter, out);
+            if (result == OptionResult::Invalid) {
+                return false;
+            }
+            if (result == OptionResult::Parsed) {
+                continue;
+            }
+            if (option == "--all") {
+                includeArchive = true;
+            } else if (option == "--sort" && hasValue) {
+                std::string key = toLowerCase(argv[i + 1]);
+                if (key == "id") {
+                    filter.order = TaskFilter::Order::Id;
+                } else if (key == "created") {
+                    filter.order = TaskFilter::Order::Created;
+                } else if (key == "completed") {
+                    filter.order = TaskFilter::Order::Completed;
+                } else {
+                    out << "Error: --sort expects id, created or completed." << std::endl;
+                    return false;
+                }
+                ++i;
+            } else if ((option == "--limit" || option == "--offset") && hasValue) {
+                int count = 0;
+                if (!parseTaskId(argv[i + 1], argv[i + 1] + std::strlen(argv[i + 1]), count)) {
+                    out << "Error: " << option << " expects a non-negative number." << std::endl;
+                    return false;
+                }
+                (option == "--limit" ? filter.limit : filter.offset) = static_cast<size_t>(count);
+                ++i;
+            } else {
+                out << "Error: Unknown list option: " << argv[i] << std::endl;
+                out << "Usage: ./todo list [--pending|--done] [--since YYYY-MM-DD] "
+                       "[--until YYYY-MM-DD] [--sort id|created|completed] "
+                       "[--offset N] [--limit N] [--all]" << std::endl;
+                return false;
+            }
+        }
+        if (includeArchive && filter.order != TaskFilter::Order::Stored) {
+            out << "Error: --sort cannot be combined with --all." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void handleCompleteCommand(int argc, char* argv[]) {
+        handleBulkCommand(argc, argv, "complete");
+    }
+
+    void handleRemoveCommand(int argc, char* argv[]) {
+        handleBulkCommand(argc, argv, "remove");
+    }
+
+    // complete/remove accept ids, lists and ranges ("3,7,100-5000") and the
+    // list filters. A single id keeps the one-record path; anything else is
+    // applied in one pass with one save.
+    void handleBulkCommand(int argc, char* argv[], const std::string& command) {
+        const std::string usage = "Usage: ./todo " + command +
+                                  " <task_id>[,<id>|<first>-<last>...] [--pending|--done] "
+                                  "[--since DATE] [--until DATE] [--before DATE]";
+        IdSelection selection;
+        TaskFilter filter;
+        bool filtered = false;
+        for (int i = 2; i < argc; ++i) {
+            OptionResult result = parseFilterOption(argc, argv, i, filter, std::cout);
+            if (result == OptionResult::Invalid) {
+                return;
+            }
+            if (result == OptionResult::Parsed) {
+                filtered = true;
+            } else if (argv[i][0] == '-' || !selection.parse(argv[i])) {
+                std::cout << "Error: Task ID must be a number, a list or a range: "
+                          << argv[i] << std::endl;
+                std::cout << usage << std::endl;
+                return;
+            }
+        }
+        if (selection.empty() && !filtered) {
+            std::cout << "Error: Please provide a task ID." << std::endl;
+            std::cout << usage << std::endl;
+            return;
+        }
+
+        if (selection.isSingleId() && !filtered) {
+            int taskId = selection.ranges[0].first;
+            (command == "complete") ? manager->completeTask(taskId) : manager->removeTask(taskId);
+        } else if (command == "complete") {
+            manager->completeMatching(selection, filter);
+        } else {
+            manager->removeMatching(selection, filter);
+        }
+    }
+
+    void handleSearchCommand(int argc, char* argv[]) {
+        if (argc >= 3 && toLowerCase(argv[2]) == "--reindex") {
+            manager->rebuildSearchIndex();
+            return;
+        }
+        bool includeArchive = argc >= 3 && toLowerCase(argv[2]) == "--all";
+        int firstTerm = includeArchive ? 3 : 2;
+        if (argc <= firstTerm) {
+            std::cout << "Error: Please provide search terms." << std::endl;
+            std::cout << "Usage: ./todo search [--all] <terms>" << std::endl;
+            return;
+        }
+        manager->searchTasks(buildDescriptionFromArgs(argc, argv, firstTerm), includeArchive);
+    }
+
+    // --format jsonl|csv; false, after writing the error to `out`, for any
+    // other value.
+    bool parseExportFormat(const char* value, ExportFormat& format, std::ostream& out) const {
+        std::string name = toLowerCase(value);
+        if (name == "jsonl" || name == "json") {
+            format = ExportFormat::JsonLines;
+        } else if (name == "csv") {
+            format = ExportFormat::Csv;
+        } else {
+            out << "Error: --format expects jsonl or csv." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool parseExportOptions(int argc, char* argv[], TaskFilter& filter, ExportFormat& format,
+                            bool& includeArchive, std::ostream& out) const {
+        for (int i = 2; i < argc; ++i) {
+            std::string option = toLowerCase(argv[i]);
+            OptionResult result = parseFilterOption(argc, argv, i, filter, out);
+            if (result == OptionResult::Invalid) {
+                return false;
+            }
+            if (result == OptionResult::Parsed) {
+                continue;
+            }
+            if (option == "--all") {
+                includeArchive = true;
+            } else if (option == "--format" && i + 1 < argc) {
+                if (!parseExportFormat(argv[++i], format, out)) {
+                    return false;
+                }
+            } else {
+                out << "Error: Unknown export option: " << argv[i] << std::endl;
+                out << "Usage: ./todo export [--format jsonl|csv] [--pending|--done] "
+                       "[--since DATE] [--until DATE] [--before DATE] [--all]" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void handleExportCommand(int argc, char* argv[]) {
+        TaskFilter filter;
+        ExportFormat format = ExportFormat::JsonLines;
+        bool includeArchive = false;
+        if (parseExportOptions(argc, argv, filter, format, includeArchive, std::cout)) {
+            manager->exportTasks(filter, format, includeArchive);
+        }
+    }
+
+    // Streams records from a file or stdin into one batch. The format
+    // comes from --format, else from a .csv file name, else JSON Lines.
+    void handleImportCommand(int argc, char* argv[]) {
+        const char* usage = "Usage: ./todo import [--format jsonl|csv] [file]";
+        ExportFormat format = ExportFormat::JsonLines;
+        bool formatGiven = false;
+        const char* path = nullptr;
+        for (int i = 2; i < argc; ++i) {
+            if (toLowerCase(argv[i]) == "--format" && i + 1 < argc) {
+                if (!parseExportFormat(argv[++i], format, std::cout)) {
+                    return;
+                }
+                formatGiven = true;
+            } else if (!path && argv[i][0] != '-') {
+                path = argv[i];
+            } else {
+                std::cout << "Error: Unknown import option: " << argv[i] << std::endl;
+                std::cout << usage << std::endl;
+                return;
+            }
+        }
+
+        std::ifstream file;
+        std::istream* input = &std::cin;
+        if (path) {
+            file.open(path, std::ios::binary);
+            if (!file.is_open()) {
+                std::cout << "Error: Unable to open import file: " << path << std::endl;
+                return;
+            }
+            input = &file;
+            std::string name = toLowerCase(path);
+            if (!formatGiven && name.size() > 4 && name.compare(name.size() - 4, 4, ".csv") == 0) {
+                format = ExportFormat::Csv;
+            }
+        }
+
+        size_t lineNumber = 0;
+        size_t imported = 0;
+        size_t rejected = 0;
+        size_t firstRejectedLine = 0;
+        bool headerPending = format == ExportFormat::Csv;
+        TaskRecordFormat::CsvColumns columns;
+        std::vector<std::string> fields;
+        std::string line;
+        std::string record;
+
+        manager->beginBatch();
+        while (std::getline(*input, line)) {
+            ++lineNumber;
+            size_t recordLine = lineNumber;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            record = line;
+            while (format == ExportFormat::Csv && TaskRecordFormat::isOpenCsvRecord(record) &&
+                   std::getline(*input, line)) {
+                ++lineNumber;
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                record += '\n';
+                record += line;
+            }
+            if (record.find_first_not_of(" \t") == std::string::npos) {
+                continue;
+            }
+
+            ImportedTask task;
+            bool parsed = false;
+            if (format == ExportFormat::JsonLines) {
+                parsed = TaskRecordFormat::parseJson(StringRef(record), task);
+            } else if (TaskRecordFormat::splitCsv(record, fields)) {
+                if (headerPending) {
+                    headerPending = false;
+                    if (columns.assign(fields)) {
+                        continue;
+                    }
+                    columns = TaskRecordFormat::CsvColumns();
+                }
+                parsed = TaskRecordFormat::parseCsv(fields, columns, task);
+            }
+            if (parsed && manager->importTask(task)) {
+                ++imported;
+            } else if (rejected++ == 0) {
+                firstRejectedLine = recordLine;
+            }
+        }
+
+        if (manager->commitBatch()) {
+            std::cout << "Imported " << imported << " task(s).";
+            if (rejected > 0) {
+                std::cout << " Skipped " << rejected << " malformed record(s) (first at line "
+                          << firstRejectedLine << ").";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    void handleArchiveCommand(int argc, char* argv[]) {
+        int days = kDefaultArchiveDays;
+        if (argc >= 3) {
+            if (argc != 4 || toLowerCase(argv[2]) != "--older-than" ||
+                !parseTaskId(argv[3], argv[3] + std::strlen(argv[3]), days) || days < 0) {
+                std::cout << "Error: Please provide the age as --older-than DAYS." << std::endl;
+                std::cout << "Usage: ./todo archive [--older-than DAYS]" << std::endl;
+                return;
+            }
+        }
+        manager->archiveCompleted(days);
+    }
+
+    void handleMigrateCommand(int argc, char* argv[]) {
+        std::string target = (argc < 3) ? "" : toLowerCase(argv[2]);
+        bool inDatabase = StoreOptions::hasDatabase(options.path);
+        if (target == "text" || target == "binary") {
+            StorageFormat format = target == "text" ? StorageFormat::Text : StorageFormat::Binary;
+            if (!inDatabase) {
+                manager->migrateStorage(format);
+                return;
+            }
+            auto files = configure(StoreOptions::openLayout(options.path, 1));
+            files->setFormat(format);
+            manager->migrateLayout(std::move(files), target + " format");
+        } else if (target == "sqlite") {
+            if (inDatabase) {
+                std::cout << "The store is already in SQLite." << std::endl;
+                return;
+            }
+            manager->migrateLayout(configure(StoreOptions::openDatabase(options.path)), "SQLite");
+        } else if (target == "--shards") {
+            size_t count = 0;
+            if (argc != 4 || !StoreOptions::parseShardCount(argv[3], count)) {
+                std::cout << "Error: Please provide a shard count from 1 to "
+                          << ShardedStorage::kMaxShards << "." << std::endl;
+                std::cout << "Usage: ./todo migrate --shards N" << std::endl;
+                return;
+            }
+            if (count == manager->shardCount() && !inDatabase) {
+                std::cout << "The store already has " << count << " shard(s)." << std::endl;
+                return;
+            }
+            auto layout = configure(StoreOptions::openLayout(options.path, count));
+            layout->setFormat(manager->storageFormat());
+            manager->migrateLayout(std::move(layout), std::to_string(count) + " shard(s)");
+        } else {
+            std::cout << "Error: Please provide a storage format (text, binary or sqlite) or "
+                         "--shards N." << std::endl;
+            std::cout << "Usage: ./todo migrate <text|binary|sqlite>" << std::endl;
+            std::cout << "       ./todo migrate --shards N" << std::endl;
+        }
+    }
+
+    void handleBatchCommand(int argc, char* argv[]) {
+        std::ifstream file;
+        std::istream* input = &std::cin;
+        if (argc >= 3) {
+            file.open(argv[2]);
+            if (!file.is_open()) {
+                std::cout << "Error: Unable to open batch file: " << argv[2] << std::endl;
+                return;
+            }
+            input = &file;
+        }
+
+        size_t lineNumber = 0;
+        size_t succeeded = 0;
+        size_t failed = 0;
+        std::string line;
+
+        manager->beginBatch();
+        while (std::getline(*input, line)) {
+            ++lineNumber;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.find_first_not_of(" \t") == std::string::npos || line[0] == '#') {
+                continue;
+            }
+
+            std::cout << lineNumber << ": ";
+            if (applyBatchLine(line)) {
+                ++succeeded;
+            } else {
+                ++failed;
+            }
+        }
+
+        if (manager->commitBatch()) {
+            std::cout << "Batch complete: " << succeeded << " succeeded, "
+                      << failed << " failed." << std::endl;
+        }
+    }
+
+    void handleServeCommand() {
+        if (serving) {
+            std::cout << "Error: The server is already running." << std::endl;
+            return;
+        }
+
+        serving = true;
+        manager->ensureLoaded();
+        manager->publishVersion();
+        TodoServer server(options.socketPath(),
+                          [this](int argc, char* argv[]) {
+                              run(argc, argv);
+                              manager->publishVersion();
+                          },
+                          [this](int argc, char* argv[]) { return prepareRead(argc, argv); });
+        server.run();
+        serving = false;
+    }
+
+    // Plain stored-order listings and exports are rendered by a server read
+    // worker from the version published after the last request. Sorted,
+    // archived and measured ones, and every other command, run on the
+    // server thread.
+    TodoServer::ReadJob prepareRead(int argc, char* argv[]) const {
+        std::string command = argc < 2 ? "" : toLowerCase(argv[1]);
+        if ((command != "list" && command != "export") || statsFromEnvironment()) {
+            return TodoServer::ReadJob();
+        }
+        for (int i = 2; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--stats") == 0) {
+                return TodoServer::ReadJob();
+            }
+        }
+
+        TaskFilter filter;
+        ExportFormat format = ExportFormat::JsonLines;
+        bool includeArchive = false;
+        std::ostringstream errors;
+        bool valid = (command == "list")
+                         ? parseListOptions(argc, argv, filter, includeArchive, errors)
+                         : parseExportOptions(argc, argv, filter, format, includeArchive, errors);
+        if (!valid) {
+            std::string message = errors.str();
+            return [message]() { return message; };
+        }
+        std::shared_ptr<const StoreVersion> pinned = manager->currentVersion();
+        if (includeArchive || filter.order != TaskFilter::Order::Stored || !pinned) {
+            return TodoServer::ReadJob();
+        }
+        if (command == "export") {
+            return [pinned, filter, format]() {
+                std::ostringstream output;
+                TodoManager::exportVersion(*pinned, filter, format, output);
+                return output.str();
+            };
+        }
+        return [pinned, filter]() {
+            std::ostringstream output;
+            TodoManager::listVersion(*pinned, filter, output);
+            return output.str();
+        };
+    }
+
+    bool applyBatchLine(const std::string& line) {
+        size_t split = line.find_first_of(" \t");
+        std::string command = toLowerCase(line.substr(0, split));
+        std::string argument = (split == std::string::npos) ? "" : line.substr(split + 1);
+
+        if (command == "add") {
+            return manager->addTask(argument);
+        }
+
+        if (command == "complete" || command == "remove") {
+            size_t first = argument.find_first_not_of(" \t\r");
+            size_t last = argument.find_last_not_of(" \t\r");
+            int taskId = 0;
+            if (first == std::string::npos ||
+                !parseTaskId(argument.data() + first, argument.data() + last + 1, taskId)) {
+                std::cout << "Error: Task ID must be a number." << std::endl;
+                return false;
+            }
+            return (command == "complete") ? manager->completeTask(taskId)
+                                           : manager->removeTask(taskId);
+        }
+
+        std::cout << "Unknown batch command: " << command << std::endl;
+        return false;
+    }
+
+    void showHelp() const {
+        std::cout << R"(
+CLI Todo Application - Help
+
+Usage: ./todo [--store PATH] [--shards N] <command> [arguments] [--stats]
+
+Options:
+  --store PATH         Use the store at PATH (default todos.txt)
+  --shards N           Split a new store over N files (1 to 64)
+
+Commands:
+  add <description>    Add a new todo task
+  list [options]       Display tasks with their status. Options:
+                         --pending | --done      filter by status
+                         --since / --until DATE  created on or after/before
+                                                 DATE (YYYY-MM-DD, inclusive)
+                         --sort id|created|completed
+                                                 by ID, oldest created or
+                                                 latest completed first
+                         --offset N --limit N    page through the results
+                         --all                   include archived tasks
+  complete <ids>       Mark tasks as complete
+  remove <ids>         Remove tasks from the list
+                       <ids> is an ID, a list or a range (3,7,100-5000);
+                       --pending, --done, --since, --until and --before
+                       DATE (created before DATE) select tasks as well
+  search <terms>       Show tasks whose description contains every term
+                       (search --reindex rebuilds the index, search --all
+                       also scans the archive)
+  export [options]     Write tasks to stdout as JSON Lines or CSV:
+                         --format jsonl|csv      record format (default jsonl)
+                         --all                   include archived tasks
+                       and the list status and date filters
+  import [file]        Add tasks from JSON Lines or CSV (a file, or stdin)
+                       as new tasks in one batch; --format jsonl|csv, or
+                       CSV for a .csv file name
+  migrate <format>     Convert the store to the text or binary format, or
+                       move it into SQLite (sqlite; needs a SQLite build)
+  migrate --shards N   Reshard the store over N files (1: a single file)
+  compact              Fold the journal into a new snapshot and reclaim
+                       the space of removed tasks
+  archive [--older-than DAYS]
+                       Move tasks completed more than DAYS (default 30)
+                       days ago to the compressed archive
+  batch [file]         Apply add/complete/remove lines from a file or stdin
+                       with a single save at the end (alias: --stdin)
+  serve                Keep the store in memory and serve commands over a
+                       local socket; other invocations forward to it
+  help                 Show this help message
+
+Environment:
+  TODO_STORE           Same as --store
+  TODO_SHARDS          Same as --shards
+  TODO_DURABILITY      When to fsync: none, batch (each snapshot, the
+                       default) or op (also every single operation)
+  TODO_IO              pipelined (default: saves write one buffer while
+                       formatting the next, loads read ahead) or sync
+  TODO_PARSE_THREADS   Threads for parsing large text stores (default:
+                       one per core)
+  TODO_ARCHIVE_DAYS    Also archive tasks completed more than this many
+                       days ago whenever the snapshot is rewritten
+  TODO_STATS=1         Same as --stats: print the command's phase timings,
+                       bytes read/written and allocations to stderr as JSON
+
+Examples:
+  ./todo add "Buy groceries"
+  ./todo list
+  ./todo list --pending --limit 20
+  ./todo search groceries
+  ./todo complete 1
+  ./todo remove 2
+  ./todo complete 100-5000
+  ./todo remove --done --before 2026-01-01
+  ./todo migrate binary
+  ./todo --store ~/notes/todos.txt --shards 4 add "Plan the week"
+  ./todo archive --older-than 90
+  ./todo list --all --done
+  ./todo export --format csv --done > done.csv
+  ./todo import tasks.jsonl
+  printf 'add Buy milk\ncomplete 1\n' | ./todo batch
+)" << std::endl;
+    }
+
+    // Applies TODO_DURABILITY, TODO_IO and TODO_PARSE_THREADS.
+    static std::unique_ptr<StorageBackend> configure(std::unique_ptr<StorageBackend> storage) {
+        storage->setDurability(durabilityFromEnvironment());
+        storage->setIoMode(ioModeFromEnvironment());
+        const char* parseThreads = std::getenv("TODO_PARSE_THREADS");
+        int threadCount = 0;
+        if (parseThreads && parseTaskId(parseThreads, parseThreads + std::strlen(parseThreads),
+                                        threadCount) && threadCount > 0) {
+            storage->setParseThreads(static_cast<size_t>(threadCount));
+        }
+        return storage;
+    }
+
+    // TODO_DURABILITY selects none, batch (the default) or op.
+    static Durability durabilityFromEnvironment() {
+        const char* value = std::getenv("TODO_DURABILITY");
+        if (!value || !*value) {
+            return Durability::Batch;
+        }
+        std::string level(value);
+        std::transform(level.begin(), level.end(), level.begin(), ::tolower);
+        if (level == "none") {
+            return Durability::None;
+        }
+        if (level == "op") {
+            return Durability::Op;
+        }
+        if (level != "batch") {
+            std::cerr << "Error: Unknown TODO_DURABILITY '" << value
+                      << "'; expected none, batch or op. Using batch." << std::endl;
+        }
+        return Durability::Batch;
+    }
+
+    // TODO_IO selects pipelined (the default) or sync.
+    static IoMode ioModeFromEnvironment() {
+        const char* value = std::getenv("TODO_IO");
+        if (!value || !*value) {
+            return IoMode::Pipelined;
+        }
+        std::string mode(value);
+        std::transform(mode.begin(), mode.end(), mode.begin(), ::tolower);
+        if (mode == "sync") {
+            return IoMode::Sync;
+        }
+        if (mode != "pipelined") {
+            std::cerr << "Error: Unknown TODO_IO '" << value
+                      << "'; expected pipelined or sync. Using pipelined." << std::endl;
+        }
+        return IoMode::Pipelined;
+    }
+
+    std::string toLowerCase(const std::string& str) const {
+        std::string result = str;
+        std::transform(result.begin(), result.end(), result.begin(), ::tolower);
+        return result;
+    }
+
+    std::string buildDescriptionFromArgs(int argc, char* argv[], int startIndex) const {
+        std::string description;
+        for (int i = startIndex; i < argc; ++i) {
+            if (i > startIndex) {
+                description += " ";
+            }
+            description += argv[i];
+        }
+        return description;
+    }
+};
+
+#ifndef TODO_NO_MAIN
+// Counts allocations for --stats; otherwise behaves like the default
+// operator new. The array and nothrow forms forward here. Kept out of line
+// so compilers do not pair inlined malloc/free calls with new-expressions.
+#if defined(__GNUC__)
+#define TODO_NOINLINE __attribute__((noinline))
+#else
+#define TODO_NOINLINE
+#endif
+
+TODO_NOINLINE void* operator new(std::size_t size) {
+    heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    heapAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    for (;;) {
+        if (void* block = std::malloc(size ? size : 1)) {
+            return block;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+TODO_NOINLINE void operator delete(void* block) noexcept {
+    std::free(block);
+}
+
+TODO_NOINLINE void operator delete(void* block, std::size_t) noexcept {
+    std::free(block);
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        StoreOptions options;
+        std::vector<char*> args;
+        if (!options.parse(argc, argv, args)) {
+            return 1;
+        }
+        TodoClient client(options.socketPath());
+        if (client.forward(static_cast<int>(args.size()), args.data())) {
+            return 0;
+        }
+
+        TodoCLI cli(options);
+        cli.run(static_cast<int>(args.size()), args.data());
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
+#endif
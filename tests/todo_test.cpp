@@ -0,0 +1,983 @@
+// Behavior tests for the store formats, the journal, the archive codec and
+// the import and export formats. Each case runs against stores in a fresh
+// scratch directory, either through the storage classes directly or
+// through TodoCLI in process (runTodo), exactly as the command line would.
+// CMakeLists.txt registers every case with ctest by name.
+//
+// Build: cmake --build build --target todo_test
+// Usage: ./todo_test [case ...]      (every case when none is named)
+
+#define TODO_NO_MAIN
+#include "../main.cpp"
+
+#include "../bench/workload.h"
+
+#include <dirent.h>
+
+namespace {
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+std::vector<TestCase>& testCases() {
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+struct Registration {
+    Registration(const char* name, void (*run)()) { testCases().push_back(TestCase{name, run}); }
+};
+
+size_t failedChecks = 0;
+
+#define TEST_CASE(name)                               \
+    void name();                                      \
+    Registration name##Registration(#name, name);     \
+    void name()
+
+#define CHECK(condition)                                                                     \
+    do {                                                                                     \
+        if (!(condition)) {                                                                  \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed"     \
+                      << std::endl;                                                          \
+            ++failedChecks;                                                                  \
+        }                                                                                    \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                           \
+    do {                                                                                     \
+        const auto& actualValue = (actual);                                                  \
+        const auto& expectedValue = (expected);                                              \
+        if (!(actualValue == expectedValue)) {                                               \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #actual ", " #expected \
+                      << ") failed: " << actualValue << " != " << expectedValue << std::endl; \
+            ++failedChecks;                                                                  \
+        }                                                                                    \
+    } while (0)
+
+// A fresh directory under $TMPDIR (or /tmp), removed with its files.
+class ScratchDirectory {
+private:
+    std::string root;
+
+public:
+    ScratchDirectory() {
+        const char* base = std::getenv("TMPDIR");
+        std::string pattern = std::string(base && *base ? base : "/tmp") + "/todo_test.XXXXXX";
+        std::vector<char> buffer(pattern.begin(), pattern.end());
+        buffer.push_back('\0');
+        if (!::mkdtemp(buffer.data())) {
+            throw std::runtime_error("Unable to create a scratch directory from " + pattern);
+        }
+        root = buffer.data();
+    }
+
+    ~ScratchDirectory() {
+        if (DIR* directory = ::opendir(root.c_str())) {
+            while (dirent* entry = ::readdir(directory)) {
+                std::string name = entry->d_name;
+                if (name != "." && name != "..") {
+                    std::remove(file(name).c_str());
+                }
+            }
+            ::closedir(directory);
+        }
+        ::rmdir(root.c_str());
+    }
+
+    ScratchDirectory(const ScratchDirectory&) = delete;
+    ScratchDirectory& operator=(const ScratchDirectory&) = delete;
+
+    std::string file(const std::string& name) const { return root + "/" + name; }
+};
+
+// Runs one command line against the store at `store`, in process, and
+// returns what it printed on stdout.
+std::string runTodo(const std::string& store, std::vector<std::string> args) {
+    args.insert(args.begin(), {"todo", "--store", store});
+    std::vector<char*> argv;
+    for (auto& argument : args) {
+        argv.push_back(&argument[0]);
+    }
+
+    std::ostringstream output;
+    std::streambuf* previous = std::cout.rdbuf(output.rdbuf());
+    try {
+        StoreOptions options;
+        std::vector<char*> rest;
+        if (options.parse(static_cast<int>(argv.size()), argv.data(), rest)) {
+            TodoCLI cli(options);
+            cli.run(static_cast<int>(rest.size()), rest.data());
+        }
+    } catch (...) {
+        std::cout.rdbuf(previous);
+        throw;
+    }
+    std::cout.rdbuf(previous);
+    return output.str();
+}
+
+// The "<id>. [<status>] <description>" lines of a listing.
+std::vector<std::string> listedTasks(const std::string& listing) {
+    std::vector<std::string> lines;
+    std::istringstream stream(listing);
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (!line.empty() && std::isdigit(static_cast<unsigned char>(line[0])) &&
+            line.find(". [") != std::string::npos) {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+void writeFile(const std::string& path, const std::string& contents, bool append = false) {
+    std::ofstream file(path, append ? std::ios::binary | std::ios::app : std::ios::binary);
+    file << contents;
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+bool sameFields(const TaskFields& actual, const TaskFields& expected) {
+    return actual.id == expected.id && actual.description.str() == expected.description.str() &&
+           actual.completed == expected.completed && actual.createdAt == expected.createdAt &&
+           actual.completedAt == expected.completedAt;
+}
+
+// Reports the first task of `expected` that `actual` lacks or differs in.
+void checkSameTasks(const TaskStore& actual, const TaskStore& expected) {
+    CHECK_EQ(actual.size(), expected.size());
+    for (size_t slot = 0; slot < expected.slotCount(); ++slot) {
+        if (expected.isRemoved(slot)) {
+            continue;
+        }
+        size_t found = actual.find(expected.id(slot));
+        if (found == TaskStore::npos || !sameFields(actual.fieldsAt(found), expected.fieldsAt(slot))) {
+            std::cerr << "Task " << expected.id(slot) << " (" << expected.description(slot)
+                      << ") did not round-trip." << std::endl;
+            ++failedChecks;
+            return;
+        }
+    }
+}
+
+// Synthetic tasks plus descriptions that stress the snapshot encodings.
+TaskStore makeRoundTripTasks(int taskCount) {
+    TaskStore tasks = workload::makeTasks(taskCount);
+    const char* descriptions[] = {"say \"hi\", then leave", "back\\slash and tab\there",
+                                  "café ✓ naïve", "#next-id=7 is not a header", "x",
+                                  "a|b pipe", "|leading", "trailing|", "||",
+                                  "1|0|2024-01-02 03:04:05|"};
+    int taskId = taskCount;
+    for (const char* description : descriptions) {
+        ++taskId;
+        tasks.put(TaskFields{taskId, StringRef(description), taskId % 2 == 0,
+                             1700000000 + taskId, taskId % 2 == 0 ? 1700100000 + taskId : 0});
+    }
+    return tasks;
+}
+
+void checkSnapshotRoundTrip(StorageFormat format, int taskCount, size_t parseThreads) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    TaskStore tasks = makeRoundTripTasks(taskCount);
+    {
+        TodoStorage storage(path);
+        storage.setFormat(format);
+        storage.setDurability(Durability::None);
+        storage.reserveId(static_cast<int>(tasks.slotCount()));
+        CHECK(storage.saveTasks(tasks));
+    }
+
+    TodoStorage reopened(path);
+    reopened.setParseThreads(parseThreads);
+    CHECK(reopened.getFormat() == format);
+    checkSameTasks(reopened.loadTasks(), tasks);
+    CHECK_EQ(reopened.getNextId(), static_cast<int>(tasks.slotCount()) + 1);
+    for (int taskId : {1, taskCount / 2 + 1, static_cast<int>(tasks.slotCount())}) {
+        std::unique_ptr<Task> found = reopened.findTask(taskId);
+        CHECK(found && sameFields(found->fields(), tasks.fieldsAt(tasks.find(taskId))));
+    }
+}
+
+TEST_CASE(text_snapshot_round_trip) {
+    checkSnapshotRoundTrip(StorageFormat::Text, 1000, 1);
+}
+
+TEST_CASE(text_snapshot_parallel_round_trip) {
+    // Large enough to be split into several chunks parsed on their own threads.
+    checkSnapshotRoundTrip(StorageFormat::Text, 200000, 4);
+}
+
+TEST_CASE(binary_snapshot_round_trip) {
+    checkSnapshotRoundTrip(StorageFormat::Binary, 1000, 1);
+}
+
+TEST_CASE(text_snapshot_keeps_pipes_in_descriptions) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    runTodo(path, {"add", "a|b pipe"});
+    runTodo(path, {"add", "ends with|"});
+    runTodo(path, {"complete", "2"});
+    std::string before = runTodo(path, {"list"});
+    CHECK(before.find("1. [○] a|b pipe") != std::string::npos);
+
+    // Compaction moves the records from the journal into the text snapshot.
+    runTodo(path, {"compact"});
+    CHECK(readFile(path).find("1|a|b pipe|0|") != std::string::npos);
+    CHECK_EQ(runTodo(path, {"list"}), before);
+    CHECK(runTodo(path, {"search", "pipe"}).find("a|b pipe") != std::string::npos);
+}
+
+TEST_CASE(text_snapshot_reads_four_field_lines) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    writeFile(path, "1|written by hand|1|2024-01-02 03:04:05\n2|pending|0|2024-01-03 03:04:05|\n");
+    TaskStore tasks = TodoStorage(path).loadTasks();
+    CHECK_EQ(tasks.size(), 2u);
+    size_t slot = tasks.find(1);
+    CHECK(slot != TaskStore::npos);
+    if (slot != TaskStore::npos) {
+        CHECK_EQ(tasks.description(slot).str(), std::string("written by hand"));
+        CHECK(tasks.isCompleted(slot));
+        CHECK_EQ(formatTimestamp(tasks.createdAt(slot)), std::string("2024-01-02 03:04:05"));
+        CHECK_EQ(tasks.completedAt(slot), 0);
+    }
+    TaskFields fields;
+    for (const char* line : {"1|no status", "x|a|0|2024-01-02 03:04:05|", "|a|0|b|c"}) {
+        CHECK(!Task::parseFileLine(line, line + std::strlen(line), fields));
+    }
+}
+
+TEST_CASE(migrate_round_trip) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    for (const char* description : {"first", "second", "third"}) {
+        runTodo(path, {"add", description});
+    }
+    runTodo(path, {"complete", "2"});
+    std::string before = runTodo(path, {"list"});
+
+    CHECK(runTodo(path, {"migrate", "binary"}).find("Migrated 3 task(s)") != std::string::npos);
+    CHECK(TodoStorage(path).getFormat() == StorageFormat::Binary);
+    CHECK_EQ(runTodo(path, {"list"}), before);
+    runTodo(path, {"migrate", "text"});
+    CHECK(TodoStorage(path).getFormat() == StorageFormat::Text);
+    CHECK_EQ(runTodo(path, {"list"}), before);
+}
+
+TEST_CASE(journal_replay_after_torn_tail) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    runTodo(path, {"add", "one"});
+    runTodo(path, {"add", "two"});
+    runTodo(path, {"complete", "1"});
+
+    // A crash in the middle of appending leaves an unterminated record.
+    writeFile(path + ".journal", "A|3|0|2026-01-0", true);
+    std::vector<std::string> listed = listedTasks(runTodo(path, {"list"}));
+    CHECK_EQ(listed.size(), 2u);
+
+    // The next record is cut loose from the torn one and replays.
+    runTodo(path, {"add", "three"});
+    listed = listedTasks(runTodo(path, {"list"}));
+    CHECK_EQ(listed.size(), 3u);
+    if (listed.size() == 3) {
+        CHECK_EQ(listed[0], std::string("1. [✓] one"));
+        CHECK_EQ(listed[1], std::string("2. [○] two"));
+        CHECK_EQ(listed[2], std::string("3. [○] three"));
+    }
+
+    // A journal record that is complete but malformed is skipped as well.
+    writeFile(path + ".journal", "A|not-a-task\nR|\nX\n", true);
+    runTodo(path, {"add", "four"});
+    CHECK_EQ(listedTasks(runTodo(path, {"list"})).size(), 4u);
+}
+
+TEST_CASE(journal_folds_into_snapshot) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    for (const char* description : {"one", "two", "three"}) {
+        runTodo(path, {"add", description});
+    }
+    runTodo(path, {"remove", "2"});
+    std::string before = runTodo(path, {"list"});
+
+    CHECK(runTodo(path, {"compact"}).find("Compacted 2 task(s)") != std::string::npos);
+    CHECK(readFile(path + ".journal").empty());
+    CHECK_EQ(runTodo(path, {"list"}), before);
+    runTodo(path, {"add", "four"});
+    CHECK(runTodo(path, {"list"}).find("4. [○] four") != std::string::npos);
+}
+
+std::string joinIds(const std::vector<int>& ids) {
+    std::string text;
+    for (int taskId : ids) {
+        text += (text.empty() ? "" : ",") + std::to_string(taskId);
+    }
+    return text;
+}
+
+TEST_CASE(search_index_log_parsing) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    SearchIndexFile index(path);
+    std::vector<std::string> plain = {"plain"};
+
+    // Malformed and short lines are skipped, whatever their length.
+    writeFile(path + ".index.log",
+              "x\n+\n+|\n|\n+|5\n+|abc|plain bad id\n*|4|plain bad op\n+|2|plain two\n"
+              "+|3|plain three\n-|3|plain three\n+|4|other\n+|1|plain one\n");
+    CHECK_EQ(joinIds(index.query(plain)), std::string("1,2"));
+    writeFile(path + ".index.log", "x\n", true); // nothing after it to stop a scan
+    CHECK_EQ(joinIds(index.query(plain)), std::string("1,2"));
+
+    // An unterminated line is a record torn by a crash and not applied.
+    writeFile(path + ".index.log", "-|1|plain one", true);
+    CHECK_EQ(joinIds(index.query(plain)), std::string("1,2"));
+
+    // The next flush cuts it off rather than completing it.
+    index.stageAdded(6, StringRef("plain six"));
+    index.flush();
+    CHECK_EQ(joinIds(index.query(plain)), std::string("1,2,6"));
+    std::string log = readFile(path + ".index.log");
+    CHECK(log.find("-|1|") == std::string::npos);
+    const std::string appended = "+|6|plain six\n";
+    CHECK(log.size() >= appended.size() &&
+          log.compare(log.size() - appended.size(), appended.size(), appended) == 0);
+}
+
+TEST_CASE(search_after_damaged_index_log) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    runTodo(path, {"add", "plain one"});
+    runTodo(path, {"add", "other"});
+    writeFile(path + ".index.log", "x\n", true);
+    CHECK(runTodo(path, {"search", "plain"}).find("1. [○] plain one") != std::string::npos);
+
+    runTodo(path, {"add", "plain three"});
+    writeFile(path + ".index.log", "-|3|plain thr", true);
+    runTodo(path, {"add", "plain four"});
+    std::vector<std::string> found = listedTasks(runTodo(path, {"search", "plain"}));
+    CHECK_EQ(found.size(), 3u);
+}
+
+TEST_CASE(search_after_damaged_index_header) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    runTodo(path, {"add", "hello world"});
+    runTodo(path, {"add", "other"});
+    std::string search = runTodo(path, {"search", "hello"});
+    CHECK(search.find("1. [○] hello world") != std::string::npos);
+    std::string index = readFile(path + ".index");
+
+    // A header alone, whose token count wraps the size of the offset
+    // columns around to the bytes present; then an index cut short.
+    std::string header("TODX\x01\0\0\0", 8);
+    std::uint64_t counts[3] = {(std::uint64_t(1) << 60) - 1, 0, 0};
+    header.append(reinterpret_cast<const char*>(counts), sizeof(counts));
+    for (const std::string& damaged : {header, index.substr(0, index.size() - 1)}) {
+        writeFile(path + ".index", damaged);
+        CHECK_EQ(runTodo(path, {"search", "hello"}), search);
+        CHECK_EQ(readFile(path + ".index"), index);
+    }
+}
+
+size_t detectedShards(const std::string& path) {
+    StoreOptions options;
+    options.path = path;
+    return options.existingShards();
+}
+
+TEST_CASE(shard_detection_of_single_store) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    CHECK_EQ(detectedShards(path), 0u);
+
+    // Until the journal compacts, a single store has no snapshot file.
+    runTodo(path, {"add", "one"});
+    runTodo(path, {"add", "two"});
+    CHECK(!std::ifstream(path).is_open());
+    CHECK_EQ(detectedShards(path), 1u);
+    std::string listing = runTodo(path, {"list"});
+    CHECK_EQ(listedTasks(listing).size(), 2u);
+
+    // Asking it for another layout is refused rather than opening an empty one.
+    CHECK(runTodo(path, {"--shards", "4", "list"}).find("has 1 shard(s), not 4") !=
+          std::string::npos);
+    ::setenv("TODO_SHARDS", "4", 1);
+    runTodo(path, {"add", "three"});
+    ::unsetenv("TODO_SHARDS");
+    CHECK(!std::ifstream(ShardedStorage::manifestPath(path)).is_open());
+    CHECK_EQ(runTodo(path, {"list"}), listing);
+
+    // The journal, lock file, id sidecar or snapshot alone mark a store.
+    for (const char* suffix : {".journal", ".lock", ".ids", ""}) {
+        std::string other = scratch.file(std::string("other.txt") + suffix);
+        writeFile(other, "");
+        CHECK_EQ(detectedShards(scratch.file("other.txt")), 1u);
+        std::remove(other.c_str());
+    }
+    runTodo(path, {"migrate", "binary"});
+    CHECK_EQ(detectedShards(path), 1u);
+    CHECK_EQ(runTodo(path, {"list"}), listing);
+}
+
+TEST_CASE(shard_detection_of_sharded_store) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    runTodo(path, {"--shards", "3", "add", "one"});
+    runTodo(path, {"add", "two"});
+    CHECK_EQ(detectedShards(path), 3u);
+    CHECK(runTodo(path, {"--shards", "2", "add", "three"}).find("has 3 shard(s), not 2") !=
+          std::string::npos);
+    CHECK_EQ(listedTasks(runTodo(path, {"list"})).size(), 2u);
+
+    CHECK(runTodo(path, {"migrate", "--shards", "1"}).find("Migrated 2 task(s)") !=
+          std::string::npos);
+    CHECK_EQ(detectedShards(path), 1u);
+    std::vector<std::string> listed = listedTasks(runTodo(path, {"list"}));
+    CHECK_EQ(listed.size(), 2u);
+    if (listed.size() == 2) {
+        CHECK_EQ(listed[1], std::string("2. [○] two"));
+    }
+}
+
+void checkExportImportRoundTrip(const std::string& format, const std::string& extension) {
+    ScratchDirectory scratch;
+    std::string source = scratch.file("source.txt");
+    std::string target = scratch.file("target.txt");
+    std::string exported = scratch.file("tasks." + extension);
+    const char* descriptions[] = {"plain", "say \"hi\", then leave", "comma, and ; semicolon",
+                                  "back\\slash and tab\there", "café ✓ naïve", "{\"json\": [1]}"};
+    for (const char* description : descriptions) {
+        runTodo(source, {"add", description});
+    }
+    runTodo(source, {"complete", "2,5"});
+
+    std::string sourceExport = runTodo(source, {"export", "--format", format});
+    CHECK(!sourceExport.empty());
+    writeFile(exported, sourceExport);
+    CHECK(runTodo(target, {"import", exported}).find("Imported 6 task(s).") != std::string::npos);
+
+    // Ids are reassigned on import; they start at 1 in both stores.
+    CHECK_EQ(runTodo(target, {"export", "--format", format}), sourceExport);
+    CHECK_EQ(runTodo(target, {"list"}), runTodo(source, {"list"}));
+}
+
+TEST_CASE(jsonl_export_import_round_trip) {
+    checkExportImportRoundTrip("jsonl", "jsonl");
+}
+
+TEST_CASE(csv_export_import_round_trip) {
+    checkExportImportRoundTrip("csv", "csv");
+}
+
+TEST_CASE(csv_import_of_quoted_line_breaks) {
+    std::string record = "7,\"two\nlines, \"\"quoted\"\"\",0,,";
+    CHECK(TaskRecordFormat::isOpenCsvRecord("7,\"two"));
+    CHECK(!TaskRecordFormat::isOpenCsvRecord(record));
+    std::vector<std::string> fields;
+    CHECK(TaskRecordFormat::splitCsv(record, fields));
+    ImportedTask task;
+    CHECK(TaskRecordFormat::parseCsv(fields, TaskRecordFormat::CsvColumns(), task));
+    CHECK_EQ(task.description, std::string("two\nlines, \"quoted\""));
+    CHECK(!task.completed);
+    CHECK(!TaskRecordFormat::splitCsv("1,\"unterminated", fields));
+}
+
+TEST_CASE(jsonl_import_rejects_malformed_records) {
+    ImportedTask task;
+    CHECK(TaskRecordFormat::parseJson(StringRef("{\"description\":\"a\\u00e9\\n\"}"), task));
+    CHECK_EQ(task.description, std::string("a\xc3\xa9\n"));
+    for (const char* line : {"", "{}", "{\"description\":\"a\"", "{\"description\":1}",
+                             "{\"description\":\"a\",\"completed\":\"yes\"}",
+                             "{\"description\":\"a\"} trailing", "[\"description\"]"}) {
+        ImportedTask rejected;
+        if (TaskRecordFormat::parseJson(StringRef(line), rejected)) {
+            std::cerr << "Accepted malformed record: " << line << std::endl;
+            ++failedChecks;
+        }
+    }
+}
+
+// An LZ block copied flush against an unreadable page, so a decoder that
+// reads past the end of its input faults instead of passing by luck.
+class GuardedBlock {
+private:
+    char* mapped;
+    size_t mappedSize;
+    const char* block;
+    size_t size;
+
+public:
+    explicit GuardedBlock(const std::string& bytes) : block(nullptr), size(bytes.size()) {
+        size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t dataPages = (size + page - 1) / page + 1;
+        mappedSize = (dataPages + 1) * page;
+        void* region = ::mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) {
+            throw std::runtime_error("Unable to map a guarded block");
+        }
+        mapped = static_cast<char*>(region);
+        ::mprotect(mapped + dataPages * page, page, PROT_NONE);
+        char* start = mapped + dataPages * page - size;
+        std::memcpy(start, bytes.data(), size);
+        block = start;
+    }
+
+    ~GuardedBlock() { ::munmap(mapped, mappedSize); }
+
+    GuardedBlock(const GuardedBlock&) = delete;
+    GuardedBlock& operator=(const GuardedBlock&) = delete;
+
+    bool decompress(size_t rawSize, std::string& out) const {
+        return decompressBlock(block, size, rawSize, out);
+    }
+};
+
+void checkLzRoundTrip(const std::string& raw) {
+    std::string compressed = compressBlock(raw.data(), raw.size());
+    std::string restored = "left over from an earlier block";
+    CHECK(GuardedBlock(compressed).decompress(raw.size(), restored));
+    CHECK(restored == raw);
+}
+
+std::string randomBytes(size_t size, unsigned seed) {
+    std::mt19937 random(seed);
+    std::string bytes(size, '\0');
+    for (auto& byte : bytes) {
+        byte = static_cast<char>(random() & 0xFF);
+    }
+    return bytes;
+}
+
+// Journal lines as the archive writes them.
+std::string archiveLines(int taskCount) {
+    TaskStore tasks = workload::makeTasks(taskCount);
+    std::string raw;
+    for (size_t slot = 0; slot < tasks.slotCount(); ++slot) {
+        raw += Task::fromFields(tasks.fieldsAt(slot)).toJournalString();
+        raw += '\n';
+    }
+    return raw;
+}
+
+TEST_CASE(lz_block_round_trip) {
+    for (const char* text : {"", "a", "abc", "abcd", "abcdabcd", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaa"}) {
+        checkLzRoundTrip(text);
+    }
+    // Incompressible input is all literals, with long literal lengths.
+    for (size_t size : {15u, 16u, 269u, 270u, 271u, 4096u, 200000u}) {
+        checkLzRoundTrip(randomBytes(size, static_cast<unsigned>(size)));
+    }
+    // Runs are matches that overlap what they produce, with long match lengths.
+    checkLzRoundTrip(std::string(100000, 'x'));
+    checkLzRoundTrip(std::string(19, 'y') + std::string(274, 'z') + "tail");
+
+    std::string lines = archiveLines(2000);
+    CHECK(compressBlock(lines.data(), lines.size()).size() < lines.size() * 2 / 3);
+    checkLzRoundTrip(lines);
+    // Matches and literals mixed with incompressible stretches.
+    checkLzRoundTrip(lines.substr(0, 5000) + randomBytes(3000, 7) + lines.substr(0, 70000));
+}
+
+TEST_CASE(lz_block_rejects_corrupt_input) {
+    std::string raw = archiveLines(200);
+    std::string compressed = compressBlock(raw.data(), raw.size());
+    std::string out;
+    CHECK(GuardedBlock(compressed).decompress(raw.size(), out) && out == raw);
+
+    // A block that stops early, or expands to other than the size it was
+    // stored with.
+    for (size_t size = 0; size < compressed.size(); ++size) {
+        if (GuardedBlock(compressed.substr(0, size)).decompress(raw.size(), out)) {
+            std::cerr << "Accepted a block truncated to " << size << " bytes." << std::endl;
+            ++failedChecks;
+            break;
+        }
+    }
+    CHECK(!GuardedBlock(compressed).decompress(raw.size() - 1, out));
+    CHECK(!GuardedBlock(compressed).decompress(raw.size() + 1, out));
+    // A stored size no block this long could expand to is refused before
+    // anything is allocated for it.
+    CHECK(!GuardedBlock(compressed).decompress(size_t(1) << 40, out));
+
+    // Lengths that run off the end, a zero distance and a distance before
+    // the start of the output.
+    for (const std::string& bad :
+         {std::string("\xF0"), std::string("\xF0\xFF\xFF", 3), std::string("\x1F" "a", 2),
+          std::string("\x10" "a\x00\x00", 4), std::string("\x10" "a\x02\x00", 4),
+          std::string("\x1F" "a\x01\x00\xFF", 5), std::string("\x00", 1)}) {
+        CHECK(!GuardedBlock(bad).decompress(64, out));
+    }
+
+    // Random damage is either rejected or decodes to exactly the stored
+    // size, and is never read past the end of the block.
+    std::mt19937 random(11);
+    for (int round = 0; round < 2000; ++round) {
+        std::string damaged = compressed;
+        for (int flips = 1 + static_cast<int>(random() % 4); flips > 0; --flips) {
+            damaged[random() % damaged.size()] = static_cast<char>(random() & 0xFF);
+        }
+        if (round % 2 == 1) {
+            damaged.resize(random() % damaged.size());
+        }
+        if (GuardedBlock(damaged).decompress(raw.size(), out)) {
+            CHECK_EQ(out.size(), raw.size());
+        }
+    }
+}
+
+std::vector<Task> archivedTasks(int taskCount) {
+    TaskStore tasks = workload::makeTasks(taskCount);
+    std::vector<Task> records;
+    for (size_t slot = 0; slot < tasks.slotCount(); ++slot) {
+        records.push_back(Task::fromFields(tasks.fieldsAt(slot)));
+    }
+    return records;
+}
+
+size_t archivedCount(const TaskArchive& archive) {
+    size_t visited = 0;
+    archive.scan(TaskFilter(), {}, 1, [&visited](const TaskFields&) { ++visited; });
+    return visited;
+}
+
+TEST_CASE(archive_rejects_corrupt_blocks) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    TaskArchive archive(path);
+    // Several blocks of about 64 KiB each.
+    std::vector<Task> records = archivedTasks(5000);
+    CHECK(archive.append(records, 0, 1, Durability::None, IoMode::Sync));
+    CHECK_EQ(archivedCount(archive), records.size());
+    CHECK_EQ(archive.count(1), records.size());
+
+    // Overwriting the start of the first block with length bytes that run
+    // past its end.
+    std::string original = readFile(archive.getFilename());
+    std::string damaged = original;
+    std::memset(&damaged[8], 0xFF, 64);
+    writeFile(archive.getFilename(), damaged);
+    bool rejected = false;
+    try {
+        archivedCount(archive);
+    } catch (const std::runtime_error& e) {
+        rejected = std::string(e.what()).find("Corrupt archive block") != std::string::npos;
+    }
+    CHECK(rejected);
+
+    // A trailer whose index offset wraps around to pass the size check:
+    // two 56-byte ArchiveBlocks and the 24-byte trailer "end" 16 bytes
+    // before the start of a 120-byte file.
+    std::string wrapped = original.substr(0, 8) + std::string(88, '\0');
+    std::uint64_t indexOffset = 0 - std::uint64_t(16);
+    std::uint64_t blockCount = 2;
+    std::uint32_t version = 1;
+    wrapped.append(reinterpret_cast<const char*>(&indexOffset), 8);
+    wrapped.append(reinterpret_cast<const char*>(&blockCount), 8);
+    wrapped.append("TODA", 4);
+    wrapped.append(reinterpret_cast<const char*>(&version), 4);
+    writeFile(archive.getFilename(), wrapped);
+    rejected = false;
+    try {
+        archive.count(1);
+    } catch (const std::runtime_error& e) {
+        rejected = std::string(e.what()).find("Corrupt archive") != std::string::npos;
+    }
+    CHECK(rejected);
+
+    // A file cut short anywhere loses its trailer.
+    for (size_t size : {size_t(4), size_t(8), original.size() / 2, original.size() - 1}) {
+        writeFile(archive.getFilename(), original.substr(0, size));
+        rejected = false;
+        try {
+            archive.count(1);
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        CHECK(rejected);
+    }
+}
+
+// True when `load` throws a runtime_error whose message contains `what`.
+template <typename Load>
+bool rejectsWith(const std::string& what, Load load) {
+    try {
+        load();
+    } catch (const std::runtime_error& e) {
+        return std::string(e.what()).find(what) != std::string::npos;
+    }
+    return false;
+}
+
+TEST_CASE(binary_snapshot_rejects_wrapped_sizes) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    runTodo(path, {"add", "one"});
+    runTodo(path, {"add", "two"});
+    runTodo(path, {"migrate", "binary"});
+    std::string original = readFile(path);
+
+    // Two 29-byte rows after the 40-byte header, 6 bytes short of the last
+    // offset entry and the status column, with a heap size of 2^64 - 8 that
+    // wraps the sum of the column sizes around to the bytes left.
+    std::string damaged = original.substr(0, 40 + 2 * 29);
+    std::uint64_t heapSize = 0 - std::uint64_t(8);
+    std::memcpy(&damaged[16], &heapSize, sizeof(heapSize));
+    writeFile(path, damaged);
+    CHECK(rejectsWith("Corrupt binary task file", [&] { TodoStorage(path).loadTasks(); }));
+    CHECK(rejectsWith("Corrupt binary task file", [&] { runTodo(path, {"list"}); }));
+
+    // A count that leaves no room for the final offset entry.
+    damaged = original.substr(0, 40 + 2 * 29 + 4);
+    writeFile(path, damaged);
+    CHECK(rejectsWith("Corrupt binary task file", [&] { TodoStorage(path).loadTasks(); }));
+}
+
+// Overwrites the 8 bytes at `offset` of the file at `path`.
+void patchWord(const std::string& path, size_t offset, std::uint64_t value) {
+    std::string contents = readFile(path);
+    CHECK(offset + sizeof(value) <= contents.size());
+    if (offset + sizeof(value) <= contents.size()) {
+        std::memcpy(&contents[offset], &value, sizeof(value));
+        writeFile(path, contents);
+    }
+}
+
+// A two-task store whose .ids sidecar has been built: a 32-byte header,
+// the ids at 32 and their positions at 40 and 48.
+std::string storeWithIdIndex(ScratchDirectory& scratch, const char* format) {
+    std::string path = scratch.file(std::string(format) + ".txt");
+    runTodo(path, {"add", "one"});
+    runTodo(path, {"add", "two"});
+    runTodo(path, {"migrate", format});
+    runTodo(path, {"complete", "2"});
+    CHECK_EQ(readFile(path + ".ids").size(), 32u + 2 * 12);
+    return path;
+}
+
+TEST_CASE(id_index_rejects_positions_past_snapshot) {
+    ScratchDirectory scratch;
+    for (const char* format : {"text", "binary"}) {
+        std::string path = storeWithIdIndex(scratch, format);
+        patchWord(path + ".ids", 40, std::uint64_t(1) << 40);
+        CHECK(runTodo(path, {"remove", "1"}).find("Task 1 removed") != std::string::npos);
+        CHECK(listedTasks(runTodo(path, {"list"})) == std::vector<std::string>{"2. [✓] two"});
+    }
+}
+
+TEST_CASE(id_index_rejects_positions_of_other_tasks) {
+    ScratchDirectory scratch;
+    for (const char* format : {"text", "binary"}) {
+        // Task 1's entry points at task 2's record.
+        std::string path = storeWithIdIndex(scratch, format);
+        std::string index = readFile(path + ".ids");
+        patchWord(path + ".ids", 40, readColumnValue<std::uint64_t>(index.data() + 40, 1));
+        runTodo(path, {"add", "three"});
+        runTodo(path, {"complete", "3"});
+        runTodo(path, {"complete", "1"});
+        std::vector<std::string> listed = listedTasks(runTodo(path, {"list"}));
+        CHECK_EQ(listed.size(), 3u);
+        if (listed.size() == 3) {
+            CHECK_EQ(listed[0], std::string("1. [✓] one"));
+            CHECK_EQ(listed[1], std::string("2. [✓] two"));
+        }
+    }
+}
+
+TEST_CASE(id_index_rejects_wrapped_counts) {
+    ScratchDirectory scratch;
+    for (const char* format : {"text", "binary"}) {
+        // 2^62 + 2 entries of 12 bytes wrap around to the 24 bytes present.
+        std::string path = storeWithIdIndex(scratch, format);
+        patchWord(path + ".ids", 24, (std::uint64_t(1) << 62) + 2);
+        CHECK(runTodo(path, {"remove", "1"}).find("Task 1 removed") != std::string::npos);
+        CHECK(listedTasks(runTodo(path, {"list"})) == std::vector<std::string>{"2. [✓] two"});
+    }
+}
+
+TEST_CASE(order_index_rejects_positions_past_snapshot) {
+    ScratchDirectory scratch;
+    for (const char* format : {"text", "binary"}) {
+        std::string path = scratch.file(std::string(format) + ".txt");
+        for (const char* description : {"one", "two", "three"}) {
+            runTodo(path, {"add", description});
+        }
+        runTodo(path, {"migrate", format});
+        std::string sorted = runTodo(path, {"list", "--sort", "created"});
+        CHECK_EQ(listedTasks(sorted).size(), 3u);
+
+        // The first entry of byCreated, after the header and byId.
+        patchWord(path + ".order", 32 + 3 * 8, std::uint64_t(1) << 40);
+        CHECK_EQ(listedTasks(runTodo(path, {"list", "--sort", "created"})).size(), 2u);
+        CHECK_EQ(runTodo(path, {"list", "--sort", "created"}), sorted);
+    }
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+TEST_CASE(server_times_out_idle_clients) {
+    ScratchDirectory scratch;
+    std::string socketPath = scratch.file("todos.sock");
+    TodoServer server(socketPath, [](int argc, char** argv) {
+        std::cout << "ran " << argv[argc - 1] << std::endl;
+    });
+    server.setRequestTimeout(200);
+
+    // The server thread swaps std::cout while it handles a request, so it
+    // is captured once, around the server's whole life.
+    std::ostringstream output;
+    std::streambuf* previous = std::cout.rdbuf(output.rdbuf());
+    serverStopRequested = 0;
+    std::thread serving([&server]() { server.run(); });
+    for (int attempt = 0; attempt < 200 && ::access(socketPath.c_str(), F_OK) != 0; ++attempt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    // A client that connects and sends nothing does not hold up the next.
+    int idle = connectToSocket(socketPath);
+    TodoClient client(socketPath);
+    std::string command[] = {"todo", "list"};
+    char* argv[] = {&command[0][0], &command[1][0]};
+    auto start = std::chrono::steady_clock::now();
+    bool forwarded = client.forward(2, argv);
+    double elapsed = secondsSince(start);
+    std::string idleResponse;
+    bool answered = readAll(idle, idleResponse, 5000);
+    ::close(idle);
+
+    serverStopRequested = 1;
+    ::close(connectToSocket(socketPath)); // wakes the accept loop
+    serving.join();
+    std::cout.rdbuf(previous);
+
+    CHECK(forwarded);
+    CHECK(elapsed < 3);
+    CHECK(output.str().find("ran list\n") != std::string::npos);
+    CHECK(answered);
+    CHECK_EQ(idleResponse, std::string("Error: Timed out waiting for the request.\n"));
+}
+
+TEST_CASE(client_times_out_wedged_server) {
+    ScratchDirectory scratch;
+    std::string socketPath = scratch.file("todos.sock");
+    // Listens, so connections queue, but never accepts one.
+    sockaddr_un address;
+    CHECK(makeSocketAddress(socketPath, address));
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK(::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    CHECK(::listen(listener, 4) == 0);
+
+    TodoClient client(socketPath);
+    client.setResponseTimeout(200);
+    std::string command[] = {"todo", "list"};
+    char* argv[] = {&command[0][0], &command[1][0]};
+    std::ostringstream errors;
+    std::streambuf* previous = std::cerr.rdbuf(errors.rdbuf());
+    auto start = std::chrono::steady_clock::now();
+    bool forwarded = client.forward(2, argv);
+    double elapsed = secondsSince(start);
+    std::cerr.rdbuf(previous);
+    ::close(listener);
+    ::unlink(socketPath.c_str());
+
+    CHECK(forwarded);
+    CHECK(elapsed < 3);
+    CHECK(errors.str().find("did not answer in time") != std::string::npos);
+}
+
+#ifdef TODO_WITH_SQLITE
+// The ids a scan visits, in the order it visits them.
+std::string scannedIds(const StorageBackend& storage, const TaskFilter& filter) {
+    std::vector<int> ids;
+    storage.scanTasks(filter, [&ids](const TaskFields& fields) { ids.push_back(fields.id); });
+    return joinIds(ids);
+}
+
+TEST_CASE(sqlite_scan_matches_file_scan) {
+    ScratchDirectory scratch;
+    std::string path = scratch.file("todos.txt");
+    TaskStore tasks = workload::makeTasks(2000);
+    TodoStorage files(path);
+    files.setDurability(Durability::None);
+    CHECK(files.saveTasks(tasks));
+    SqliteStorage database(path);
+    database.setDurability(Durability::None);
+    CHECK(database.saveTasks(tasks));
+
+    // Every filter value goes through the same few prepared statements.
+    std::vector<int> someIds;
+    for (int taskId = 30; taskId <= 1500; taskId += 7) {
+        someIds.push_back(taskId);
+    }
+    const std::int64_t day = 86400;
+    for (TaskFilter::Order order :
+         {TaskFilter::Order::Id, TaskFilter::Order::Created, TaskFilter::Order::Completed}) {
+        for (TaskFilter::Status status :
+             {TaskFilter::Status::Any, TaskFilter::Status::Pending, TaskFilter::Status::Done}) {
+            for (std::int64_t window = 0; window < 4; ++window) {
+                TaskFilter filter;
+                filter.order = order;
+                filter.status = status;
+                filter.createdFrom = window == 0 ? 0 : workload::kEpochEnd - window * 90 * day;
+                filter.createdUntil = window < 2 ? 0 : filter.createdFrom + window * 30 * day;
+                filter.ids = window == 3 ? &someIds : nullptr;
+                filter.offset = window == 1 ? 5 : 0;
+                filter.limit = window == 1 ? 40 : TaskFilter::kUnlimited;
+                CHECK_EQ(scannedIds(database, filter), scannedIds(files, filter));
+            }
+        }
+    }
+}
+#endif
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    // The cases pick their own store, layout and settings.
+    for (const char* name : {"TODO_STORE", "TODO_SHARDS", "TODO_STATS", "TODO_ARCHIVE_DAYS",
+                             "TODO_PARSE_THREADS", "TODO_DURABILITY", "TODO_IO"}) {
+        ::unsetenv(name);
+    }
+
+    std::vector<std::string> selected(argv + 1, argv + argc);
+    for (const auto& name : selected) {
+        auto named = [&name](const TestCase& test) { return name == test.name; };
+        if (std::none_of(testCases().begin(), testCases().end(), named)) {
+            std::cerr << "Unknown test case: " << name << std::endl;
+            return 1;
+        }
+    }
+
+    size_t ran = 0;
+    size_t failed = 0;
+    for (const auto& test : testCases()) {
+        if (!selected.empty() &&
+            std::find(selected.begin(), selected.end(), test.name) == selected.end()) {
+            continue;
+        }
+        size_t failuresBefore = failedChecks;
+        try {
+            test.run();
+        } catch (const std::exception& e) {
+            std::cerr << test.name << " threw: " << e.what() << std::endl;
+            ++failedChecks;
+        }
+        bool passed = failedChecks == failuresBefore;
+        std::cout << (passed ? "ok      " : "FAILED  ") << test.name << std::endl;
+        ++ran;
+        failed += passed ? 0 : 1;
+    }
+    std::cout << ran - failed << " of " << ran << " test case(s) passed." << std::endl;
+    return failed == 0 ? 0 : 1;
+}